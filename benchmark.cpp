@@ -1,6 +1,11 @@
 
 #include "game.h"
 #include "lzw.h"
+#include "mdec.h"
+#include "mixer.h"
+#include "paf.h"
+#include "palette.h"
+#include "scaler.h"
 #include "system.h"
 #include "util.h"
 #include "video.h"
@@ -24,9 +29,9 @@ uint32_t Game::benchmarkCpu() {
 	uint8_t *p = _video->_shadowLayer;
 	int count = 32;
 	do {
-		decodeLZW(_pwr1_screenTransformData, p);
+		decodeLZW(&_res->_lzw, _pwr1_screenTransformData, p);
 		benchmarkLoop(p, Video::W * Video::H);
-		decodeLZW(_pwr2_screenTransformData, p);
+		decodeLZW(&_res->_lzw, _pwr2_screenTransformData, p);
 		_video->updateGameDisplay(p);
 	} while (--count != 0);
 	const uint32_t score = g_system->getTimeStamp() - t0;
@@ -35,3 +40,755 @@ uint32_t Game::benchmarkCpu() {
 	warning("benchmark CPU %d", score);
 	return score;
 }
+
+static const int kMaxBenchmarkResults = 64;
+
+struct BenchmarkResult {
+	const char *name;
+	const char *unit;
+	int iterations;
+	uint64_t minNs, medianNs, p99Ns;
+	double throughput; // units per second, from the median
+};
+
+static BenchmarkResult _benchmarkResults[kMaxBenchmarkResults];
+static int _benchmarkResultsCount;
+
+static int compareUint64(const void *a, const void *b) {
+	const uint64_t t1 = *(const uint64_t *)a;
+	const uint64_t t2 = *(const uint64_t *)b;
+	return (t1 < t2) ? -1 : ((t1 > t2) ? 1 : 0);
+}
+
+static void addBenchmarkResult(const char *name, const char *unit, double unitsPerIteration, uint64_t *samplesNs, int count) {
+	if (count <= 0 || _benchmarkResultsCount >= kMaxBenchmarkResults) {
+		return;
+	}
+	qsort(samplesNs, count, sizeof(uint64_t), compareUint64);
+	BenchmarkResult *r = &_benchmarkResults[_benchmarkResultsCount++];
+	r->name = name;
+	r->unit = unit;
+	r->iterations = count;
+	r->minNs = samplesNs[0];
+	r->medianNs = samplesNs[count / 2];
+	r->p99Ns = samplesNs[MIN(count - 1, count * 99 / 100)];
+	r->throughput = (r->medianNs != 0) ? unitsPerIteration * 1e9 / r->medianNs : 0.;
+	fprintf(stdout, "%-24s %6d iterations min %9.3f ms median %9.3f ms p99 %9.3f ms %10.2f %s\n", name, count, r->minNs / 1e6, r->medianNs / 1e6, r->p99Ns / 1e6, r->throughput, unit);
+}
+
+typedef void (*BenchmarkProc)(void *userdata);
+
+static void runBenchmark(const char *name, const char *unit, double unitsPerIteration, int iterations, BenchmarkProc proc, void *userdata) {
+	uint64_t *samplesNs = (uint64_t *)malloc(iterations * sizeof(uint64_t));
+	if (!samplesNs) {
+		return;
+	}
+	// warm up caches
+	proc(userdata);
+	proc(userdata);
+	for (int i = 0; i < iterations; ++i) {
+		const uint64_t t0 = getTimeNs();
+		proc(userdata);
+		samplesNs[i] = getTimeNs() - t0;
+	}
+	addBenchmarkResult(name, unit, unitsPerIteration, samplesNs, iterations);
+	free(samplesNs);
+}
+
+// deterministic data for the benchmarks
+struct BenchmarkRandom {
+	uint32_t _state;
+
+	BenchmarkRandom(uint32_t seed)
+		: _state(seed) {
+	}
+	uint32_t next() {
+		_state = _state * 1103515245 + 12345;
+		return _state >> 16;
+	}
+};
+
+static const int kSpriteSize = 64;
+static const int kSpritesCount = 48;
+
+// encodes a 8-bit image (0 is transparent) using the opcodes of Video::decodeSPR
+static int encodeSPR(const uint8_t *src, int w, int h, uint8_t *dst) {
+	uint8_t *p = dst;
+	for (int y = 0; y < h; ++y) {
+		if (y != 0) {
+			*p++ = (3 << 6) | 1; // next line
+			*p++ = 0; // x offset
+		}
+		const uint8_t *line = src + y * w;
+		int x = 0;
+		while (x < w) {
+			int count = 1;
+			if (line[x] == 0) {
+				while (x + count < w && line[x + count] == 0 && count < 63) {
+					++count;
+				}
+				if (x + count < w) {
+					*p++ = (2 << 6) | count;
+				}
+			} else {
+				while (x + count < w && line[x + count] == line[x] && count < 63) {
+					++count;
+				}
+				if (count >= 3) {
+					*p++ = (1 << 6) | count;
+					*p++ = line[x];
+				} else {
+					count = 1;
+					while (x + count < w && line[x + count] != 0 && count < 63) {
+						if (x + count + 2 < w && line[x + count] == line[x + count + 1] && line[x + count] == line[x + count + 2]) {
+							break;
+						}
+						++count;
+					}
+					*p++ = count;
+					memcpy(p, line + x, count);
+					p += count;
+				}
+			}
+			x += count;
+		}
+	}
+	*p++ = 3 << 6;
+	*p++ = 0; // end of sprite
+	return p - dst;
+}
+
+struct BenchmarkSprite {
+	Video *video;
+	uint8_t data[kSpriteSize * kSpriteSize * 2];
+	SpriteSpan spans[kSpriteSize * kSpriteSize];
+	CompiledSprite cs;
+	uint8_t flags;
+	int dx;
+};
+
+static void benchmarkDecodeSPR(void *userdata) {
+	BenchmarkSprite *b = (BenchmarkSprite *)userdata;
+	for (int i = 0; i < kSpritesCount; ++i) {
+		const int x = b->dx + (i % 8) * (Video::W - kSpriteSize) / 7;
+		const int y = (i / 8) * (Video::H - kSpriteSize) / 5;
+		Video::decodeSPR(b->data, b->video->_frontLayer, x, y, b->flags, kSpriteSize, kSpriteSize);
+	}
+}
+
+static void benchmarkDrawCompiledSPR(void *userdata) {
+	BenchmarkSprite *b = (BenchmarkSprite *)userdata;
+	for (int i = 0; i < kSpritesCount; ++i) {
+		const int x = b->dx + (i % 8) * (Video::W - kSpriteSize) / 7;
+		const int y = (i / 8) * (Video::H - kSpriteSize) / 5;
+		Video::drawCompiledSPR(&b->cs, b->video->_frontLayer, x, y, b->flags, kSpriteSize, kSpriteSize);
+	}
+}
+
+// compares the output of decodeSPR and drawCompiledSPR
+static bool checkCompiledSPR(BenchmarkSprite *b) {
+	static const int kOffsets[] = { -kSpriteSize + 1, -kSpriteSize / 2, 0, 17, Video::W - kSpriteSize / 2, Video::W - 1 };
+	static const int kOffsetsCount = sizeof(kOffsets) / sizeof(kOffsets[0]);
+	uint8_t *dst1 = b->video->_frontLayer;
+	uint8_t *dst2 = b->video->_backgroundLayer;
+	for (int flags = 0; flags < 4; ++flags) {
+		for (int i = 0; i < kOffsetsCount; ++i) {
+			for (int j = 0; j < kOffsetsCount; ++j) {
+				memset(dst1, 0, Video::W * Video::H);
+				memset(dst2, 0, Video::W * Video::H);
+				Video::decodeSPR(b->data, dst1, kOffsets[i], kOffsets[j] * Video::H / Video::W, flags, kSpriteSize, kSpriteSize);
+				Video::drawCompiledSPR(&b->cs, dst2, kOffsets[i], kOffsets[j] * Video::H / Video::W, flags, kSpriteSize, kSpriteSize);
+				if (memcmp(dst1, dst2, Video::W * Video::H) != 0) {
+					warning("drawCompiledSPR output differs from decodeSPR, flags %d pos %d,%d", flags, kOffsets[i], kOffsets[j] * Video::H / Video::W);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+struct BenchmarkLZW {
+	LzwDecoder lzw;
+	uint8_t *dst;
+};
+
+static void benchmarkLZW(void *userdata) {
+	BenchmarkLZW *b = (BenchmarkLZW *)userdata;
+	decodeLZW(&b->lzw, Game::_pwr1_screenTransformData, b->dst, Video::W * Video::H);
+}
+
+struct BenchmarkShadow {
+	Video *video;
+	uint8_t *projectionData;
+	ApplyShadowColorsProc proc;
+};
+
+static void benchmarkApplyShadowColors(void *userdata) {
+	BenchmarkShadow *b = (BenchmarkShadow *)userdata;
+	Video *video = b->video;
+	video->_applyShadowColorsProc = b->proc;
+	video->applyShadowColors(0, 0, Video::W, Video::H, Video::W, Video::W, video->_shadowLayer, video->_frontLayer, b->projectionData, 0);
+}
+
+// compares the output of the scalar and SIMD applyShadowColors, including partial rows
+static bool checkApplyShadowColors(BenchmarkShadow *b, ApplyShadowColorsProc proc) {
+	static const int kWidths[] = { Video::W, Video::W - 1, 47, 15, 1 };
+	static const int kWidthsCount = sizeof(kWidths) / sizeof(kWidths[0]);
+	ApplyShadowColorsProc scalarProc = getApplyShadowColorsProc(0, 0);
+	Video *video = b->video;
+	uint8_t *dst1 = video->_backgroundLayer;
+	uint8_t *dst2 = (uint8_t *)malloc(Video::W * Video::H);
+	for (int i = 0; i < kWidthsCount; ++i) {
+		const int w = kWidths[i];
+		const int h = Video::H - i;
+		memcpy(dst1, video->_frontLayer, Video::W * Video::H);
+		memcpy(dst2, video->_frontLayer, Video::W * Video::H);
+		(*scalarProc)(dst1 + i, Video::W, w, h, b->projectionData, video->_shadowLayer, video->_shadowColorLut);
+		(*proc)(dst2 + i, Video::W, w, h, b->projectionData, video->_shadowLayer, video->_shadowColorLut);
+		if (memcmp(dst1, dst2, Video::W * Video::H) != 0) {
+			warning("SIMD applyShadowColors output differs from scalar, %dx%d", w, h);
+			free(dst2);
+			return false;
+		}
+	}
+	free(dst2);
+	return true;
+}
+
+static void benchmarkTransformShadowLayer(void *userdata) {
+	((Game *)userdata)->transformShadowLayer(4);
+}
+
+static void benchmarkCopyShadowLayer(void *userdata) {
+	Video *video = (Video *)userdata;
+	memcpy(video->_shadowLayer, video->_frontLayer, Video::W * Video::H);
+}
+
+// compares the output of a transformShadowLayer kernel with the clamped displacement, for all the scrolling deltas
+static bool checkTransformShadowLayer(Video *video, TransformShadowLayerProc proc, const char *name) {
+	uint8_t *dst = video->_backgroundLayer;
+	for (int delta = 0; delta < 256; ++delta) {
+		const uint8_t *offsets = video->_transformShadowBuffer + delta;
+		(*proc)(dst, video->_frontLayer, offsets, Video::H);
+		for (int y = 0; y < Video::H; ++y) {
+			for (int x = 0; x < Video::W; ++x) {
+				const int offset = MIN(255, x + offsets[y * Video::W + x]);
+				if (dst[y * Video::W + x] != video->_frontLayer[y * Video::W + offset]) {
+					warning("transformShadowLayer_%s output differs, delta %d pos %d,%d", name, delta, x, y);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+struct BenchmarkBitWriter {
+	uint8_t *_dst;
+	uint32_t _bits;
+	int _len;
+
+	void putBits(uint32_t value, int count) {
+		for (int i = count - 1; i >= 0; --i) {
+			_bits = (_bits << 1) | ((value >> i) & 1);
+			++_len;
+			if (_len == 16) {
+				WRITE_LE_UINT16(_dst, _bits);
+				_dst += 2;
+				_bits = 0;
+				_len = 0;
+			}
+		}
+	}
+	void flush() {
+		if (_len != 0) {
+			putBits(0, 16 - _len);
+		}
+	}
+};
+
+// encodes random 8x8 blocks with the DC value, AC escape codes and end of block codes
+static int encodeMDEC(uint8_t *dst, int w, int h) {
+	BenchmarkRandom rnd(0x4D444543);
+	BenchmarkBitWriter bw;
+	bw._dst = dst;
+	bw._bits = 0;
+	bw._len = 0;
+	bw.putBits(0, 16);
+	bw.putBits(0x3800, 16);
+	bw.putBits(2, 16); // qscale
+	bw.putBits(2, 16); // version
+	const int blocksCount = ((w + 15) / 16) * ((h + 15) / 16) * 6;
+	for (int i = 0; i < blocksCount; ++i) {
+		bw.putBits((rnd.next() % 128) - 64, 10);
+		int count = 0;
+		const int coefficientsCount = rnd.next() % 8; // including blocks with only a DC value
+		for (int j = 0; j < coefficientsCount; ++j) {
+			const int zeroes = rnd.next() % 4;
+			if (count + zeroes + 1 >= 63) {
+				break;
+			}
+			count += zeroes + 1;
+			bw.putBits(1, 6); // escape code '000001'
+			bw.putBits(zeroes, 6);
+			bw.putBits((rnd.next() % 61) - 30, 10);
+		}
+		bw.putBits(2, 2); // end of block '10'
+	}
+	bw.putBits(0x3FE, 11);
+	bw.flush();
+	return bw._dst - dst;
+}
+
+struct BenchmarkMdec {
+	const uint8_t *data;
+	int size;
+	MdecOutput output;
+};
+
+static void benchmarkMDEC(void *userdata) {
+	BenchmarkMdec *b = (BenchmarkMdec *)userdata;
+	decodeMDEC(b->data, b->size, 0, 0, Video::W, Video::H, &b->output);
+}
+
+// the SIMD transforms are bit exact with the C implementation
+static bool checkMDEC(BenchmarkMdec *b) {
+	static const int kPlaneSizes[] = { Video::W * Video::H, Video::W * Video::H / 4, Video::W * Video::H / 4 };
+	uint8_t *planes[3];
+	for (int i = 0; i < 3; ++i) {
+		planes[i] = (uint8_t *)malloc(kPlaneSizes[i]);
+		memset(b->output.planes[i].ptr, 0, kPlaneSizes[i]);
+	}
+	MdecOutput output = b->output;
+	output.idctProc = getMdecIdctProc(0, 0);
+	for (int i = 0; i < 3; ++i) {
+		output.planes[i].ptr = planes[i];
+	}
+	decodeMDEC(b->data, b->size, 0, 0, Video::W, Video::H, &output);
+	decodeMDEC(b->data, b->size, 0, 0, Video::W, Video::H, &b->output);
+	bool ok = true;
+	for (int i = 0; i < 3; ++i) {
+		if (memcmp(planes[i], b->output.planes[i].ptr, kPlaneSizes[i]) != 0) {
+			warning("SIMD mdec output differs from scalar, plane %d", i);
+			ok = false;
+		}
+		free(planes[i]);
+	}
+	return ok;
+}
+
+static const int kMixerChannels = 16;
+static const int kMixerSamples = 1764 * 2; // stereo
+
+struct BenchmarkMixer {
+	Mixer mixer;
+	int16_t buffer[kMixerSamples];
+};
+
+static void benchmarkMixerMix(void *userdata) {
+	BenchmarkMixer *b = (BenchmarkMixer *)userdata;
+	memset(b->buffer, 0, sizeof(b->buffer));
+	b->mixer.mix(b->buffer, kMixerSamples);
+}
+
+struct BenchmarkPalette {
+	uint32_t *dst;
+	const uint8_t *src;
+	const uint32_t *palette;
+	ExpandPaletteProc proc;
+};
+
+static void benchmarkExpandPalette(void *userdata) {
+	BenchmarkPalette *b = (BenchmarkPalette *)userdata;
+	(*b->proc)(b->dst, b->src, Video::W * Video::H, b->palette);
+}
+
+// compares the output of the scalar and SIMD palette expansion, including the unaligned heads and tails
+static bool checkExpandPalette(BenchmarkPalette *b) {
+	static const int kCounts[] = { Video::W * Video::H, Video::W, Video::W - 1, 63, 17, 1 };
+	static const int kCountsCount = sizeof(kCounts) / sizeof(kCounts[0]);
+	ExpandPaletteProc scalarProc = getExpandPaletteProc(0, 0);
+	uint32_t *dst = (uint32_t *)malloc(Video::W * Video::H * sizeof(uint32_t));
+	for (int i = 0; i < kCountsCount; ++i) {
+		const int count = kCounts[i] - i;
+		memset(b->dst, 0, Video::W * Video::H * sizeof(uint32_t));
+		memset(dst, 0, Video::W * Video::H * sizeof(uint32_t));
+		(*scalarProc)(dst, b->src + i, count, b->palette);
+		(*b->proc)(b->dst, b->src + i, count, b->palette);
+		if (memcmp(dst, b->dst, Video::W * Video::H * sizeof(uint32_t)) != 0) {
+			warning("SIMD expandPalette output differs from scalar, count %d", count);
+			free(dst);
+			return false;
+		}
+	}
+	free(dst);
+	return true;
+}
+
+struct BenchmarkScaler {
+	ScaleRowsProc proc;
+	uint32_t *dst;
+	const uint8_t *src;
+	const uint32_t *palette;
+	int factor;
+};
+
+static void benchmarkScaler(void *userdata) {
+	BenchmarkScaler *b = (BenchmarkScaler *)userdata;
+	b->proc(b->dst, Video::W * b->factor, b->src, Video::W, Video::W, Video::H, 0, Video::H, b->palette);
+}
+
+// compares the output of the scalar and SIMD xBR, for the full screen and the rectangles of the dirty updates
+static bool checkScaler(BenchmarkScaler *b, ScaleRowsProc scalarProc) {
+	static const int kRects[][4] = {
+		{ 0, 0, Video::W, Video::H },
+		{ 5, 7, 37, 23 },
+		{ 100, 150, 66, 42 },
+		{ 200, 0, 18, 9 },
+		{ 3, 180, 2, 12 }
+	};
+	static const int kRectsCount = sizeof(kRects) / sizeof(kRects[0]);
+	const int size = Video::W * Video::H * b->factor * b->factor;
+	const int dstPitch = Video::W * b->factor;
+	uint32_t *dst = (uint32_t *)malloc(size * sizeof(uint32_t));
+	for (int i = 0; i < kRectsCount; ++i) {
+		const uint8_t *src = b->src + kRects[i][1] * Video::W + kRects[i][0];
+		const int w = kRects[i][2];
+		const int h = kRects[i][3];
+		memset(dst, 0, size * sizeof(uint32_t));
+		memset(b->dst, 0, size * sizeof(uint32_t));
+		scalarProc(dst, dstPitch, src, Video::W, w, h, 0, h, b->palette);
+		b->proc(b->dst, dstPitch, src, Video::W, w, h, 0, h, b->palette);
+		if (memcmp(dst, b->dst, size * sizeof(uint32_t)) != 0) {
+			warning("SIMD xbr%dx output differs from scalar, %dx%d", b->factor, w, h);
+			free(dst);
+			return false;
+		}
+	}
+	free(dst);
+	return true;
+}
+
+static const int kBenchmarkPafFrames = 256;
+
+// demux and decode the first frames of a cutscene, without display
+static int benchmarkPafDecoding(PafPlayer *paf, int num, uint64_t *videoNs, uint64_t *audioNs) {
+	paf->preload(num);
+	if (paf->_videoNum != num) {
+		return 0;
+	}
+	paf->_file.seek(paf->_videoOffset + paf->_pafHdr.startOffset, SEEK_SET);
+	paf->_currentPageBuffer = 0;
+	int currentFrameBlock = 0;
+	uint32_t blocksCountForFrame = paf->_pafHdr.preloadFrameBlocksCount;
+	const int framesCount = MIN<int>(kBenchmarkPafFrames, paf->_pafHdr.framesCount);
+	for (int i = 0; i < framesCount; ++i) {
+		audioNs[i] = 0;
+		blocksCountForFrame += paf->_pafHdr.frameBlocksCountTable[i];
+		while (blocksCountForFrame != 0) {
+			paf->_file.read(paf->_bufferBlock, paf->_pafHdr.readBufferSize);
+			const uint32_t dstOffset = paf->_pafHdr.frameBlocksOffsetTable[currentFrameBlock] & ~(1 << 31);
+			if (paf->_pafHdr.frameBlocksOffsetTable[currentFrameBlock] & (1 << 31)) {
+				const uint64_t t0 = getTimeNs();
+				memcpy(paf->_demuxAudioFrameBlocks + dstOffset, paf->_bufferBlock, paf->_pafHdr.readBufferSize);
+				paf->decodeAudioFrame(paf->_demuxAudioFrameBlocks, dstOffset, paf->_pafHdr.readBufferSize);
+				audioNs[i] += getTimeNs() - t0;
+			} else {
+				memcpy(paf->_demuxVideoFrameBlocks + dstOffset, paf->_bufferBlock, paf->_pafHdr.readBufferSize);
+			}
+			++currentFrameBlock;
+			--blocksCountForFrame;
+		}
+		const uint64_t t0 = getTimeNs();
+		paf->decodeVideoFrame(paf->_demuxVideoFrameBlocks + paf->_pafHdr.framesOffsetTable[i]);
+		videoNs[i] = getTimeNs() - t0;
+		++paf->_currentPageBuffer;
+		paf->_currentPageBuffer &= 3;
+	}
+	paf->unload();
+	return framesCount;
+}
+
+void Game::benchmarkCodecs() {
+	BenchmarkRandom rnd(0x484F4445);
+	_benchmarkResultsCount = 0;
+
+	const int screenSize = Video::W * Video::H;
+	uint8_t *screen = (uint8_t *)malloc(screenSize);
+	BenchmarkLZW *lzw = (BenchmarkLZW *)malloc(sizeof(BenchmarkLZW));
+	lzw->dst = screen;
+	runBenchmark("lzw", "MB/s", screenSize / 1e6, 200, benchmarkLZW, lzw);
+	free(lzw);
+
+	// sprite with transparent corners, filled spans and literal pixels
+	for (int y = 0; y < kSpriteSize; ++y) {
+		for (int x = 0; x < kSpriteSize; ++x) {
+			const int dx = x - kSpriteSize / 2;
+			const int dy = y - kSpriteSize / 2;
+			uint8_t color = 0;
+			if (dx * dx + dy * dy < (kSpriteSize / 2) * (kSpriteSize / 2)) {
+				color = ((x / 8 + y / 8) & 1) ? (1 + (rnd.next() & 127)) : (16 + (y & 15));
+			}
+			screen[y * kSpriteSize + x] = color;
+		}
+	}
+	BenchmarkSprite *spr = (BenchmarkSprite *)malloc(sizeof(BenchmarkSprite));
+	spr->video = _video;
+	encodeSPR(screen, kSpriteSize, kSpriteSize, spr->data);
+	const double spritesPixels = kSpritesCount * kSpriteSize * kSpriteSize / 1e6;
+	spr->flags = 0;
+	spr->dx = 0;
+	runBenchmark("decodeSPR", "Mpixels/s", spritesPixels, 500, benchmarkDecodeSPR, spr);
+	spr->flags = kSprHorizFlip;
+	runBenchmark("decodeSPR_hflip", "Mpixels/s", spritesPixels, 500, benchmarkDecodeSPR, spr);
+	spr->flags = kSprVertFlip;
+	runBenchmark("decodeSPR_vflip", "Mpixels/s", spritesPixels, 500, benchmarkDecodeSPR, spr);
+	spr->flags = 0;
+	spr->dx = -kSpriteSize / 2;
+	runBenchmark("decodeSPR_clip", "Mpixels/s", spritesPixels, 500, benchmarkDecodeSPR, spr);
+	spr->flags = kSprHorizFlip;
+	runBenchmark("decodeSPR_clip_hflip", "Mpixels/s", spritesPixels, 500, benchmarkDecodeSPR, spr);
+	uint32_t spansCount;
+	Video::compileSPR(spr->data, spr->spans, &spansCount);
+	spr->cs.bitmapBits = spr->data;
+	spr->cs.spansCount = spansCount;
+	spr->cs.spans = spr->spans;
+	if (checkCompiledSPR(spr)) {
+		spr->flags = 0;
+		spr->dx = 0;
+		runBenchmark("drawCompiledSPR", "Mpixels/s", spritesPixels, 500, benchmarkDrawCompiledSPR, spr);
+		spr->flags = kSprHorizFlip;
+		runBenchmark("drawCompiledSPR_hflip", "Mpixels/s", spritesPixels, 500, benchmarkDrawCompiledSPR, spr);
+		spr->flags = kSprVertFlip;
+		runBenchmark("drawCompiledSPR_vflip", "Mpixels/s", spritesPixels, 500, benchmarkDrawCompiledSPR, spr);
+		spr->flags = 0;
+		spr->dx = -kSpriteSize / 2;
+		runBenchmark("drawCompiledSPR_clip", "Mpixels/s", spritesPixels, 500, benchmarkDrawCompiledSPR, spr);
+		spr->flags = kSprHorizFlip;
+		runBenchmark("drawCompiledSPR_clip_hflip", "Mpixels/s", spritesPixels, 500, benchmarkDrawCompiledSPR, spr);
+	}
+	free(spr);
+
+	for (int i = 0; i < screenSize; ++i) {
+		_video->_frontLayer[i] = rnd.next();
+		_video->_shadowLayer[i] = rnd.next();
+	}
+	uint8_t shadowPalette[256];
+	for (int i = 0; i < 256; ++i) {
+		shadowPalette[i] = rnd.next();
+	}
+	_video->buildShadowColorLookupTable(shadowPalette, _video->_shadowColorLookupTable);
+	BenchmarkShadow shadow;
+	shadow.video = _video;
+	shadow.projectionData = (uint8_t *)malloc(screenSize * sizeof(uint16_t));
+	for (int i = 0; i < screenSize; ++i) {
+		const int offset = CLIP<int>(i + (int)(rnd.next() % (Video::W * 8)) - Video::W * 4, 0, screenSize);
+		WRITE_LE_UINT16(shadow.projectionData + i * sizeof(uint16_t), offset);
+	}
+	ApplyShadowColorsProc defaultProc = _video->_applyShadowColorsProc;
+	shadow.proc = getApplyShadowColorsProc(0, 0);
+	runBenchmark("applyShadowColors", "Mpixels/s", screenSize / 1e6, 500, benchmarkApplyShadowColors, &shadow);
+	const char *simdName;
+	ApplyShadowColorsProc simdProc = getApplyShadowColorsProc(getCpuFeatures(), &simdName);
+	if (simdProc != shadow.proc && checkApplyShadowColors(&shadow, simdProc)) {
+		static char name[32];
+		snprintf(name, sizeof(name), "applyShadowColors_%s", simdName);
+		shadow.proc = simdProc;
+		runBenchmark(name, "Mpixels/s", screenSize / 1e6, 500, benchmarkApplyShadowColors, &shadow);
+	}
+	_video->_applyShadowColorsProc = defaultProc;
+	free(shadow.projectionData);
+
+	const int currentLevel = _currentLevel;
+	_currentLevel = kLvl_rock; // no _screenTransformRects copy
+	loadTransformLayerData(_pwr1_screenTransformData);
+	runBenchmark("memcpy_shadowLayer", "Mpixels/s", screenSize / 1e6, 500, benchmarkCopyShadowLayer, _video);
+	TransformShadowLayerProc defaultTransformProc = _video->_transformShadowLayerProc;
+	const char *transformNames[2];
+	TransformShadowLayerProc transformProcs[2];
+	transformProcs[0] = getTransformShadowLayerProc(0, &transformNames[0]);
+	transformProcs[1] = getTransformShadowLayerProc(getCpuFeatures(), &transformNames[1]);
+	for (int i = 0; i < 2; ++i) {
+		if ((i == 0 || transformProcs[i] != transformProcs[0]) && checkTransformShadowLayer(_video, transformProcs[i], transformNames[i])) {
+			static char names[2][32];
+			snprintf(names[i], sizeof(names[i]), "transformShadowLayer_%s", transformNames[i]);
+			_video->_transformShadowLayerProc = transformProcs[i];
+			runBenchmark(names[i], "Mpixels/s", screenSize / 1e6, 500, benchmarkTransformShadowLayer, this);
+		}
+	}
+	_video->_transformShadowLayerProc = defaultTransformProc;
+	unloadTransformLayerData();
+	_currentLevel = currentLevel;
+
+	BenchmarkMdec mdec;
+	uint8_t *mdecData = (uint8_t *)malloc(screenSize * sizeof(uint16_t));
+	mdec.data = mdecData;
+	mdec.size = encodeMDEC(mdecData, Video::W, Video::H);
+	memset(&mdec.output, 0, sizeof(mdec.output));
+	mdec.output.w = Video::W;
+	mdec.output.h = Video::H;
+	mdec.output.planes[kOutputPlaneY].ptr = (uint8_t *)malloc(screenSize);
+	mdec.output.planes[kOutputPlaneY].pitch = Video::W;
+	mdec.output.planes[kOutputPlaneCb].ptr = (uint8_t *)malloc(screenSize / 4);
+	mdec.output.planes[kOutputPlaneCb].pitch = Video::W / 2;
+	mdec.output.planes[kOutputPlaneCr].ptr = (uint8_t *)malloc(screenSize / 4);
+	mdec.output.planes[kOutputPlaneCr].pitch = Video::W / 2;
+	mdec.output.idctProc = getMdecIdctProc(0, 0);
+	runBenchmark("mdec", "Mpixels/s", screenSize / 1e6, 100, benchmarkMDEC, &mdec);
+	const char *idctName;
+	MdecIdctProc idctProc = getMdecIdctProc(getCpuFeatures(), &idctName);
+	if (idctProc != mdec.output.idctProc) {
+		mdec.output.idctProc = idctProc;
+		if (checkMDEC(&mdec)) {
+			static char name[32];
+			snprintf(name, sizeof(name), "mdec_%s", idctName);
+			runBenchmark(name, "Mpixels/s", screenSize / 1e6, 100, benchmarkMDEC, &mdec);
+		}
+	}
+	for (int i = 0; i < 3; ++i) {
+		free(mdec.output.planes[i].ptr);
+	}
+	free(mdecData);
+
+	if (!_paf->_skipCutscenes) {
+		uint64_t *videoNs = (uint64_t *)malloc(kBenchmarkPafFrames * sizeof(uint64_t));
+		uint64_t *audioNs = (uint64_t *)malloc(kBenchmarkPafFrames * sizeof(uint64_t));
+		const int count = benchmarkPafDecoding(_paf, kPafAnimation_intro, videoNs, audioNs);
+		addBenchmarkResult("paf_video", "frames/s", 1, videoNs, count);
+		addBenchmarkResult("paf_audio", "frames/s", 1, audioNs, count);
+		free(videoNs);
+		free(audioNs);
+	}
+
+	BenchmarkMixer *mix = new BenchmarkMixer;
+	int16_t *samples = (int16_t *)malloc(kMixerSamples * sizeof(int16_t));
+	for (int i = 0; i < kMixerSamples; ++i) {
+		samples[i] = rnd.next();
+	}
+	for (int i = 0; i < kMixerChannels; ++i) {
+		const bool stereo = (i & 1) != 0;
+		mix->mixer.queue(samples, samples + kMixerSamples, i % 3, 1 << 13, 1 << 13, stereo);
+	}
+	runBenchmark("mixer", "Msamples/s", kMixerSamples / 2 / 1e6, 500, benchmarkMixerMix, mix);
+	free(samples);
+	delete mix;
+
+	uint32_t palette[256];
+	for (int i = 0; i < 256; ++i) {
+		palette[i] = ((i * 7) & 255) << 16 | ((i * 13) & 255) << 8 | ((255 - i) & 255);
+	}
+	for (int y = 0; y < Video::H; ++y) {
+		for (int x = 0; x < Video::W; ++x) {
+			// diagonal edges and noise
+			uint8_t color = ((x + y) / 12) & 1 ? 40 : 200;
+			if (((x / 16) ^ (y / 16)) & 1) {
+				color = (x * 3 + y) & 255;
+			}
+			if ((rnd.next() & 15) == 0) {
+				color = rnd.next();
+			}
+			screen[y * Video::W + x] = color;
+		}
+	}
+	BenchmarkPalette expand;
+	expand.dst = (uint32_t *)malloc(screenSize * sizeof(uint32_t));
+	expand.src = screen;
+	expand.palette = palette;
+	expand.proc = getExpandPaletteProc(0, 0);
+	runBenchmark("expandPalette", "Mpixels/s", screenSize / 1e6, 500, benchmarkExpandPalette, &expand);
+	const char *expandName;
+	ExpandPaletteProc expandProc = getExpandPaletteProc(getCpuFeatures(), &expandName);
+	if (expandProc != expand.proc) {
+		expand.proc = expandProc;
+		if (checkExpandPalette(&expand)) {
+			static char name[32];
+			snprintf(name, sizeof(name), "expandPalette_%s", expandName);
+			runBenchmark(name, "Mpixels/s", screenSize / 1e6, 500, benchmarkExpandPalette, &expand);
+		}
+	}
+	free(expand.dst);
+
+	scaler_xbr.palette(palette);
+	BenchmarkScaler scaler;
+	scaler.dst = (uint32_t *)malloc(screenSize * scaler_xbr.factorMax * scaler_xbr.factorMax * sizeof(uint32_t));
+	scaler.src = screen;
+	scaler.palette = palette;
+	static const char *names[] = { "xbr2x", "xbr3x", "xbr4x" };
+	for (int i = scaler_xbr.factorMin; i <= scaler_xbr.factorMax; ++i) {
+		scaler.factor = i;
+		ScaleRowsProc scalarProc = getScaleRowsProc_xbr(i, 0, 0);
+		scaler.proc = scalarProc;
+		runBenchmark(names[i - 2], "Mpixels/s", screenSize / 1e6, 50, benchmarkScaler, &scaler);
+		const char *simdName;
+		ScaleRowsProc simdProc = getScaleRowsProc_xbr(i, getCpuFeatures(), &simdName);
+		if (simdProc != scalarProc) {
+			scaler.proc = simdProc;
+			if (checkScaler(&scaler, scalarProc)) {
+				static char simdNames[3][32];
+				snprintf(simdNames[i - 2], sizeof(simdNames[i - 2]), "%s_%s", names[i - 2], simdName);
+				runBenchmark(simdNames[i - 2], "Mpixels/s", screenSize / 1e6, 50, benchmarkScaler, &scaler);
+			}
+		}
+	}
+	static const Scaler *cheapScalers[] = { &scaler_integer, &scaler_scalex, &scaler_hqx };
+	for (int i = 0; i < 3; ++i) {
+		const Scaler *s = cheapScalers[i];
+		if (s->palette) {
+			s->palette(palette);
+		}
+		for (int factor = s->factorMin; factor <= s->factorMax; ++factor) {
+			static char cheapNames[3][3][32];
+			snprintf(cheapNames[i][factor - 2], sizeof(cheapNames[i][factor - 2]), "%s%dx", s->name, factor);
+			scaler.factor = factor;
+			scaler.proc = s->scaleRows[factor - 2];
+			runBenchmark(cheapNames[i][factor - 2], "Mpixels/s", screenSize / 1e6, 50, benchmarkScaler, &scaler);
+		}
+	}
+	free(scaler.dst);
+
+	free(screen);
+}
+
+void Game::benchmarkLevel(int level, int framesCount) {
+	_benchmarkFramesCount = framesCount;
+	_benchmarkFrameTimesNs = (uint64_t *)calloc(framesCount, sizeof(uint64_t));
+	_benchmarkFrameTimesCount = 0;
+	if (!_benchmarkFrameTimesNs) {
+		return;
+	}
+	const bool turboMode = _turboMode;
+	const bool skipCutscenes = _paf->_skipCutscenes;
+	_turboMode = true;
+	_paf->_skipCutscenes = true;
+	_resumeGame = false;
+	mainLoop(level, 0, false);
+	_turboMode = turboMode;
+	_paf->_skipCutscenes = skipCutscenes;
+	static char name[32];
+	snprintf(name, sizeof(name), "levelMainLoop_%d", level);
+	addBenchmarkResult(name, "frames/s", 1, _benchmarkFrameTimesNs, _benchmarkFrameTimesCount);
+	free(_benchmarkFrameTimesNs);
+	_benchmarkFrameTimesNs = 0;
+	_benchmarkFrameTimesCount = 0;
+	_benchmarkFramesCount = 0;
+}
+
+bool Game::writeBenchmarkResults(const char *path) {
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		warning("Unable to write benchmark results to '%s'", path);
+		return false;
+	}
+	fprintf(fp, "{\n\t\"benchmarks\": [\n");
+	for (int i = 0; i < _benchmarkResultsCount; ++i) {
+		const BenchmarkResult *r = &_benchmarkResults[i];
+		fprintf(fp, "\t\t{ \"name\": \"%s\", \"unit\": \"%s\", \"iterations\": %d, \"min_ns\": %llu, \"median_ns\": %llu, \"p99_ns\": %llu, \"throughput\": %.3f }%s\n",
+			r->name, r->unit, r->iterations,
+			(unsigned long long)r->minNs, (unsigned long long)r->medianNs, (unsigned long long)r->p99Ns,
+			r->throughput, (i + 1 < _benchmarkResultsCount) ? "," : "");
+	}
+	fprintf(fp, "\t]\n}\n");
+	fclose(fp);
+	return true;
+}
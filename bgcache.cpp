@@ -0,0 +1,133 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "bgcache.h"
+#include "util.h"
+
+BackgroundCache::BackgroundCache()
+	: _budget(kDefaultBudgetKb * 1024), _size(0), _useCounter(0), _entriesCount(0),
+	_hitsCount(0), _missesCount(0), _evictionsCount(0) {
+}
+
+BackgroundCache::~BackgroundCache() {
+	clear();
+}
+
+void BackgroundCache::setBudget(int kb) {
+	_budget = MAX(kb, 0) * 1024;
+	while (_size > _budget) {
+		int lru = 0;
+		for (int i = 1; i < _entriesCount; ++i) {
+			if (_entries[i].lastUse < _entries[lru].lastUse) {
+				lru = i;
+			}
+		}
+		evict(lru);
+	}
+}
+
+void BackgroundCache::clear() {
+	while (_entriesCount != 0) {
+		evict(_entriesCount - 1);
+	}
+}
+
+bool BackgroundCache::contains(uint32_t key) const {
+	for (int i = 0; i < _entriesCount; ++i) {
+		if (_entries[i].key == key) {
+			return true;
+		}
+	}
+	return false;
+}
+
+const BackgroundCacheEntry *BackgroundCache::find(uint32_t key) {
+	if (_budget == 0) {
+		return 0;
+	}
+	for (int i = 0; i < _entriesCount; ++i) {
+		if (_entries[i].key == key) {
+			_entries[i].lastUse = ++_useCounter;
+			++_hitsCount;
+			return &_entries[i];
+		}
+	}
+	++_missesCount;
+	return 0;
+}
+
+// copies the decoded data of 'src', the masks pointers are rebased
+void BackgroundCache::add(const BackgroundCacheEntry *src) {
+	const int backgroundSize = src->background ? BackgroundCacheEntry::kBackgroundSize : 0;
+	if (backgroundSize + src->masksDataSize == 0 || contains(src->key)) {
+		return;
+	}
+	BackgroundCacheEntry *entry = insert(src->key, backgroundSize, src->masksDataSize);
+	if (entry) {
+		if (entry->background) {
+			memcpy(entry->background, src->background, backgroundSize);
+		}
+		memcpy(entry->masksData, src->masksData, src->masksDataSize);
+		entry->masksBits = src->masksBits;
+		for (int i = 0; i < BackgroundCacheEntry::kMaxMasks; ++i) {
+			if ((src->masksBits & (1 << i)) != 0) {
+				entry->masks[i] = src->masks[i];
+				if (src->masks[i].w != 0) {
+					entry->masks[i].projectionDataPtr = entry->masksData + (src->masks[i].projectionDataPtr - src->masksData);
+					entry->masks[i].shadowPalettePtr = entry->masksData + (src->masks[i].shadowPalettePtr - src->masksData);
+				}
+			}
+		}
+	}
+}
+
+BackgroundCacheEntry *BackgroundCache::insert(uint32_t key, int backgroundSize, int masksDataSize) {
+	const int dataSize = backgroundSize + masksDataSize;
+	if (dataSize > _budget) {
+		return 0;
+	}
+	while (_entriesCount == kMaxEntries || _size + dataSize > _budget) {
+		int lru = 0;
+		for (int i = 1; i < _entriesCount; ++i) {
+			if (_entries[i].lastUse < _entries[lru].lastUse) {
+				lru = i;
+			}
+		}
+		evict(lru);
+		++_evictionsCount;
+	}
+	uint8_t *p = (uint8_t *)malloc(dataSize);
+	if (!p) {
+		warning("Unable to allocate %d bytes for the background cache", dataSize);
+		return 0;
+	}
+	BackgroundCacheEntry *entry = &_entries[_entriesCount++];
+	memset(entry, 0, sizeof(BackgroundCacheEntry));
+	entry->key = key;
+	entry->lastUse = ++_useCounter;
+	entry->dataSize = dataSize;
+	entry->background = (backgroundSize != 0) ? p : 0;
+	entry->masksData = p + backgroundSize;
+	entry->masksDataSize = masksDataSize;
+	_size += dataSize;
+	return entry;
+}
+
+void BackgroundCache::evict(int index) {
+	BackgroundCacheEntry *entry = &_entries[index];
+	_size -= entry->dataSize;
+	free(entry->background ? entry->background : entry->masksData);
+	--_entriesCount;
+	if (index != _entriesCount) {
+		*entry = _entries[_entriesCount];
+	}
+}
+
+void BackgroundCache::dumpStats(int debugMask) const {
+	const int lookupsCount = _hitsCount + _missesCount;
+	if (lookupsCount != 0) {
+		debug(debugMask, "Background cache: %d hits %d misses (%d%%) %d evictions, %d entries %d KB", _hitsCount, _missesCount, _hitsCount * 100 / lookupsCount, _evictionsCount, _entriesCount, _size / 1024);
+	}
+}
@@ -0,0 +1,63 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef BGCACHE_H__
+#define BGCACHE_H__
+
+#include "intern.h"
+#include "defs.h"
+
+// decoded screen background bitmap and shadow screen masks, the masks pointers reference 'masksData'
+struct BackgroundCacheEntry {
+	enum {
+		kBackgroundSize = 256 * 192,
+		kMaxMasks = 8
+	};
+
+	uint32_t key;
+	uint32_t lastUse;
+	int dataSize; // allocated with the entry
+	uint8_t *background; // 0 if not decoded (PSX)
+	uint8_t *masksData;
+	int masksDataSize;
+	uint32_t masksBits; // masks decoded from the level data
+	ScreenMask masks[kMaxMasks];
+};
+
+// least recently used entries are evicted to stay within the memory budget
+struct BackgroundCache {
+	enum {
+		kMaxEntries = 64,
+		kDefaultBudgetKb = 1024
+	};
+
+	int _budget; // bytes, 0 disables the cache
+	int _size;
+	uint32_t _useCounter;
+	int _entriesCount;
+	BackgroundCacheEntry _entries[kMaxEntries];
+
+	int _hitsCount;
+	int _missesCount;
+	int _evictionsCount;
+
+	BackgroundCache();
+	~BackgroundCache();
+
+	static uint32_t makeKey(int level, int screenNum, int backgroundId, int shadowId) {
+		return (level << 24) | ((screenNum & 255) << 16) | ((backgroundId & 255) << 8) | (shadowId & 255);
+	}
+
+	void setBudget(int kb);
+	void clear();
+	bool contains(uint32_t key) const;
+	const BackgroundCacheEntry *find(uint32_t key);
+	void add(const BackgroundCacheEntry *entry);
+	BackgroundCacheEntry *insert(uint32_t key, int backgroundSize, int masksDataSize);
+	void evict(int index);
+	void dumpStats(int debugMask) const;
+};
+
+#endif // BGCACHE_H__
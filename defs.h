@@ -233,6 +233,20 @@ struct Sprite {
 	Sprite *nextPtr;
 	uint16_t num;
 	uint16_t w, h;
+	const LvlObject *owner; // for the interpolation of the positions
+};
+
+struct SpriteSpan {
+	int16_t x, y; // relative to the sprite origin
+	uint16_t len;
+	uint8_t color; // fill color if 'data' is null
+	const uint8_t *data;
+};
+
+struct CompiledSprite {
+	const uint8_t *bitmapBits;
+	uint32_t spansCount;
+	const SpriteSpan *spans;
 };
 
 struct BoundingBox {
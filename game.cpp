@@ -10,6 +10,7 @@
 #include "paf.h"
 #include "screenshot.h"
 #include "system.h"
+#include "trace.h"
 #include "util.h"
 #include "video.h"
 
@@ -28,7 +29,27 @@ Game::Game(const char *dataPath, const char *savePath, uint32_t cheats)
 	_playDemo = false;
 
 	_frameMs = kFrameDuration;
+	_turboMode = false;
+	_presentRefreshRate = false;
+	_interpolateSprites = false;
+	_presentBetweenTicks = false;
+	_interpolatedLayers = 0;
+	_interpolateFrame = false;
+	_predecodeScreens = true;
+	_predecodeWorker = 0;
+	_predecodeBuffer = 0;
+	_predecodeLzw = 0;
+	_predecodedScreensCount = 0;
 	_difficulty = 1; // normal
+	_benchmarkFramesCount = 0;
+	_benchmarkFrameTimesNs = 0;
+	_benchmarkFrameTimesCount = 0;
+	_replayTraceFp = 0;
+	_replayGoldenFp = 0;
+	_replayMismatchFrame = -1;
+	_recordDemPath = 0;
+	memset(&_recordDem, 0, sizeof(_recordDem));
+	_recordDemSize = 0;
 
 	memset(_screenLvlObjectsList, 0, sizeof(_screenLvlObjectsList));
 	_andyObject = 0;
@@ -82,6 +103,13 @@ Game::Game(const char *dataPath, const char *savePath, uint32_t cheats)
 }
 
 Game::~Game() {
+	finishPredecode();
+	if (_predecodeWorker) {
+		g_system->destroyWorker(_predecodeWorker);
+	}
+	free(_predecodeBuffer);
+	free(_predecodeLzw);
+	free(_interpolatedLayers);
 	delete _paf;
 	delete _res;
 	delete _video;
@@ -211,19 +239,23 @@ void Game::transformShadowLayer(int delta) {
 	const uint8_t *src = _video->_transformShadowBuffer + _video->_transformShadowLayerDelta;
 	uint8_t *dst = _video->_shadowLayer;
 	_video->_transformShadowLayerDelta += delta; // overflow/wrap at 255
-	for (int y = 0; y < Video::H; ++y) {
-		if (0) { // original clips the screen width to 250px
-			for (int x = 0; x < Video::W - 6; ++x) {
-				const int offset = x + *src++;
-				*dst++ = _video->_frontLayer[y * Video::W + offset];
-			}
-			memset(dst, Video::CLEAR_COLOR, 6);
-			dst += 6;
-			src += 6;
-		} else {
-			for (int x = 0; x < Video::W; ++x) {
-				const int offset = MIN(255, x + *src++);
-				*dst++ = _video->_frontLayer[y * Video::W + offset];
+	if (_video->_transformShadowBufferMaxOffset < 16) {
+		(*_video->_transformShadowLayerProc)(dst, _video->_frontLayer, src, Video::H);
+	} else {
+		for (int y = 0; y < Video::H; ++y) {
+			if (0) { // original clips the screen width to 250px
+				for (int x = 0; x < Video::W - 6; ++x) {
+					const int offset = x + *src++;
+					*dst++ = _video->_frontLayer[y * Video::W + offset];
+				}
+				memset(dst, Video::CLEAR_COLOR, 6);
+				dst += 6;
+				src += 6;
+			} else {
+				for (int x = 0; x < Video::W; ++x) {
+					const int offset = MIN(255, x + *src++);
+					*dst++ = _video->_frontLayer[y * Video::W + offset];
+				}
 			}
 		}
 	}
@@ -252,9 +284,15 @@ void Game::transformShadowLayer(int delta) {
 void Game::loadTransformLayerData(const uint8_t *data) {
 	assert(!_video->_transformShadowBuffer);
 	_video->_transformShadowBuffer = (uint8_t *)malloc(256 * 192 + 256);
-	const int size = decodeLZW(data, _video->_transformShadowBuffer);
+	const int size = decodeLZW(&_res->_lzw, data, _video->_transformShadowBuffer, 256 * 192);
 	assert(size == 256 * 192);
 	memcpy(_video->_transformShadowBuffer + 256 * 192, _video->_transformShadowBuffer, 256);
+	// the clamping depends on the scrolling delta, keep the largest offset to bound it
+	uint8_t maxOffset = 0;
+	for (int i = 0; i < 256 * 192; ++i) {
+		maxOffset = MAX(maxOffset, _video->_transformShadowBuffer[i]);
+	}
+	_video->_transformShadowBufferMaxOffset = maxOffset;
 }
 
 void Game::unloadTransformLayerData() {
@@ -262,30 +300,38 @@ void Game::unloadTransformLayerData() {
 	_video->_transformShadowBuffer = 0;
 }
 
-void Game::decodeShadowScreenMask(LvlBackgroundData *lvl) {
-	uint8_t *dst = _video->_shadowScreenMaskBuffer;
+// decodes the shadow screen masks from 'currentShadowId', the masks entries point to the decoded data in 'dst'
+int Game::decodeShadowScreenMaskData(LzwDecoder *lzw, const LvlBackgroundData *lvl, uint8_t *dst, int dstSize, ScreenMask *masks, uint32_t *masksBits) {
+	uint8_t *start = dst;
+	const uint8_t *end = dst + dstSize;
 	for (int i = lvl->currentShadowId; i < lvl->shadowCount; ++i) {
 		const uint8_t *src = lvl->backgroundMaskTable[i];
 		if (src) {
-			const int decodedSize = decodeLZW(src + 2, dst);
+			*masksBits |= 1 << i;
+			const int decodedSize = decodeLZW(lzw, src + 2, dst, end - dst);
+			if (decodedSize < 0) {
+				warning("Failed to decode shadow screen mask #%d", i);
+				masks[i].w = masks[i].h = 0; // not drawn
+				continue;
+			}
 
-			_shadowScreenMasksTable[i].dataSize = READ_LE_UINT32(dst);
+			masks[i].dataSize = READ_LE_UINT32(dst);
 
 			// header : 20 bytes
 			// projectionData : w * h * sizeof(uint16_t) - for a given (x, y) returns the casted (x, y)
 			// paletteData : 256 (only the first 144 bytes are read)
 
-			_shadowScreenMasksTable[i].projectionDataPtr = dst + 0x14 + READ_LE_UINT32(dst + 4);
-			_shadowScreenMasksTable[i].shadowPalettePtr = dst + 0x14 + READ_LE_UINT32(dst + 8);
-			const int x = _shadowScreenMasksTable[i].x = READ_LE_UINT16(dst + 0xC);
-			const int y = _shadowScreenMasksTable[i].y = READ_LE_UINT16(dst + 0xE);
-			const int w = _shadowScreenMasksTable[i].w = READ_LE_UINT16(dst + 0x10);
-			const int h = _shadowScreenMasksTable[i].h = READ_LE_UINT16(dst + 0x12);
+			masks[i].projectionDataPtr = dst + 0x14 + READ_LE_UINT32(dst + 4);
+			masks[i].shadowPalettePtr = dst + 0x14 + READ_LE_UINT32(dst + 8);
+			const int x = masks[i].x = READ_LE_UINT16(dst + 0xC);
+			const int y = masks[i].y = READ_LE_UINT16(dst + 0xE);
+			const int w = masks[i].w = READ_LE_UINT16(dst + 0x10);
+			const int h = masks[i].h = READ_LE_UINT16(dst + 0x12);
 
 			debug(kDebug_GAME, "shadow screen mask #%d pos %d,%d dim %d,%d size %d", i, x, y, w, h, decodedSize);
 
 			const int size = w * h;
-			uint8_t *p = _shadowScreenMasksTable[i].projectionDataPtr + 2;
+			uint8_t *p = masks[i].projectionDataPtr + 2;
 			for (int j = 1; j < size; ++j) {
 				const int16_t offset = (int16_t)READ_LE_UINT16(p - 2) + (int16_t)READ_LE_UINT16(p);
 				// fprintf(stdout, "shadow #%d offset #%d 0x%x 0x%x\n", i, j, READ_LE_UINT16(p), offset);
@@ -296,10 +342,42 @@ void Game::decodeShadowScreenMask(LvlBackgroundData *lvl) {
 			const int shadowPaletteSize = decodedSize - 20 - w * h * sizeof(uint16_t);
 			assert(shadowPaletteSize >= 144);
 
-			_video->buildShadowColorLookupTable(_shadowScreenMasksTable[i].shadowPalettePtr, _video->_shadowColorLookupTable);
 			dst += decodedSize;
 		}
 	}
+	return dst - start;
+}
+
+int Game::decodeShadowScreenMask(LvlBackgroundData *lvl, uint32_t *masksBits) {
+	const int size = decodeShadowScreenMaskData(&_res->_lzw, lvl, _video->_shadowScreenMaskBuffer, Video::SHADOW_SCREEN_MASK_BUFFER_SIZE, _shadowScreenMasksTable, masksBits);
+	setupShadowColorLookupTable(*masksBits);
+	return size;
+}
+
+// the lookup table is built from the palette of the last decoded mask
+void Game::setupShadowColorLookupTable(uint32_t masksBits) {
+	for (int i = BackgroundCacheEntry::kMaxMasks - 1; i >= 0; --i) {
+		if ((masksBits & (1 << i)) != 0 && _shadowScreenMasksTable[i].w != 0) {
+			_video->buildShadowColorLookupTable(_shadowScreenMasksTable[i].shadowPalettePtr, _video->_shadowColorLookupTable);
+			break;
+		}
+	}
+}
+
+void Game::restoreShadowScreenMasks(const BackgroundCacheEntry *entry) {
+	memcpy(_video->_shadowScreenMaskBuffer, entry->masksData, entry->masksDataSize);
+	for (int i = 0; i < BackgroundCacheEntry::kMaxMasks; ++i) {
+		if ((entry->masksBits & (1 << i)) != 0) {
+			const ScreenMask *mask = &entry->masks[i];
+			ScreenMask *dst = &_shadowScreenMasksTable[i];
+			*dst = *mask;
+			if (mask->w != 0) {
+				dst->projectionDataPtr = _video->_shadowScreenMaskBuffer + (mask->projectionDataPtr - entry->masksData);
+				dst->shadowPalettePtr = _video->_shadowScreenMaskBuffer + (mask->shadowPalettePtr - entry->masksData);
+			}
+		}
+	}
+	setupShadowColorLookupTable(entry->masksBits);
 }
 
 // a: type/source (0, 1, 2) b: num/index (3, monster1Index, monster2.monster1Index)
@@ -338,13 +416,35 @@ void Game::setupBackgroundBitmap() {
 	if (lvl->backgroundBitmapId != 0xFFFF) {
 		playSound(lvl->backgroundBitmapId, 0, 0, 3);
 	}
+	finishPredecode();
+	const uint32_t cacheKey = BackgroundCache::makeKey(_currentLevel, _res->_currentScreenResourceNum, num, lvl->currentShadowId);
+	const BackgroundCacheEntry *cacheEntry = _backgroundCache.find(cacheKey);
+	bool decoded = true;
 	if (_res->_isPsx) {
 		_video->decodeBackgroundPsx(bmp + 2, -1, Video::W, Video::H);
-	} else {
-		decodeLZW(bmp, _video->_backgroundLayer);
-	}
-	if (lvl->shadowCount != 0) {
-		decodeShadowScreenMask(lvl);
+	} else if (cacheEntry) {
+		memcpy(_video->_backgroundLayer, cacheEntry->background, Video::W * Video::H);
+	} else if (decodeLZW(&_res->_lzw, bmp, _video->_backgroundLayer, Video::W * Video::H) < 0) {
+		warning("Failed to decode background bitmap %d", num);
+		decoded = false;
+	}
+	if (cacheEntry) {
+		restoreShadowScreenMasks(cacheEntry);
+	} else if (decoded) {
+		BackgroundCacheEntry entry;
+		entry.key = cacheKey;
+		entry.background = _res->_isPsx ? 0 : _video->_backgroundLayer;
+		entry.masksData = _video->_shadowScreenMaskBuffer;
+		entry.masksDataSize = 0;
+		entry.masksBits = 0;
+		if (lvl->shadowCount != 0) {
+			entry.masksDataSize = decodeShadowScreenMask(lvl, &entry.masksBits);
+		}
+		memcpy(entry.masks, _shadowScreenMasksTable, sizeof(entry.masks));
+		_backgroundCache.add(&entry);
+	} else if (lvl->shadowCount != 0) {
+		uint32_t masksBits = 0;
+		decodeShadowScreenMask(lvl, &masksBits);
 	}
 	for (int i = 0; i < 256 * 3; ++i) {
 		_video->_displayPaletteBuffer[i] = pal[i] << 8;
@@ -370,6 +470,7 @@ void Game::addToSpriteList(LvlObject *ptr) {
 		LvlAnimSeqHeader *ash = (LvlAnimSeqHeader *)(dat->animsInfoData + ah->seqOffset) + ptr->frame;
 
 		spr->num = (((ash->flags1 ^ ptr->flags1) & 0xFFF0) << 10) | (ptr->flags2 & 0x3FFF);
+		spr->owner = ptr;
 
 		int index = ptr->screenNum;
 		spr->xPos = ptr->xPos;
@@ -1237,6 +1338,7 @@ void Game::setupScreen(uint8_t num) {
 	setupBackgroundBitmap();
 	setupScreenMask(num);
 	resetDisplay();
+	startPredecode(num);
 }
 
 void Game::resetScreen() {
@@ -1825,12 +1927,23 @@ void Game::updateBackgroundPsx(int num) {
 	}
 }
 
+void Game::drawSprite(const Sprite *spr, uint8_t *dst, uint8_t flags) {
+	// the spans are only faster than the RLE opcodes when decodeSPR has to clip each pixel
+	if ((flags & kSprHorizFlip) != 0 || spr->xPos < 0 || spr->xPos + spr->w > Video::W) {
+		const CompiledSprite *cs = _res->findCompiledSprite(spr->bitmapBits);
+		if (cs) {
+			Video::drawCompiledSPR(cs, dst, spr->xPos, spr->yPos, flags, spr->w, spr->h);
+			return;
+		}
+	}
+	Video::decodeSPR(spr->bitmapBits, dst, spr->xPos, spr->yPos, flags, spr->w, spr->h);
+}
+
 void Game::drawScreen() {
 	memcpy(_video->_frontLayer, _video->_backgroundLayer, Video::W * Video::H);
 	_video->copyYuvBackBuffer();
 
 	// redraw background animation sprites
-	LvlBackgroundData *dat = &_res->_resLvlScreenBackgroundDataTable[_res->_currentScreenResourceNum];
 	if (_res->_isPsx) {
 		for (Sprite *spr = _typeSpritesList[0]; spr; spr = spr->nextPtr) {
 			assert((spr->num & 0x1F) == 0);
@@ -1840,26 +1953,31 @@ void Game::drawScreen() {
 	} else {
 		for (Sprite *spr = _typeSpritesList[0]; spr; spr = spr->nextPtr) {
 			if ((spr->num & 0x1F) == 0) {
-				_video->decodeSPR(spr->bitmapBits, _video->_backgroundLayer, spr->xPos, spr->yPos, 0, spr->w, spr->h);
+				drawSprite(spr, _video->_backgroundLayer, 0);
 			}
 		}
 	}
-	memset(_video->_shadowLayer, 0, Video::W * Video::H + 1);
+	drawScreenSprites(_video->_frontLayer, _video->_shadowLayer, true);
+}
+
+void Game::drawScreenSprites(uint8_t *frontLayer, uint8_t *shadowLayer, bool plasmaCannon) {
+	LvlBackgroundData *dat = &_res->_resLvlScreenBackgroundDataTable[_res->_currentScreenResourceNum];
+	memset(shadowLayer, 0, Video::W * Video::H + 1);
 	for (int i = 1; i < 8; ++i) {
 		for (Sprite *spr = _typeSpritesList[i]; spr; spr = spr->nextPtr) {
 			if ((spr->num & 0x2000) != 0) {
-				_video->decodeSPR(spr->bitmapBits, _video->_shadowLayer, spr->xPos, spr->yPos, (spr->num >> 0xE) & 3, spr->w, spr->h);
+				drawSprite(spr, shadowLayer, (spr->num >> 0xE) & 3);
 			}
 		}
 	}
 	for (int i = 1; i < 4; ++i) {
 		for (Sprite *spr = _typeSpritesList[i]; spr; spr = spr->nextPtr) {
 			if ((spr->num & 0x1000) != 0) {
-				_video->decodeSPR(spr->bitmapBits, _video->_frontLayer, spr->xPos, spr->yPos, (spr->num >> 0xE) & 3, spr->w, spr->h);
+				drawSprite(spr, frontLayer, (spr->num >> 0xE) & 3);
 			}
 		}
 	}
-	if (_andyObject->spriteNum == 0 && (_andyObject->flags2 & 0x1F) == 4) {
+	if (plasmaCannon && _andyObject->spriteNum == 0 && (_andyObject->flags2 & 0x1F) == 4) {
 		if (_plasmaCannonFirstIndex < _plasmaCannonLastIndex2) {
 			drawPlasmaCannon();
 		}
@@ -1867,14 +1985,14 @@ void Game::drawScreen() {
 	for (int i = 4; i < 8; ++i) {
 		for (Sprite *spr = _typeSpritesList[i]; spr; spr = spr->nextPtr) {
 			if ((spr->num & 0x1000) != 0) {
-				_video->decodeSPR(spr->bitmapBits, _video->_frontLayer, spr->xPos, spr->yPos, (spr->num >> 0xE) & 3, spr->w, spr->h);
+				drawSprite(spr, frontLayer, (spr->num >> 0xE) & 3);
 			}
 		}
 	}
 	for (int i = 0; i < 24; ++i) {
 		for (Sprite *spr = _typeSpritesList[i]; spr; spr = spr->nextPtr) {
 			if ((spr->num & 0x2000) != 0) {
-				_video->decodeSPR(spr->bitmapBits, _video->_shadowLayer, spr->xPos, spr->yPos, (spr->num >> 0xE) & 3, spr->w, spr->h);
+				drawSprite(spr, shadowLayer, (spr->num >> 0xE) & 3);
 			}
 		}
 	}
@@ -1885,19 +2003,19 @@ void Game::drawScreen() {
 			_shadowScreenMasksTable[i].h,
 			256,
 			_shadowScreenMasksTable[i].w,
-			_video->_shadowLayer,
-			_video->_frontLayer,
+			shadowLayer,
+			frontLayer,
 			_shadowScreenMasksTable[i].projectionDataPtr,
 			_shadowScreenMasksTable[i].shadowPalettePtr);
 	}
 	for (int i = 1; i < 12; ++i) {
 		for (Sprite *spr = _typeSpritesList[i]; spr; spr = spr->nextPtr) {
 			if ((spr->num & 0x1000) != 0) {
-				_video->decodeSPR(spr->bitmapBits, _video->_frontLayer, spr->xPos, spr->yPos, (spr->num >> 0xE) & 3, spr->w, spr->h);
+				drawSprite(spr, frontLayer, (spr->num >> 0xE) & 3);
 			}
 		}
 	}
-	if (_andyObject->spriteNum == 0 && (_andyObject->flags2 & 0x1F) == 0xC) {
+	if (plasmaCannon && _andyObject->spriteNum == 0 && (_andyObject->flags2 & 0x1F) == 0xC) {
 		if (_plasmaCannonFirstIndex < _plasmaCannonLastIndex2) {
 			drawPlasmaCannon();
 		}
@@ -1905,7 +2023,7 @@ void Game::drawScreen() {
 	for (int i = 12; i <= 24; ++i) {
 		for (Sprite *spr = _typeSpritesList[i]; spr; spr = spr->nextPtr) {
 			if ((spr->num & 0x1000) != 0) {
-				_video->decodeSPR(spr->bitmapBits, _video->_frontLayer, spr->xPos, spr->yPos, (spr->num >> 0xE) & 3, spr->w, spr->h);
+				drawSprite(spr, frontLayer, (spr->num >> 0xE) & 3);
 			}
 		}
 	}
@@ -1940,6 +2058,7 @@ void Game::mainLoop(int level, int checkpoint, bool levelChanged) {
 		// resume once, on the starting level
 		_resumeGame = false;
 	}
+	const uint32_t randSeed = _rnd._rndSeed;
 
 	PafCallback pafCb;
 	pafCb.frameProc = 0;
@@ -1996,14 +2115,60 @@ void Game::mainLoop(int level, int checkpoint, bool levelChanged) {
 	resetShootLvlObjectDataTable();
 	callLevel_initialize();
 	restartLevel();
+	if (_recordDemPath) {
+		startDemoRecording(randSeed, rounds);
+	}
+	const uint64_t startTimeNs = getTimeNs();
+	int framesCount = 0;
+	// with the frames presented between the ticks, the late logic ticks catch up like a fixed timestep accumulator
+	const int refreshRate = (_presentRefreshRate && !_turboMode) ? g_system->getDisplayRefreshRate() : 0;
+	_presentBetweenTicks = (refreshRate * _frameMs > 1000);
+	_pacer.start(_frameMs, _presentBetweenTicks ? kPacerCatchUp : kPacerDrop);
+	if (_presentBetweenTicks) {
+		_presentPacer.startNs(1000000000 / refreshRate, kPacerDrop);
+		initInterpolation();
+	}
 	while (true) {
-		const int frameTimeStamp = g_system->getTimeStamp() + _frameMs;
+		const uint64_t frameTimeNs = getTimeNs();
+		_profiler.beginFrame();
 		levelMainLoop();
-		if (g_system->inp.quit || _endLevel) {
+		_profiler.endFrame();
+		if (_benchmarkFrameTimesNs) {
+			_benchmarkFrameTimesNs[framesCount] = getTimeNs() - frameTimeNs;
+			_benchmarkFrameTimesCount = framesCount + 1;
+		}
+		if (_replayTraceFp || _replayGoldenFp) {
+			updateReplayTrace(framesCount);
+		}
+		++framesCount;
+		if (g_system->inp.quit || _endLevel || framesCount == _benchmarkFramesCount) {
+			break;
+		}
+		if (_playDemo && (_res->_demOffset >= _res->_dem.keyMaskLen || _replayMismatchFrame >= 0)) {
 			break;
 		}
-		const int delay = MAX<int>(10, frameTimeStamp - g_system->getTimeStamp());
-		g_system->sleep(delay);
+		if (_turboMode) {
+			continue;
+		}
+		if (_presentBetweenTicks) {
+			presentUntilNextTick();
+		} else {
+			_pacer.wait();
+		}
+	}
+	if (_turboMode) {
+		const uint64_t durationNs = getTimeNs() - startTimeNs;
+		fprintf(stdout, "Level %d: %d frames in %.3f seconds, %.1f fps\n", _currentLevel, framesCount, durationNs / 1e9, durationNs ? framesCount * 1e9 / durationNs : 0.);
+	} else {
+		_pacer.dumpStats(kDebug_GAME, "Level");
+		_backgroundCache.dumpStats(kDebug_GAME);
+		if (_presentBetweenTicks) {
+			_presentPacer.dumpStats(kDebug_GAME, "Present");
+		}
+	}
+	finishPredecode();
+	if (_recordDemPath) {
+		stopDemoRecording();
 	}
 	_animBackgroundDataCount = 0;
 	callLevel_terminate();
@@ -2011,6 +2176,9 @@ void Game::mainLoop(int level, int checkpoint, bool levelChanged) {
 
 void Game::mixAudio(int16_t *buf, int len) {
 
+	traceThreadName("audio");
+	TraceScope ts("mixAudio");
+
 	if (_snd_muted) {
 		return;
 	}
@@ -2517,10 +2685,12 @@ void Game::updateInput() {
 void Game::levelMainLoop() {
 	memset(_typeSpritesList, 0, sizeof(_typeSpritesList));
 	_spritesNextPtr = &_spritesTable[0];
-	for (int i = 0; i < kMaxSprites - 1; ++i) {
-		_spritesTable[i].nextPtr = &_spritesTable[i + 1];
+	for (int i = 0; i < kMaxSprites; ++i) {
+		_spritesTable[i].nextPtr = (i < kMaxSprites - 1) ? &_spritesTable[i + 1] : 0;
+		_spritesTable[i].owner = 0;
 	}
-	_spritesTable[kMaxSprites - 1].nextPtr = 0;
+	// the sprites lists are reset, present the last frame drawn as is
+	_interpolateFrame = false;
 	_directionKeyMask = 0;
 	_actionKeyMask = 0;
 	updateInput();
@@ -2532,6 +2702,9 @@ void Game::levelMainLoop() {
 		_andyObject->directionKeyMask = _directionKeyMask;
 		_andyObject->actionKeyMask = _actionKeyMask;
 	}
+	if (_recordDem.actionKeyMask) {
+		recordDemoFrame();
+	}
 	_video->clearBackBuffer();
 	if (_andyObject->screenNum != _res->_currentScreenResourceNum) {
 		preloadLevelScreenData(_andyObject->screenNum, _res->_currentScreenResourceNum);
@@ -2551,20 +2724,33 @@ void Game::levelMainLoop() {
 		return;
 	}
 	_currentLevelCheckpoint = _level->_checkpoint;
-	if (updateAndyLvlObject()) {
+	_profiler.begin(kProfileAndy);
+	const bool andyUpdated = updateAndyLvlObject();
+	_profiler.end(kProfileAndy);
+	if (andyUpdated) {
+		_profiler.begin(kProfileLevelTick);
 		callLevel_tick();
+		_profiler.end(kProfileLevelTick);
 		return;
 	}
+	_profiler.begin(kProfileMst);
 	executeMstCode();
+	_profiler.end(kProfileMst);
+	_profiler.begin(kProfileLvlObjects);
 	updateLvlObjectLists();
+	_profiler.end(kProfileLvlObjects);
+	_profiler.begin(kProfileLevelTick);
 	callLevel_tick();
+	_profiler.end(kProfileLevelTick);
 	updateAndyMonsterObjects();
 	if (!_hideAndyObjectFlag) {
 		addToSpriteList(_andyObject);
 	}
 	((AndyLvlObjectData *)_andyObject->dataPtr)->dxPos = 0;
 	((AndyLvlObjectData *)_andyObject->dataPtr)->dyPos = 0;
+	_profiler.begin(kProfileAnimatedObjects);
 	updateAnimatedLvlObjectsLeftRightCurrentScreens();
+	_profiler.end(kProfileAnimatedObjects);
 	if (_currentLevel == kLvl_rock || _currentLevel == kLvl_lar2 || _currentLevel == kLvl_test) {
 		if (_andyObject->spriteNum == 0 && _plasmaExplosionObject && _plasmaExplosionObject->nextPtr != 0) {
 			updatePlasmaCannonExplosionLvlObject(_plasmaExplosionObject->nextPtr);
@@ -2575,7 +2761,9 @@ void Game::levelMainLoop() {
 		_video->updateGamePalette(_video->_displayPaletteBuffer);
 		g_system->copyRectWidescreen(Video::W, Video::H, _video->_backgroundLayer, _video->_palette);
 	}
+	_profiler.begin(kProfileDrawScreen);
 	drawScreen();
+	_profiler.end(kProfileDrawScreen);
 	if (g_system->inp.screenshot) {
 		g_system->inp.screenshot = false;
 		captureScreenshot();
@@ -2585,12 +2773,18 @@ void Game::levelMainLoop() {
 		snprintf(buffer, sizeof(buffer), "P%d S%02d %d R%d", _currentLevel, _andyObject->screenNum, _res->_screensState[_andyObject->screenNum].s0, _level->_checkpoint);
 		_video->drawString(buffer, (Video::W - strlen(buffer) * 8) / 2, 8, _video->findWhiteColor(), _video->_frontLayer);
 	}
+	_profiler.drawOverlay(_video, 24);
+	if (_presentBetweenTicks && _interpolateSprites) {
+		updateInterpolatedSprites();
+	}
+	_profiler.begin(kProfileGameDisplay);
 	if (_shakeScreenDuration != 0 || _levelRestartCounter != 0 || _video->_displayShadowLayer) {
 		shakeScreen();
 		_video->updateGameDisplay(_video->_displayShadowLayer ? _video->_shadowLayer : _video->_frontLayer);
 	} else {
 		_video->updateGameDisplay(_video->_frontLayer);
 	}
+	_profiler.end(kProfileGameDisplay);
 	_rnd.update();
 	g_system->processEvents();
 	if (g_system->inp.keyPressed(SYS_INP_ESC) || g_system->inp.exit) { // display exit confirmation screen
@@ -2599,7 +2793,11 @@ void Game::levelMainLoop() {
 		}
 	} else {
 		// displayHintScreen(1, 0);
-		_video->updateScreen();
+		_profiler.begin(kProfileScreen);
+		if (!_interpolateFrame) { // otherwise presented by presentUntilNextTick()
+			_video->updateScreen();
+		}
+		_profiler.end(kProfileScreen);
 	}
 }
 
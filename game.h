@@ -7,10 +7,13 @@
 #define GAME_H__
 
 #include "intern.h"
+#include "bgcache.h"
 #include "defs.h"
 #include "fileio.h"
 #include "fs.h"
 #include "mixer.h"
+#include "pacer.h"
+#include "profiler.h"
 #include "random.h"
 #include "resource.h"
 
@@ -28,6 +31,12 @@ struct CheckpointData {
 	uint8_t spriteNum;
 };
 
+struct InterpolatedSprite {
+	const LvlObject *owner;
+	int16_t xPos;
+	int16_t yPos;
+};
+
 enum {
 	kObjectDataTypeAndy,
 	kObjectDataTypeAnimBackgroundData,
@@ -87,12 +96,18 @@ struct Game {
 	FileSystem _fs;
 	Level *_level;
 	Mixer _mix;
+	FramePacer _pacer;
+	BackgroundCache _backgroundCache;
 	PafPlayer *_paf;
+	Profiler _profiler;
 	Random _rnd;
 	Resource *_res;
 	Video *_video;
 	uint32_t _cheats;
 	int _frameMs;
+	bool _turboMode; // do not throttle the frame rate
+	bool _presentRefreshRate; // present the last frame at the display refresh rate between the logic ticks
+	bool _interpolateSprites;
 	int _difficulty;
 
 	SetupConfig _setupConfig;
@@ -235,7 +250,60 @@ struct Game {
 	}
 
 	// benchmark.cpp
+	int _benchmarkFramesCount; // stop mainLoop after that many frames
+	uint64_t *_benchmarkFrameTimesNs;
+	int _benchmarkFrameTimesCount;
+
 	uint32_t benchmarkCpu();
+	void benchmarkCodecs();
+	void benchmarkLevel(int level, int framesCount);
+	bool writeBenchmarkResults(const char *path);
+
+	// interpolate.cpp
+	bool _presentBetweenTicks;
+	FramePacer _presentPacer;
+	uint8_t *_interpolatedLayers; // front and shadow
+	InterpolatedSprite _interpolatedSprites[2][kMaxSprites]; // previous and current logic ticks
+	int _interpolatedSpritesCount[2];
+	int _interpolatedScreenNum[2];
+	int _interpolatedSpritesIndex;
+	bool _interpolateFrame; // the sprites of the last frame drawn can be interpolated
+
+	void initInterpolation();
+	void updateInterpolatedSprites();
+	void drawInterpolatedScreen(int alpha);
+	void presentUntilNextTick();
+
+	// predecode.cpp
+	enum {
+		kMaxPredecodedScreens = 4 // top, right, bottom and left
+	};
+	bool _predecodeScreens;
+	void *_predecodeWorker;
+	uint8_t *_predecodeBuffer;
+	LzwDecoder *_predecodeLzw;
+	int _predecodedScreensCount;
+	LvlBackgroundData _predecodeScreensData[kMaxPredecodedScreens]; // copied when the worker is started
+	BackgroundCacheEntry _predecodedScreens[kMaxPredecodedScreens];
+
+	void startPredecode(int screenNum);
+	void finishPredecode();
+	void predecodeScreens();
+
+	// replay.cpp
+	FILE *_replayTraceFp; // per-frame hashes output
+	FILE *_replayGoldenFp; // per-frame hashes to compare with
+	int _replayMismatchFrame;
+
+	const char *_recordDemPath; // record the input of the next level played
+	Dem _recordDem;
+	uint32_t _recordDemSize; // allocated key masks
+
+	bool replayDemo(const char *demPath, const char *tracePath, const char *goldenPath);
+	void updateReplayTrace(int frame);
+	void startDemoRecording(uint32_t randSeed, int randRounds);
+	void recordDemoFrame();
+	void stopDemoRecording();
 
 	// game.cpp
 	void mainLoop(int level, int checkpoint, bool levelChanged);
@@ -249,7 +317,10 @@ struct Game {
 	void transformShadowLayer(int delta);
 	void loadTransformLayerData(const uint8_t *data);
 	void unloadTransformLayerData();
-	void decodeShadowScreenMask(LvlBackgroundData *lvl);
+	static int decodeShadowScreenMaskData(LzwDecoder *lzw, const LvlBackgroundData *lvl, uint8_t *dst, int dstSize, ScreenMask *masks, uint32_t *masksBits);
+	int decodeShadowScreenMask(LvlBackgroundData *lvl, uint32_t *masksBits);
+	void setupShadowColorLookupTable(uint32_t masksBits);
+	void restoreShadowScreenMasks(const BackgroundCacheEntry *entry);
 	SssObject *playSound(int num, LvlObject *ptr, int a, int b);
 	void removeSound(LvlObject *ptr);
 	void setupBackgroundBitmap();
@@ -305,7 +376,9 @@ struct Game {
 	int updateAndyLvlObject();
 	void drawPlasmaCannon();
 	void updateBackgroundPsx(int num);
+	void drawSprite(const Sprite *spr, uint8_t *dst, uint8_t flags);
 	void drawScreen();
+	void drawScreenSprites(uint8_t *frontLayer, uint8_t *shadowLayer, bool plasmaCannon);
 	void updateLvlObjectList(LvlObject **list);
 	void updateLvlObjectLists();
 	LvlObject *updateAnimatedLvlObjectType0(LvlObject *ptr);
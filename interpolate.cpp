@@ -0,0 +1,105 @@
+
+#include "game.h"
+#include "system.h"
+#include "util.h"
+#include "video.h"
+
+// the frames are presented at the display refresh rate between two logic ticks, either as is or with the
+// positions of the sprites interpolated between the previous and the current ticks (one tick of latency)
+
+static const int kMaxInterpolatedDistance = 48; // larger moves are teleports and are not interpolated
+
+void Game::initInterpolation() {
+	_interpolateFrame = false;
+	_interpolatedSpritesCount[0] = _interpolatedSpritesCount[1] = 0;
+	_interpolatedScreenNum[0] = _interpolatedScreenNum[1] = -1;
+	_interpolatedSpritesIndex = 0;
+	if (_interpolateSprites && !_interpolatedLayers) {
+		_interpolatedLayers = (uint8_t *)malloc(Video::W * Video::H * 2 + 1);
+		if (!_interpolatedLayers) {
+			warning("Unable to allocate %d bytes for the interpolated layers", Video::W * Video::H * 2 + 1);
+			_interpolateSprites = false;
+		}
+	}
+}
+
+// called after drawScreen(), the sprites lists are unchanged until the next logic tick
+void Game::updateInterpolatedSprites() {
+	_interpolatedSpritesIndex ^= 1;
+	InterpolatedSprite *sprites = _interpolatedSprites[_interpolatedSpritesIndex];
+	int count = 0;
+	for (int i = 1; i < (int)kMaxSpriteTypes; ++i) {
+		for (Sprite *spr = _typeSpritesList[i]; spr; spr = spr->nextPtr) {
+			if (spr->owner) {
+				sprites[count].owner = spr->owner;
+				sprites[count].xPos = spr->xPos;
+				sprites[count].yPos = spr->yPos;
+				++count;
+			}
+		}
+	}
+	_interpolatedSpritesCount[_interpolatedSpritesIndex] = count;
+	_interpolatedScreenNum[_interpolatedSpritesIndex] = _res->_currentScreenResourceNum;
+	if (_interpolatedScreenNum[_interpolatedSpritesIndex ^ 1] != _res->_currentScreenResourceNum) {
+		_interpolateFrame = false;
+		return;
+	}
+	// the plasma cannon, the screen effects and the overlays are not redrawn
+	const bool plasmaCannon = _andyObject->spriteNum == 0 && ((_andyObject->flags2 & 0x1F) == 4 || (_andyObject->flags2 & 0x1F) == 0xC) && _plasmaCannonFirstIndex < _plasmaCannonLastIndex2;
+	_interpolateFrame = !_res->_isPsx && !plasmaCannon && _shakeScreenDuration == 0 && _levelRestartCounter == 0 && !_video->_displayShadowLayer && _cheats == 0 && !(_profiler._enabled && _profiler._overlay);
+}
+
+// 'alpha' is the position between the previous (0) and the current (256) logic ticks
+void Game::drawInterpolatedScreen(int alpha) {
+	const InterpolatedSprite *prev = _interpolatedSprites[_interpolatedSpritesIndex ^ 1];
+	const int prevCount = _interpolatedSpritesCount[_interpolatedSpritesIndex ^ 1];
+	int16_t pos[kMaxSprites][2];
+	for (int i = 0; i < kMaxSprites; ++i) {
+		Sprite *spr = &_spritesTable[i];
+		pos[i][0] = spr->xPos;
+		pos[i][1] = spr->yPos;
+		if (!spr->owner) {
+			continue;
+		}
+		for (int j = 0; j < prevCount; ++j) {
+			if (prev[j].owner == spr->owner) {
+				const int dx = spr->xPos - prev[j].xPos;
+				const int dy = spr->yPos - prev[j].yPos;
+				if (ABS(dx) <= kMaxInterpolatedDistance && ABS(dy) <= kMaxInterpolatedDistance) {
+					spr->xPos = prev[j].xPos + dx * alpha / 256;
+					spr->yPos = prev[j].yPos + dy * alpha / 256;
+				}
+				break;
+			}
+		}
+	}
+	// the background animations are already drawn on the background layer
+	uint8_t *frontLayer = _interpolatedLayers;
+	uint8_t *shadowLayer = _interpolatedLayers + Video::W * Video::H;
+	memcpy(frontLayer, _video->_backgroundLayer, Video::W * Video::H);
+	drawScreenSprites(frontLayer, shadowLayer, false);
+	for (int i = 0; i < kMaxSprites; ++i) {
+		_spritesTable[i].xPos = pos[i][0];
+		_spritesTable[i].yPos = pos[i][1];
+	}
+}
+
+void Game::presentUntilNextTick() {
+	const uint64_t tickNs = _pacer._wakeUpNs;
+	bool presented = !_interpolateFrame;
+	// keep half a refresh period for the logic tick deadline
+	while (_presentPacer._deadlineNs + _presentPacer._frameNs / 2 < _pacer._deadlineNs || !presented) {
+		if (presented) {
+			_presentPacer.wait();
+		}
+		if (_interpolateFrame) {
+			const uint64_t elapsedNs = g_system->getTimeStampNs() - tickNs;
+			const int alpha = (int)MIN<uint64_t>(elapsedNs * 256 / _pacer._frameNs, 256);
+			drawInterpolatedScreen(alpha);
+			g_system->copyRect(0, 0, Video::W, Video::H, _interpolatedLayers, Video::W);
+		}
+		_video->updateScreen();
+		presented = true;
+	}
+	_pacer.wait();
+}
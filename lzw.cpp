@@ -3,107 +3,141 @@
  * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
-#include "intern.h"
+#include <limits.h>
+#include "lzw.h"
+#include "util.h"
 
 enum {
 	kCodeWidth = 9,
 	kClearCode = 1 << (kCodeWidth - 1),
 	kEndCode = kClearCode + 1,
 	kNewCodes = kEndCode + 1,
-	kStackSize = 8192,
 	kMaxBits = 12
 };
 
-struct LzwDecoder {
-
-	uint16_t _prefix[1 << kMaxBits];
-	uint8_t _stack[kStackSize];
+// the streams are not sized, only load the bytes of the next code to not read past the end code
+struct LzwBitReader {
 	const uint8_t *_buf;
-	uint32_t _currentBits;
-	uint8_t _bitsLeft;
+	uint64_t _bits;
+	int _bitsCount;
+
+	LzwBitReader(const uint8_t *src)
+		: _buf(src), _bits(0), _bitsCount(0) {
+	}
 
+	void refill(int codeSize);
 	uint32_t nextCode(int codeSize);
-	int decode(uint8_t *dst);
 };
 
-static struct LzwDecoder _lzw;
+inline void LzwBitReader::refill(int codeSize) {
+	do {
+		_bits |= (uint64_t)(*_buf++) << _bitsCount;
+		_bitsCount += 8;
+	} while (_bitsCount < codeSize);
+}
 
-uint32_t LzwDecoder::nextCode(int codeSize) { // 9 to 12bits
-	_currentBits |= (*_buf++) << _bitsLeft;
-	_bitsLeft += 8;
-	if (_bitsLeft < codeSize) {
-		_currentBits |= (*_buf++) << _bitsLeft;
-		_bitsLeft += 8;
+inline uint32_t LzwBitReader::nextCode(int codeSize) { // 9 to 12bits
+	if (_bitsCount < codeSize) {
+		refill(codeSize);
 	}
-	const uint32_t code = _currentBits & ((1 << codeSize) - 1);
-	_currentBits >>= codeSize;
-	_bitsLeft -= codeSize;
+	const uint32_t code = (uint32_t)_bits & ((1 << codeSize) - 1);
+	_bits >>= codeSize;
+	_bitsCount -= codeSize;
 	return code;
 }
 
-int LzwDecoder::decode(uint8_t *dst) {
+// the dictionary strings are completely decoded before the current output position and never overlap the copy
+static inline void copyString(uint8_t *dst, const uint8_t *src, int len) {
+	if (len <= 8) {
+		for (int i = 0; i < len; ++i) {
+			dst[i] = src[i];
+		}
+	} else {
+		memcpy(dst, src, len);
+	}
+}
+
+int LzwDecoder::decode(const uint8_t *src, uint8_t *dst, int dstSize) {
+	// the reader is a local copy, the stores to the output could otherwise alias its state
+	LzwBitReader br(src);
 	uint8_t *p = dst;
-	uint8_t *stackPtr = &_stack[kStackSize - 1];
-	uint32_t previousCode = 0;
-	uint32_t lastCode = 0;
+	int bytesLeft = (dstSize >= 0) ? dstSize : INT_MAX;
+	_initialString[0] = 0;
+	const uint8_t *lastString = _initialString;
+	int lastLength = 1;
 	uint32_t currentCode;
 	uint32_t currentSlot = kNewCodes;
 	uint32_t topSlot = 1 << kCodeWidth;
 	int codeSize = kCodeWidth;
-	while ((currentCode = nextCode(codeSize)) != kEndCode) {
+	while ((currentCode = br.nextCode(codeSize)) != kEndCode) {
 		if (currentCode == kClearCode) {
 			currentSlot = kNewCodes;
 			topSlot = 1 << kCodeWidth;
 			codeSize = kCodeWidth;
-			while ((currentCode = nextCode(codeSize)) == kClearCode) {
+			while ((currentCode = br.nextCode(codeSize)) == kClearCode) {
 			}
 			if (currentCode == kEndCode) {
 				break;
 			} else if (currentCode >= kNewCodes) {
 				currentCode = 0;
 			}
-			previousCode = lastCode = currentCode;
+			if (bytesLeft < 1) {
+				break;
+			}
+			--bytesLeft;
+			lastString = p;
+			lastLength = 1;
 			*p++ = (uint8_t)currentCode;
 		} else {
-			uint8_t *currentStackPtr = stackPtr;
-			uint32_t slot = currentSlot;
-			uint32_t code = currentCode;
-			if (currentCode >= slot) {
-				code = lastCode;
-				currentStackPtr = &_stack[kStackSize - 2];
-				*currentStackPtr = (uint8_t)previousCode;
+			int len;
+			if (currentCode < kClearCode) {
+				len = 1;
+				if (len > bytesLeft) {
+					break;
+				}
+				*p = (uint8_t)currentCode;
+			} else if (currentCode < currentSlot) {
+				len = _lengths[currentCode];
+				if (len > bytesLeft) {
+					break;
+				}
+				copyString(p, _strings[currentCode], len);
+			} else if (currentCode == currentSlot) { // KwK, the previous string followed by its first byte
+				len = lastLength + 1;
+				if (len > bytesLeft) {
+					break;
+				}
+				copyString(p, lastString, lastLength);
+				p[lastLength] = lastString[0];
+			} else {
+				warning("LZW invalid code %d, next code %d", currentCode, currentSlot);
+				return -1;
 			}
-			while (code >= kNewCodes) {
-				--currentStackPtr;
-				assert(currentStackPtr >= &_stack[0]);
-				*currentStackPtr = _stack[code];
-				code = _prefix[code];
+			bytesLeft -= len;
+			if (currentSlot < topSlot) {
+				if (lastString == _initialString) {
+					_initialString[1] = p[0];
+				}
+				_strings[currentSlot] = lastString;
+				_lengths[currentSlot] = (uint16_t)(lastLength + 1);
+				++currentSlot;
 			}
-			--currentStackPtr;
-			*currentStackPtr = (uint8_t)code;
-			if (slot < topSlot) {
-				_stack[slot] = (uint8_t)code;
-				previousCode = code;
-				_prefix[slot] = (uint16_t)lastCode;
-				lastCode = currentCode;
-				++slot;
-				currentSlot = slot;
-			}
-			if (slot >= topSlot && codeSize < kMaxBits) {
+			if (currentSlot >= topSlot && codeSize < kMaxBits) {
 				topSlot <<= 1;
 				++codeSize;
 			}
-			while (currentStackPtr < stackPtr) {
-				*p++ = *currentStackPtr++;
-			}
-			assert(currentStackPtr == stackPtr);
+			lastString = p;
+			lastLength = len;
+			p += len;
 		}
 	}
+	if (currentCode != kEndCode) {
+		warning("LZW output larger than %d bytes", dstSize);
+		return -1;
+	}
 	return p - dst;
 }
 
-int decodeLZW(const uint8_t *src, uint8_t *dst) {
-	memset(&_lzw, 0, sizeof(_lzw));
-	_lzw._buf = src;
-	return _lzw.decode(dst);
+int decodeLZW(LzwDecoder *lzw, const uint8_t *src, uint8_t *dst, int dstSize) {
+	return lzw->decode(src, dst, dstSize);
 }
@@ -6,7 +6,25 @@
 #ifndef LZW_H__
 #define LZW_H__
 
-int decodeLZW(const uint8_t *src, uint8_t *dst);
+#include "intern.h"
 
-#endif // LZW_H__
+enum {
+	kLzwMaxCodes = 1 << 12
+};
+
+// the decoder state is owned by the caller, each thread decoding concurrently needs its own decoder
+struct LzwDecoder {
+
+	// the strings of the dictionary entries are not stored, each entry points to the decoded string
+	// of its prefix code in the output buffer, which is followed by the first byte of the next string
+	const uint8_t *_strings[kLzwMaxCodes];
+	uint16_t _lengths[kLzwMaxCodes];
+	uint8_t _initialString[2]; // a stream not starting with a clear code references string(0)
 
+	int decode(const uint8_t *src, uint8_t *dst, int dstSize);
+};
+
+// returns the decoded size, or -1 if the stream is invalid or decodes to more than 'dstSize' bytes (-1 for no limit)
+int decodeLZW(LzwDecoder *lzw, const uint8_t *src, uint8_t *dst, int dstSize = -1);
+
+#endif // LZW_H__
@@ -3,7 +3,7 @@
  * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
  */
 
-#if !defined(PSP) && !defined(WII)
+#if !defined(PSP) && !defined(WII) && !defined(HEADLESS)
 #include <SDL.h>
 #endif
 #include <ctype.h>
@@ -17,6 +17,7 @@
 #include "util.h"
 #include "resource.h"
 #include "system.h"
+#include "trace.h"
 #include "video.h"
 
 #ifdef __SWITCH__
@@ -38,6 +39,18 @@ static const char *_usage =
 	"  --savepath=PATH   Path to save files (default '.')\n"
 	"  --level=NUM       Start at level NUM\n"
 	"  --checkpoint=NUM  Start at checkpoint NUM\n"
+	"  --turbo           Do not throttle the frame rate\n"
+	"  --benchmark[=FILE] Run the benchmarks, write results to FILE (json)\n"
+	"  --demo=FILE       Replay .dem FILE\n"
+	"  --trace=FILE      Write the per-frame hashes of the replay to FILE\n"
+	"  --golden=FILE     Compare the per-frame hashes of the replay with FILE\n"
+	"  --record=FILE     Record the input of the first level played to .dem FILE\n"
+	"  --profile[=FILE]  Display the frame profiler, write per-frame timings to FILE (csv)\n"
+	"  --trace-events=FILE Write engine events to FILE (Chrome trace json)\n"
+#ifdef HEADLESS
+	"  --input=FILE      Read input from script FILE\n"
+	"  --frames=NUM      Quit after NUM input frames\n"
+#endif
 ;
 
 static bool _fullscreen = false;
@@ -71,6 +84,10 @@ static const char *_defaultDataPath = ".";
 
 static const char *_defaultSavePath = ".";
 
+static const char *_defaultBenchmarkPath = "benchmark.json";
+
+static const int kBenchmarkLevelFrames = 1000;
+
 static const char *_levelNames[] = {
 	"rock",
 	"fort",
@@ -105,10 +122,18 @@ static void handleConfigIni(Game *g, const char *section, const char *name, cons
 			g->_playingSssObjectsMax = atoi(value);
 		} else if (strcmp(name, "difficulty") == 0) {
 			g->_difficulty = atoi(value);
+		} else if (strcmp(name, "background_cache_kb") == 0) {
+			g->_backgroundCache.setBudget(atoi(value));
+		} else if (strcmp(name, "predecode_screens") == 0) {
+			g->_predecodeScreens = configBool(value);
 		} else if (strcmp(name, "frame_duration") == 0) {
 			g->_frameMs = g->_paf->_frameMs = atoi(value);
 		} else if (strcmp(name, "loading_screen") == 0) {
 			_displayLoadingScreen = configBool(value);
+		} else if (strcmp(name, "turbo") == 0) {
+			g->_turboMode = g->_paf->_turboMode = configBool(value);
+		} else if (strcmp(name, "profiler_overlay") == 0) {
+			g->_profiler._enabled = g->_profiler._overlay = configBool(value);
 		}
 	} else if (strcmp(section, "display") == 0) {
 		if (strcmp(name, "scale_factor") == 0) {
@@ -116,6 +141,17 @@ static void handleConfigIni(Game *g, const char *section, const char *name, cons
 			g_system->setScaler(0, scale);
 		} else if (strcmp(name, "scale_algorithm") == 0) {
 			g_system->setScaler(value, 0);
+		} else if (strcmp(name, "scale_threads") == 0) {
+			g_system->setScalerThreads(atoi(value));
+		} else if (strcmp(name, "render_thread") == 0) {
+			g_system->setRenderThread(configBool(value));
+		} else if (strcmp(name, "present_refresh_rate") == 0) {
+			g->_presentRefreshRate = configBool(value);
+		} else if (strcmp(name, "interpolate_sprites") == 0) {
+			g->_interpolateSprites = configBool(value);
+			if (g->_interpolateSprites) {
+				g->_presentRefreshRate = true;
+			}
 		} else if (strcmp(name, "gamma") == 0) {
 			g_system->setGamma(atof(value));
 		} else if (strcmp(name, "fullscreen") == 0) {
@@ -183,6 +219,16 @@ int main(int argc, char *argv[]) {
 
 	g_debugMask = 0; //kDebug_GAME | kDebug_RESOURCE | kDebug_SOUND | kDebug_MONSTER;
 	int cheats = 0;
+	bool turbo = false;
+	const char *benchmarkPath = 0;
+	const char *demoPath = 0;
+	const char *tracePath = 0;
+	const char *goldenPath = 0;
+	const char *recordPath = 0;
+	bool profile = false;
+	const char *profilePath = 0;
+	const char *traceEventsPath = 0;
+	int ret = 0;
 
 #ifdef WII
 	System_earlyInit();
@@ -216,6 +262,18 @@ int main(int argc, char *argv[]) {
 				{ "checkpoint", required_argument, 0, 4 },
 				{ "debug",      required_argument, 0, 5 },
 				{ "cheats",     required_argument, 0, 6 },
+#ifdef HEADLESS
+				{ "input",      required_argument, 0, 7 },
+				{ "frames",     required_argument, 0, 16 },
+#endif
+				{ "turbo",      no_argument,       0, 8 },
+				{ "benchmark",  optional_argument, 0, 9 },
+				{ "demo",       required_argument, 0, 10 },
+				{ "trace",      required_argument, 0, 11 },
+				{ "golden",     required_argument, 0, 12 },
+				{ "record",     required_argument, 0, 13 },
+				{ "profile",    optional_argument, 0, 14 },
+				{ "trace-events", required_argument, 0, 15 },
 				{ 0, 0, 0, 0 },
 			};
 			int index;
@@ -253,17 +311,75 @@ int main(int argc, char *argv[]) {
 			case 6:
 				cheats |= atoi(optarg);
 				break;
+#ifdef HEADLESS
+			case 7:
+				System_setInputFile(optarg);
+				break;
+			case 16:
+				System_setMaxFrames(strtoul(optarg, 0, 10));
+				break;
+#endif
+			case 8:
+				turbo = true;
+				break;
+			case 9:
+				benchmarkPath = optarg ? optarg : _defaultBenchmarkPath;
+				break;
+			case 10:
+				demoPath = optarg;
+				break;
+			case 11:
+				tracePath = optarg;
+				break;
+			case 12:
+				goldenPath = optarg;
+				break;
+			case 13:
+				recordPath = optarg;
+				break;
+			case 14:
+				profile = true;
+				profilePath = optarg;
+				break;
+			case 15:
+				traceEventsPath = optarg;
+				break;
 			default:
 				fprintf(stdout, _usage, argv[0]);
 				return -1;
 			}
 		}
 	}
+#ifdef HEADLESS
+	if (!benchmarkPath && !demoPath && !System_hasInputEnd()) {
+		// there is no input device to leave the game
+		warning("No 'quit' in the input script, use --frames=NUM to limit the run");
+		return -1;
+	}
+#endif
+	if (traceEventsPath && traceOpen(traceEventsPath)) {
+		traceThreadName("game");
+	}
 	Game *g = new Game(dataPath ? dataPath : _defaultDataPath, savePath ? savePath : _defaultSavePath, cheats);
 	readConfigIni(_configIni, g);
+	if (turbo) {
+		g->_turboMode = g->_paf->_turboMode = true;
+	}
+	g->_recordDemPath = recordPath;
+	if (profile) {
+		g->_profiler._enabled = g->_profiler._overlay = true;
+		if (profilePath) {
+			g->_profiler.openCsv(profilePath);
+		}
+	}
 	if (_runBenchmark) {
 		g->benchmarkCpu();
 	}
+	if (benchmarkPath) {
+		g->benchmarkCodecs();
+		// keep the results if the level benchmark fails to load
+		g->writeBenchmarkResults(benchmarkPath);
+	}
 	// load setup.dat (PC) or setup.dax (PSX)
 	g->_res->loadSetupDat();
 	const bool isPsx = g->_res->_isPsx;
@@ -272,38 +388,48 @@ int main(int argc, char *argv[]) {
 	if (isPsx) {
 		g->_video->initPsx();
 	}
-	if (_displayLoadingScreen) {
-		g->displayLoadingScreen();
-	}
-	do {
-		g->loadSetupCfg(resume);
-		if (_runMenu && resume) {
-			Menu *m = new Menu(g, g->_paf, g->_res, g->_video);
-			const bool runGame = m->mainLoop();
-			delete m;
-			if (!runGame) {
-				break;
-			}
+	if (benchmarkPath) {
+		g->benchmarkLevel(level, kBenchmarkLevelFrames);
+		g->writeBenchmarkResults(benchmarkPath);
+	} else if (demoPath) {
+		if (!g->replayDemo(demoPath, tracePath, goldenPath)) {
+			ret = 1;
 		}
-		bool levelChanged = false;
-		while (!g_system->inp.quit && level < kLvl_test) {
-			if (_displayLoadingScreen) {
-				g->displayLoadingScreen();
-			}
-			g->mainLoop(level, checkpoint, levelChanged);
-			// do not save progress when starting from a specific level checkpoint
-			if (resume) {
-				g->saveSetupCfg();
+	} else {
+		if (_displayLoadingScreen) {
+			g->displayLoadingScreen();
+		}
+		do {
+			g->loadSetupCfg(resume);
+			if (_runMenu && resume) {
+				Menu *m = new Menu(g, g->_paf, g->_res, g->_video);
+				const bool runGame = m->mainLoop();
+				delete m;
+				if (!runGame) {
+					break;
+				}
 			}
-			if (g->_res->_isDemo) {
-				break;
+			bool levelChanged = false;
+			while (!g_system->inp.quit && level < kLvl_test) {
+				if (_displayLoadingScreen) {
+					g->displayLoadingScreen();
+				}
+				g->mainLoop(level, checkpoint, levelChanged);
+				// do not save progress when starting from a specific level checkpoint
+				if (resume) {
+					g->saveSetupCfg();
+				}
+				if (g->_res->_isDemo) {
+					break;
+				}
+				level = g->_currentLevel + 1;
+				checkpoint = 0;
+				levelChanged = true;
 			}
-			level = g->_currentLevel + 1;
-			checkpoint = 0;
-			levelChanged = true;
-		}
-	} while (!g_system->inp.quit && resume && !isPsx); // do not return to menu when starting from a specific level checkpoint
+		} while (!g_system->inp.quit && resume && !isPsx); // do not return to menu when starting from a specific level checkpoint
+	}
 	g_system->stopAudio();
+	traceClose();
 	g_system->destroy();
 	delete g;
 #ifndef __vita__
@@ -313,5 +439,5 @@ int main(int argc, char *argv[]) {
 #ifdef __SWITCH__
 	socketExit();
 #endif
-	return 0;
+	return ret;
 }
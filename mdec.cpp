@@ -1,8 +1,9 @@
 
-#include <math.h>
 #include "intern.h"
 #include "mdec.h"
 #include "mdec_coeffs.h"
+#include "simd.h"
+#include "util.h"
 
 struct BitStream { // most significant 16 bits
 	const uint8_t *_src;
@@ -51,7 +52,53 @@ static int readDC(BitStream *bs, int version) {
 	return bs->getSignedBits(10);
 }
 
-static void readAC(BitStream *bs, int *coefficients) {
+// position in the block of the n-th coefficient read
+static const uint8_t _zigZagOrder[8 * 8] = {
+	 0,  1,  8, 16,  9,  2,  3, 10,
+	17, 24, 32, 25, 18, 11,  4,  5,
+	12, 19, 26, 33, 40, 48, 41, 34,
+	27, 20, 13,  6,  7, 14, 21, 28,
+	35, 42, 49, 56, 57, 50, 43, 36,
+	29, 22, 15, 23, 30, 37, 44, 51,
+	58, 59, 52, 45, 38, 31, 39, 46,
+	53, 60, 61, 54, 47, 55, 62, 63
+};
+
+static const uint8_t _quantizationTable[8 * 8] = {
+	 2, 16, 19, 22, 26, 27, 29, 34,
+	16, 16, 22, 24, 27, 29, 34, 37,
+	19, 22, 26, 27, 29, 34, 34, 38,
+	22, 22, 26, 27, 29, 34, 37, 40,
+	22, 26, 27, 29, 32, 35, 40, 48,
+	26, 27, 29, 32, 35, 40, 48, 58,
+	26, 27, 29, 34, 38, 46, 56, 69,
+	27, 29, 35, 38, 46, 56, 69, 83
+};
+
+enum {
+	kDequantBits = 3, // the AC coefficients are scaled by qscale / 8
+	kDequantMax = (1 << (10 + kDequantBits)) - 1, // clamped to not overflow the IDCT, not reached by valid streams
+	kConstBits = 13,
+	kPass1Bits = 2,
+	kPass1Shift = kConstBits - kPass1Bits + kDequantBits, // the dequantization fractional bits are dropped after the columns
+	kPass2Shift = kConstBits + kPass1Bits + 3
+};
+
+// dequantization factors in the read order, with kDequantBits fractional bits
+static void initDequantTable(int *dequant, int scale) {
+	dequant[0] = _quantizationTable[0] << kDequantBits; // DC
+	for (int i = 1; i < 8 * 8; ++i) {
+		dequant[i] = _quantizationTable[_zigZagOrder[i]] * scale;
+	}
+}
+
+static void putCoefficient(int16_t *block, int i, int value, const int *dequant) {
+	value *= dequant[i];
+	block[_zigZagOrder[i]] = (value < -kDequantMax) ? -kDequantMax : ((value > kDequantMax) ? kDequantMax : value);
+}
+
+// the coefficients are dequantized when stored to the block
+static void readAC(BitStream *bs, int16_t *block, const int *dequant) {
 	int count = 0;
 	int node = 0;
 	while (bs->bitsAvailable() > 0) {
@@ -61,8 +108,7 @@ static void readAC(BitStream *bs, int *coefficients) {
 				const int zeroes = bs->getBits(6);
 				count += zeroes + 1;
 				assert(count < 63);
-				coefficients += zeroes;
-				*coefficients++ = bs->getSignedBits(10);
+				putCoefficient(block, count, bs->getSignedBits(10), dequant);
 			}
 			break;
 		case kAcHuff_EndOfBlock:
@@ -78,9 +124,8 @@ static void readAC(BitStream *bs, int *coefficients) {
 				const int zeroes = value >> 8;
 				count += zeroes + 1;
 				assert(count < 63);
-				coefficients += zeroes;
 				const int nonZeroes = value & 255;
-				*coefficients++ = bs->getBit() ? -nonZeroes : nonZeroes;
+				putCoefficient(block, count, bs->getBit() ? -nonZeroes : nonZeroes, dequant);
 			}
 			break;
 		}
@@ -88,94 +133,387 @@ static void readAC(BitStream *bs, int *coefficients) {
 	}
 }
 
-static const uint8_t _zigZagTable[8 * 8] = {
-	 0,  1,  5,  6, 14, 15, 27, 28,
-	 2,  4,  7, 13, 16, 26, 29, 42,
-	 3,  8, 12, 17, 25, 30, 41, 43,
-	 9, 11, 18, 24, 31, 40, 44, 53,
-	10, 19, 23, 32, 39, 45, 52, 54,
-	20, 22, 33, 38, 46, 51, 55, 60,
-	21, 34, 37, 47, 50, 56, 59, 61,
-	35, 36, 48, 49, 57, 58, 62, 63
-};
+// fixed point constants, FIX(x) = x * (1 << kConstBits)
+static const int FIX_0_298631336 = 2446;
+static const int FIX_0_390180644 = 3196;
+static const int FIX_0_541196100 = 4433;
+static const int FIX_0_765366865 = 6270;
+static const int FIX_0_899976223 = 7373;
+static const int FIX_1_175875602 = 9633;
+static const int FIX_1_501321110 = 12299;
+static const int FIX_1_847759065 = 15137;
+static const int FIX_1_961570560 = 16069;
+static const int FIX_2_053119869 = 16819;
+static const int FIX_2_562915447 = 20995;
+static const int FIX_3_072711026 = 25172;
 
-static const uint8_t _quantizationTable[8 * 8] = {
-	 2, 16, 19, 22, 26, 27, 29, 34,
-	16, 16, 22, 24, 27, 29, 34, 37,
-	19, 22, 26, 27, 29, 34, 34, 38,
-	22, 22, 26, 27, 29, 34, 37, 40,
-	22, 26, 27, 29, 32, 35, 40, 48,
-	26, 27, 29, 32, 35, 40, 48, 58,
-	26, 27, 29, 34, 38, 46, 56, 69,
-	27, 29, 35, 38, 46, 56, 69, 83
-};
+static inline int descale(int x, int n) {
+	return (x + (1 << (n - 1))) >> n;
+}
 
-static void dequantizeBlock(int *coefficients, float *block, int scale) {
-	block[0] = coefficients[0] * _quantizationTable[0]; // DC
-	for (int i = 1; i < 8 * 8; i++) {
-		block[i] = coefficients[_zigZagTable[i]] * _quantizationTable[i] * scale / 8.f;
-	}
+static inline uint8_t clampPixel(int x) {
+	return (x < 0) ? 0 : ((x > 255) ? 255 : x);
 }
 
-static const int16_t _idct8x8[8][8] = {
-	{ 23170,  32138,  30273,  27245,  23170,  18204,  12539,   6392 },
-	{ 23170,  27245,  12539,  -6393, -23171, -32139, -30274, -18205 },
-	{ 23170,  18204, -12540, -32139, -23171,   6392,  30273,  27245 },
-	{ 23170,   6392, -30274, -18205,  23170,  27245, -12540, -32139 },
-	{ 23170,  -6393, -30274,  18204,  23170, -27246, -12540,  32138 },
-	{ 23170, -18205, -12540,  32138, -23171,  -6393,  30273, -27246 },
-	{ 23170, -27246,  12539,   6392, -23171,  32138, -30274,  18204 },
-	{ 23170, -32139,  30273, -27246,  23170, -18205,  12539,  -6393 }
+// Loeffler, Ligtenberg and Moschytz 1D IDCT with 12 multiplications, as in the IJG 'islow' implementation.
+// The 'in' coefficients are read with a stride of 'step', the even and odd parts are returned in 'tmp'
+struct Idct1D {
+	int tmp10, tmp11, tmp12, tmp13; // even part
+	int tmp0, tmp1, tmp2, tmp3; // odd part
+
+	void compute(const int16_t *in, int step) {
+		int z1, z2, z3, z4, z5;
+
+		z2 = in[2 * step];
+		z3 = in[6 * step];
+		z1 = (z2 + z3) * FIX_0_541196100;
+		tmp2 = z1 + z3 * (-FIX_1_847759065);
+		tmp3 = z1 + z2 * FIX_0_765366865;
+		z2 = in[0];
+		z3 = in[4 * step];
+		tmp0 = (z2 + z3) * (1 << kConstBits);
+		tmp1 = (z2 - z3) * (1 << kConstBits);
+		tmp10 = tmp0 + tmp3;
+		tmp13 = tmp0 - tmp3;
+		tmp11 = tmp1 + tmp2;
+		tmp12 = tmp1 - tmp2;
+
+		tmp0 = in[7 * step];
+		tmp1 = in[5 * step];
+		tmp2 = in[3 * step];
+		tmp3 = in[1 * step];
+		z1 = tmp0 + tmp3;
+		z2 = tmp1 + tmp2;
+		z3 = tmp0 + tmp2;
+		z4 = tmp1 + tmp3;
+		z5 = (z3 + z4) * FIX_1_175875602;
+		tmp0 *= FIX_0_298631336;
+		tmp1 *= FIX_2_053119869;
+		tmp2 *= FIX_3_072711026;
+		tmp3 *= FIX_1_501321110;
+		z1 *= -FIX_0_899976223;
+		z2 *= -FIX_2_562915447;
+		z3 *= -FIX_1_961570560;
+		z4 *= -FIX_0_390180644;
+		z3 += z5;
+		z4 += z5;
+		tmp0 += z1 + z3;
+		tmp1 += z2 + z4;
+		tmp2 += z2 + z3;
+		tmp3 += z1 + z4;
+	}
 };
 
-static void idct(float *dequantData, float *result) {
-	float tmp[8 * 8];
-	// 1D IDCT rows
-	for (int y = 0; y < 8; y++) {
-		for (int x = 0; x < 8; x++) {
-			float p = 0;
-			for (int i = 0; i < 8; ++i) {
-				p += dequantData[i] * _idct8x8[x][i] / 0x10000;
+// separable fixed point IDCT, the output matches the floating point transform within +/-1
+static void idct_C(const int16_t *block, uint8_t *dst, int dstPitch) {
+	int16_t ws[8 * 8];
+	// columns, the dequantization fractional bits are dropped
+	for (int x = 0; x < 8; ++x) {
+		const int16_t *in = block + x;
+		int16_t *out = ws + x;
+		if ((in[8] | in[16] | in[24] | in[32] | in[40] | in[48] | in[56]) == 0) {
+			const int dc = descale(in[0], kDequantBits - kPass1Bits);
+			for (int y = 0; y < 8; ++y) {
+				out[y * 8] = dc;
 			}
-			tmp[y + x * 8] = p;
+			continue;
 		}
-		dequantData += 8;
-	}
-	// 1D IDCT columns
-	for (int x = 0; x < 8; x++) {
-		const float *u = tmp + x * 8;
-		for (int y = 0; y < 8; y++) {
-			float p = 0;
-			for (int i = 0; i < 8; ++i) {
-				p += u[i] * _idct8x8[y][i] / 0x10000;
-			}
-			result[y * 8 + x] = p;
+		Idct1D t;
+		t.compute(in, 8);
+		out[0 * 8] = descale(t.tmp10 + t.tmp3, kPass1Shift);
+		out[7 * 8] = descale(t.tmp10 - t.tmp3, kPass1Shift);
+		out[1 * 8] = descale(t.tmp11 + t.tmp2, kPass1Shift);
+		out[6 * 8] = descale(t.tmp11 - t.tmp2, kPass1Shift);
+		out[2 * 8] = descale(t.tmp12 + t.tmp1, kPass1Shift);
+		out[5 * 8] = descale(t.tmp12 - t.tmp1, kPass1Shift);
+		out[3 * 8] = descale(t.tmp13 + t.tmp0, kPass1Shift);
+		out[4 * 8] = descale(t.tmp13 - t.tmp0, kPass1Shift);
+	}
+	// rows, the output is biased to the (0,255) range
+	static const int kBias = 128 << kPass2Shift;
+	for (int y = 0; y < 8; ++y) {
+		const int16_t *in = ws + y * 8;
+		if ((in[1] | in[2] | in[3] | in[4] | in[5] | in[6] | in[7]) == 0) {
+			const uint8_t color = clampPixel(descale(in[0], kPass1Bits + 3) + 128);
+			memset(dst, color, 8);
+			dst += dstPitch;
+			continue;
+		}
+		Idct1D t;
+		t.compute(in, 1);
+		t.tmp10 += kBias;
+		t.tmp11 += kBias;
+		t.tmp12 += kBias;
+		t.tmp13 += kBias;
+		dst[0] = clampPixel(descale(t.tmp10 + t.tmp3, kPass2Shift));
+		dst[7] = clampPixel(descale(t.tmp10 - t.tmp3, kPass2Shift));
+		dst[1] = clampPixel(descale(t.tmp11 + t.tmp2, kPass2Shift));
+		dst[6] = clampPixel(descale(t.tmp11 - t.tmp2, kPass2Shift));
+		dst[2] = clampPixel(descale(t.tmp12 + t.tmp1, kPass2Shift));
+		dst[5] = clampPixel(descale(t.tmp12 - t.tmp1, kPass2Shift));
+		dst[3] = clampPixel(descale(t.tmp13 + t.tmp0, kPass2Shift));
+		dst[4] = clampPixel(descale(t.tmp13 - t.tmp0, kPass2Shift));
+		dst += dstPitch;
+	}
+}
+
+// The vector implementations compute the same integer sums as Idct1D and are bit exact with idct_C.
+// The coefficients are clamped to kDequantMax, which keeps the intermediate values within 16 bits
+// and the products sums within 32 bits.
+
+// the odd part factors for the (1,3,5,7) coefficients, indexed by the Idct1D odd outputs tmp0 to tmp3
+static const int16_t _idctOddFactors[4][4] = {
+	{
+		FIX_1_175875602 - FIX_0_899976223,
+		FIX_1_175875602 - FIX_1_961570560,
+		FIX_1_175875602,
+		FIX_1_175875602 + FIX_0_298631336 - FIX_0_899976223 - FIX_1_961570560
+	}, {
+		FIX_1_175875602 - FIX_0_390180644,
+		FIX_1_175875602 - FIX_2_562915447,
+		FIX_1_175875602 + FIX_2_053119869 - FIX_2_562915447 - FIX_0_390180644,
+		FIX_1_175875602
+	}, {
+		FIX_1_175875602,
+		FIX_1_175875602 + FIX_3_072711026 - FIX_2_562915447 - FIX_1_961570560,
+		FIX_1_175875602 - FIX_2_562915447,
+		FIX_1_175875602 - FIX_1_961570560
+	}, {
+		FIX_1_175875602 + FIX_1_501321110 - FIX_0_899976223 - FIX_0_390180644,
+		FIX_1_175875602,
+		FIX_1_175875602 - FIX_0_390180644,
+		FIX_1_175875602 - FIX_0_899976223
+	}
+};
+
+static inline uint8_t dcPixel(int dc) {
+	return clampPixel(descale(descale(dc, kDequantBits - kPass1Bits), kPass1Bits + 3) + 128);
+}
+
+static inline void fillBlock(uint8_t *dst, int dstPitch, uint8_t color) {
+	for (int y = 0; y < 8; ++y) {
+		memset(dst, color, 8);
+		dst += dstPitch;
+	}
+}
+
+#ifdef SIMD_X86
+
+TARGET_SSE2 static inline __m128i pairFactors_SSE2(int a, int b) {
+	return _mm_set1_epi32((a & 0xFFFF) | (int)((uint32_t)b << 16));
+}
+
+// 1D transform of 4 columns, the coefficients are interleaved in pairs (0,4) (2,6) (1,3) (5,7) for _mm_madd_epi16
+TARGET_SSE2 static inline void idct4_SSE2(__m128i in04, __m128i in26, __m128i in13, __m128i in57, __m128i bias, __m128i *out) {
+	const __m128i tmp0 = _mm_add_epi32(_mm_madd_epi16(in04, pairFactors_SSE2(1 << kConstBits, 1 << kConstBits)), bias);
+	const __m128i tmp1 = _mm_add_epi32(_mm_madd_epi16(in04, pairFactors_SSE2(1 << kConstBits, -(1 << kConstBits))), bias);
+	const __m128i tmp2 = _mm_madd_epi16(in26, pairFactors_SSE2(FIX_0_541196100, FIX_0_541196100 - FIX_1_847759065));
+	const __m128i tmp3 = _mm_madd_epi16(in26, pairFactors_SSE2(FIX_0_541196100 + FIX_0_765366865, FIX_0_541196100));
+	const __m128i tmp10 = _mm_add_epi32(tmp0, tmp3);
+	const __m128i tmp13 = _mm_sub_epi32(tmp0, tmp3);
+	const __m128i tmp11 = _mm_add_epi32(tmp1, tmp2);
+	const __m128i tmp12 = _mm_sub_epi32(tmp1, tmp2);
+	__m128i odd[4];
+	for (int i = 0; i < 4; ++i) {
+		const int16_t *f = _idctOddFactors[i];
+		odd[i] = _mm_add_epi32(_mm_madd_epi16(in13, pairFactors_SSE2(f[0], f[1])), _mm_madd_epi16(in57, pairFactors_SSE2(f[2], f[3])));
+	}
+	out[0] = _mm_add_epi32(tmp10, odd[3]);
+	out[7] = _mm_sub_epi32(tmp10, odd[3]);
+	out[1] = _mm_add_epi32(tmp11, odd[2]);
+	out[6] = _mm_sub_epi32(tmp11, odd[2]);
+	out[2] = _mm_add_epi32(tmp12, odd[1]);
+	out[5] = _mm_sub_epi32(tmp12, odd[1]);
+	out[3] = _mm_add_epi32(tmp13, odd[0]);
+	out[4] = _mm_sub_epi32(tmp13, odd[0]);
+}
+
+// transforms the 8 columns of 'v', 'bias' includes the rounding of the shift
+template <int kShift>
+TARGET_SSE2 static inline void idctPass_SSE2(__m128i *v, __m128i bias) {
+	__m128i lo[8], hi[8];
+	idct4_SSE2(_mm_unpacklo_epi16(v[0], v[4]), _mm_unpacklo_epi16(v[2], v[6]), _mm_unpacklo_epi16(v[1], v[3]), _mm_unpacklo_epi16(v[5], v[7]), bias, lo);
+	idct4_SSE2(_mm_unpackhi_epi16(v[0], v[4]), _mm_unpackhi_epi16(v[2], v[6]), _mm_unpackhi_epi16(v[1], v[3]), _mm_unpackhi_epi16(v[5], v[7]), bias, hi);
+	for (int i = 0; i < 8; ++i) {
+		v[i] = _mm_packs_epi32(_mm_srai_epi32(lo[i], kShift), _mm_srai_epi32(hi[i], kShift));
+	}
+}
+
+TARGET_SSE2 static inline void transpose8x8_SSE2(__m128i *v) {
+	const __m128i a0 = _mm_unpacklo_epi16(v[0], v[1]);
+	const __m128i a1 = _mm_unpackhi_epi16(v[0], v[1]);
+	const __m128i a2 = _mm_unpacklo_epi16(v[2], v[3]);
+	const __m128i a3 = _mm_unpackhi_epi16(v[2], v[3]);
+	const __m128i a4 = _mm_unpacklo_epi16(v[4], v[5]);
+	const __m128i a5 = _mm_unpackhi_epi16(v[4], v[5]);
+	const __m128i a6 = _mm_unpacklo_epi16(v[6], v[7]);
+	const __m128i a7 = _mm_unpackhi_epi16(v[6], v[7]);
+	const __m128i b0 = _mm_unpacklo_epi32(a0, a2);
+	const __m128i b1 = _mm_unpackhi_epi32(a0, a2);
+	const __m128i b2 = _mm_unpacklo_epi32(a1, a3);
+	const __m128i b3 = _mm_unpackhi_epi32(a1, a3);
+	const __m128i b4 = _mm_unpacklo_epi32(a4, a6);
+	const __m128i b5 = _mm_unpackhi_epi32(a4, a6);
+	const __m128i b6 = _mm_unpacklo_epi32(a5, a7);
+	const __m128i b7 = _mm_unpackhi_epi32(a5, a7);
+	v[0] = _mm_unpacklo_epi64(b0, b4);
+	v[1] = _mm_unpackhi_epi64(b0, b4);
+	v[2] = _mm_unpacklo_epi64(b1, b5);
+	v[3] = _mm_unpackhi_epi64(b1, b5);
+	v[4] = _mm_unpacklo_epi64(b2, b6);
+	v[5] = _mm_unpackhi_epi64(b2, b6);
+	v[6] = _mm_unpacklo_epi64(b3, b7);
+	v[7] = _mm_unpackhi_epi64(b3, b7);
+}
+
+TARGET_SSE2 static void idct_SSE2(const int16_t *block, uint8_t *dst, int dstPitch) {
+	__m128i v[8];
+	__m128i ac = _mm_and_si128(_mm_loadu_si128((const __m128i *)block), _mm_setr_epi16(0, -1, -1, -1, -1, -1, -1, -1));
+	for (int i = 0; i < 8; ++i) {
+		v[i] = _mm_loadu_si128((const __m128i *)(block + i * 8));
+		if (i != 0) {
+			ac = _mm_or_si128(ac, v[i]);
 		}
 	}
+	if (_mm_movemask_epi8(_mm_cmpeq_epi16(ac, _mm_setzero_si128())) == 0xFFFF) {
+		fillBlock(dst, dstPitch, dcPixel(block[0]));
+		return;
+	}
+	// the columns then the rows of the transposed block
+	idctPass_SSE2<kPass1Shift>(v, _mm_set1_epi32(1 << (kPass1Shift - 1)));
+	transpose8x8_SSE2(v);
+	idctPass_SSE2<kPass2Shift>(v, _mm_set1_epi32((1 << (kPass2Shift - 1)) + (128 << kPass2Shift)));
+	transpose8x8_SSE2(v);
+	for (int y = 0; y < 8; y += 2) {
+		const __m128i pixels = _mm_packus_epi16(v[y], v[y + 1]);
+		_mm_storel_epi64((__m128i *)dst, pixels);
+		_mm_storel_epi64((__m128i *)(dst + dstPitch), _mm_unpackhi_epi64(pixels, pixels));
+		dst += dstPitch * 2;
+	}
 }
 
-static void decodeBlock(BitStream *bs, int x8, int y8, uint8_t *dst, int dstPitch, int scale, int version) {
-	int coefficients[8 * 8];
-	memset(coefficients, 0, sizeof(coefficients));
-	coefficients[0] = readDC(bs, version);
-	readAC(bs, &coefficients[1]);
+#endif
 
-	float dequantData[8 * 8];
-	dequantizeBlock(coefficients, dequantData, scale);
+#ifdef SIMD_NEON
+
+// 1D transform of 4 columns
+static inline void idct4_NEON(const int16x4_t *in, int32x4_t bias, int32x4_t *out) {
+	const int32x4_t z0 = vshll_n_s16(in[0], kConstBits);
+	const int32x4_t z4 = vshll_n_s16(in[4], kConstBits);
+	const int32x4_t tmp0 = vaddq_s32(vaddq_s32(z0, z4), bias);
+	const int32x4_t tmp1 = vaddq_s32(vsubq_s32(z0, z4), bias);
+	const int32x4_t tmp2 = vmlal_n_s16(vmull_n_s16(in[2], FIX_0_541196100), in[6], FIX_0_541196100 - FIX_1_847759065);
+	const int32x4_t tmp3 = vmlal_n_s16(vmull_n_s16(in[2], FIX_0_541196100 + FIX_0_765366865), in[6], FIX_0_541196100);
+	const int32x4_t tmp10 = vaddq_s32(tmp0, tmp3);
+	const int32x4_t tmp13 = vsubq_s32(tmp0, tmp3);
+	const int32x4_t tmp11 = vaddq_s32(tmp1, tmp2);
+	const int32x4_t tmp12 = vsubq_s32(tmp1, tmp2);
+	int32x4_t odd[4];
+	for (int i = 0; i < 4; ++i) {
+		const int16_t *f = _idctOddFactors[i];
+		odd[i] = vmlal_n_s16(vmlal_n_s16(vmlal_n_s16(vmull_n_s16(in[1], f[0]), in[3], f[1]), in[5], f[2]), in[7], f[3]);
+	}
+	out[0] = vaddq_s32(tmp10, odd[3]);
+	out[7] = vsubq_s32(tmp10, odd[3]);
+	out[1] = vaddq_s32(tmp11, odd[2]);
+	out[6] = vsubq_s32(tmp11, odd[2]);
+	out[2] = vaddq_s32(tmp12, odd[1]);
+	out[5] = vsubq_s32(tmp12, odd[1]);
+	out[3] = vaddq_s32(tmp13, odd[0]);
+	out[4] = vsubq_s32(tmp13, odd[0]);
+}
 
-	float idctData[8 * 8];
-	idct(dequantData, idctData);
+// transforms the 8 columns of 'v', 'bias' includes the rounding of the shift
+template <int kShift>
+static inline void idctPass_NEON(int16x8_t *v, int32x4_t bias) {
+	int16x4_t inLo[8], inHi[8];
+	for (int i = 0; i < 8; ++i) {
+		inLo[i] = vget_low_s16(v[i]);
+		inHi[i] = vget_high_s16(v[i]);
+	}
+	int32x4_t lo[8], hi[8];
+	idct4_NEON(inLo, bias, lo);
+	idct4_NEON(inHi, bias, hi);
+	for (int i = 0; i < 8; ++i) {
+		v[i] = vcombine_s16(vqmovn_s32(vshrq_n_s32(lo[i], kShift)), vqmovn_s32(vshrq_n_s32(hi[i], kShift)));
+	}
+}
+
+static inline void transpose8x8_NEON(int16x8_t *v) {
+	const int16x8x2_t a0 = vtrnq_s16(v[0], v[1]);
+	const int16x8x2_t a1 = vtrnq_s16(v[2], v[3]);
+	const int16x8x2_t a2 = vtrnq_s16(v[4], v[5]);
+	const int16x8x2_t a3 = vtrnq_s16(v[6], v[7]);
+	const int32x4x2_t b0 = vtrnq_s32(vreinterpretq_s32_s16(a0.val[0]), vreinterpretq_s32_s16(a1.val[0])); // columns 0,4 and 2,6 of rows 0-3
+	const int32x4x2_t b1 = vtrnq_s32(vreinterpretq_s32_s16(a0.val[1]), vreinterpretq_s32_s16(a1.val[1])); // columns 1,5 and 3,7
+	const int32x4x2_t b2 = vtrnq_s32(vreinterpretq_s32_s16(a2.val[0]), vreinterpretq_s32_s16(a3.val[0])); // rows 4-7
+	const int32x4x2_t b3 = vtrnq_s32(vreinterpretq_s32_s16(a2.val[1]), vreinterpretq_s32_s16(a3.val[1]));
+	v[0] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b0.val[0]), vget_low_s32(b2.val[0])));
+	v[4] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b0.val[0]), vget_high_s32(b2.val[0])));
+	v[2] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b0.val[1]), vget_low_s32(b2.val[1])));
+	v[6] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b0.val[1]), vget_high_s32(b2.val[1])));
+	v[1] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b1.val[0]), vget_low_s32(b3.val[0])));
+	v[5] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b1.val[0]), vget_high_s32(b3.val[0])));
+	v[3] = vreinterpretq_s16_s32(vcombine_s32(vget_low_s32(b1.val[1]), vget_low_s32(b3.val[1])));
+	v[7] = vreinterpretq_s16_s32(vcombine_s32(vget_high_s32(b1.val[1]), vget_high_s32(b3.val[1])));
+}
 
-	dst += (y8 * dstPitch + x8) * 8;
-	for (int y = 0; y < 8; y++) {
-		for (int x = 0; x < 8; x++) {
-			const int val = (int)round(idctData[y * 8 + x]); // (-128,127) range
-			dst[x] = (val <= -128) ? 0 : ((val >= 127) ? 255 : (128 + val));
+static void idct_NEON(const int16_t *block, uint8_t *dst, int dstPitch) {
+	static const int16_t kAcMask[8] = { 0, -1, -1, -1, -1, -1, -1, -1 };
+	int16x8_t v[8];
+	int16x8_t ac = vandq_s16(vld1q_s16(block), vld1q_s16(kAcMask));
+	for (int i = 0; i < 8; ++i) {
+		v[i] = vld1q_s16(block + i * 8);
+		if (i != 0) {
+			ac = vorrq_s16(ac, v[i]);
 		}
+	}
+	if (vmaxvq_u16(vreinterpretq_u16_s16(ac)) == 0) {
+		fillBlock(dst, dstPitch, dcPixel(block[0]));
+		return;
+	}
+	// the columns then the rows of the transposed block
+	idctPass_NEON<kPass1Shift>(v, vdupq_n_s32(1 << (kPass1Shift - 1)));
+	transpose8x8_NEON(v);
+	idctPass_NEON<kPass2Shift>(v, vdupq_n_s32((1 << (kPass2Shift - 1)) + (128 << kPass2Shift)));
+	transpose8x8_NEON(v);
+	for (int y = 0; y < 8; ++y) {
+		vst1_u8(dst, vqmovun_s16(v[y]));
 		dst += dstPitch;
 	}
 }
 
+#endif
+
+MdecIdctProc getMdecIdctProc(uint32_t cpuFeatures, const char **name) {
+	const char *procName = "c";
+	MdecIdctProc proc = idct_C;
+#ifdef SIMD_X86
+	if (cpuFeatures & kCpuFeatureSse2) {
+		procName = "sse2";
+		proc = idct_SSE2;
+	}
+#endif
+#ifdef SIMD_NEON
+	if (cpuFeatures & kCpuFeatureNeon) {
+		procName = "neon";
+		proc = idct_NEON;
+	}
+#endif
+	if (name) {
+		*name = procName;
+	}
+	return proc;
+}
+
+static void decodeBlock(BitStream *bs, int x8, int y8, uint8_t *dst, int dstPitch, const int *dequant, MdecIdctProc idct, int version) {
+	int16_t block[8 * 8];
+	memset(block, 0, sizeof(block));
+	putCoefficient(block, 0, readDC(bs, version), dequant);
+	readAC(bs, block, dequant);
+	(*idct)(block, dst + (y8 * dstPitch + x8) * 8, dstPitch);
+}
+
 int decodeMDEC(const uint8_t *src, int len, const uint8_t *mbOrder, int mbLength, int w, int h, MdecOutput *out) {
 	BitStream bs(src, len);
 	bs.getBits(16);
@@ -186,6 +524,10 @@ int decodeMDEC(const uint8_t *src, int len, const uint8_t *mbOrder, int mbLength
 	// fprintf(stdout, "mdec qscale %d version %d w %d h %d\n", qscale, version, w, h);
 	assert(version == 2);
 
+	int dequant[8 * 8];
+	initDequantTable(dequant, qscale);
+	const MdecIdctProc idct = out->idctProc ? out->idctProc : idct_C;
+
 	const int blockW = (w + 15) / 16;
 	const int blockH = (h + 15) / 16;
 
@@ -206,12 +548,12 @@ int decodeMDEC(const uint8_t *src, int len, const uint8_t *mbOrder, int mbLength
 				}
 				++z;
 			}
-			decodeBlock(&bs, x, y, crPtr, crPitch, qscale, version);
-			decodeBlock(&bs, x, y, cbPtr, cbPitch, qscale, version);
-			decodeBlock(&bs, x2,     y2,     yPtr, yPitch, qscale, version);
-			decodeBlock(&bs, x2 + 1, y2,     yPtr, yPitch, qscale, version);
-			decodeBlock(&bs, x2,     y2 + 1, yPtr, yPitch, qscale, version);
-			decodeBlock(&bs, x2 + 1, y2 + 1, yPtr, yPitch, qscale, version);
+			decodeBlock(&bs, x, y, crPtr, crPitch, dequant, idct, version);
+			decodeBlock(&bs, x, y, cbPtr, cbPitch, dequant, idct, version);
+			decodeBlock(&bs, x2,     y2,     yPtr, yPitch, dequant, idct, version);
+			decodeBlock(&bs, x2 + 1, y2,     yPtr, yPitch, dequant, idct, version);
+			decodeBlock(&bs, x2,     y2 + 1, yPtr, yPitch, dequant, idct, version);
+			decodeBlock(&bs, x2 + 1, y2 + 1, yPtr, yPitch, dequant, idct, version);
 			if (mbOrder && z == mbLength) {
 				goto end;
 			}
@@ -10,6 +10,9 @@ enum {
 	kOutputPlaneCr = 2
 };
 
+// transforms the dequantized coefficients of a block to 8x8 pixels
+typedef void (*MdecIdctProc)(const int16_t *block, uint8_t *dst, int dstPitch);
+
 struct MdecOutput {
 	int x, y;
 	int w, h;
@@ -17,8 +20,11 @@ struct MdecOutput {
 		uint8_t *ptr;
 		int pitch;
 	} planes[3];
+	MdecIdctProc idctProc; // 0 for the C implementation
 };
 
+MdecIdctProc getMdecIdctProc(uint32_t cpuFeatures, const char **name);
+
 int decodeMDEC(const uint8_t *src, int len, const uint8_t *mbOrder, int mbLength, int w, int h, MdecOutput *out);
 
 #endif // MDEC_H__
@@ -344,7 +344,7 @@ void Menu::drawBitmap(const uint8_t *data, uint32_t size, bool setPalette) {
 		memset(_video->_frontLayer, 0, Video::W * Video::H);
 		_video->decodeBackgroundPsx(data, size, Video::W, Video::H);
 	} else {
-		decodeLZW(data, _video->_frontLayer);
+		decodeLZW(&_res->_lzw, data, _video->_frontLayer, Video::W * Video::H);
 		if (setPalette) {
 			g_system->setPalette(data + size, 256, 6);
 		}
@@ -425,6 +425,7 @@ static void menuPafCallback(void *userdata, int frame, const uint8_t *buffer) {
 bool Menu::mainLoop() {
 	bool ret = false;
 	loadData();
+	_pacer.start(kDelayMs, kPacerDrop);
 	while (!g_system->inp.quit) {
 		const int option = handleTitleScreen();
 		if (option == kTitleScreen_AssignPlayer) {
@@ -448,6 +449,7 @@ bool Menu::mainLoop() {
 		break;
 	}
 	_res->unloadDatMenuBuffers();
+	_pacer.dumpStats(kDebug_MENU, "Menu");
 	return ret;
 }
 
@@ -484,7 +486,7 @@ int Menu::handleTitleScreen() {
 			break;
 		}
 		drawTitleScreen(currentOption);
-		g_system->sleep(kDelayMs);
+		_pacer.wait();
 	}
 	return currentOption;
 }
@@ -715,7 +717,7 @@ void Menu::handleAssignPlayer() {
 			}
 		}
 		drawPlayerProgress(state, cursor);
-		g_system->sleep(kDelayMs);
+		_pacer.wait();
 	}
 }
 
@@ -865,7 +867,7 @@ void Menu::handleSettingsScreen(int num) {
 	}
 	drawSettingsScreen();
 	_condMask = 8;
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 void Menu::drawControlsScreen() {
@@ -915,7 +917,7 @@ void Menu::handleControlsScreen(int num) {
 	}
 	drawControlsScreen();
 	_condMask = 0x20;
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 void Menu::drawJoystickKeyCode(int num) {
@@ -1097,7 +1099,7 @@ void Menu::handleJoystickControlsScreen(int num) {
 	if (_joystickControlsNum == 8) {
 		_condMask = 8;
 	}
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 void Menu::drawKeyboardKeyCode(int num) {
@@ -1260,7 +1262,7 @@ void Menu::handleKeyboardControlsScreen(int num) {
 	if (_keyboardControlsNum == 8) {
 		_condMask = 8;
 	}
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 void Menu::drawDifficultyScreen() {
@@ -1293,7 +1295,7 @@ void Menu::handleDifficultyScreen(int num) {
 		}
 	}
 	drawDifficultyScreen();
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 void Menu::drawSoundScreen() {
@@ -1375,7 +1377,7 @@ void Menu::handleSoundScreen(int num) {
 						_g->setSoundPanning(so, panning);
 						drawSoundScreen();
 					}
-					g_system->sleep(kDelayMs);
+					_pacer.wait();
 				}
 			}
 			_soundTestSpriteNum = 24;
@@ -1445,7 +1447,7 @@ void Menu::handleSoundScreen(int num) {
 		_soundCounter = 0;
 	}
 	drawSoundScreen();
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 void Menu::changeToOption(int num) {
@@ -1557,7 +1559,7 @@ void Menu::handleLoadLevel(int num) {
 		}
 	}
 	drawLevelScreen();
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 void Menu::handleLoadCheckpoint(int num) {
@@ -1609,7 +1611,7 @@ void Menu::handleLoadCheckpoint(int num) {
 		}
 	}
 	drawCheckpointScreen();
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 void Menu::handleLoadCutscene(int num) {
@@ -1663,7 +1665,7 @@ void Menu::handleLoadCutscene(int num) {
 		}
 	}
 	drawCutsceneScreen();
-	g_system->sleep(kDelayMs);
+	_pacer.wait();
 }
 
 static bool matchInput(uint8_t type, uint8_t mask, const PlayerInput &inp, uint8_t optionMask) {
@@ -1744,7 +1746,7 @@ bool Menu::handleOptions() {
 		}
 		_condMask = 0;
 		if (num == -1) {
-			g_system->sleep(kDelayMs);
+			_pacer.wait();
 			continue;
 		}
 		const uint8_t *data = &_optionData[num * 8];
@@ -3,6 +3,7 @@
 #define MENU_H__
 
 #include "intern.h"
+#include "pacer.h"
 
 struct Game;
 struct PafPlayer;
@@ -97,6 +98,7 @@ struct Menu {
 	int _volumeState;
 	int _soundCounter;
 	int _soundTestSpriteNum;
+	FramePacer _pacer;
 
 	Menu(Game *g, PafPlayer *paf, Resource *res, Video *video);
 
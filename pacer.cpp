@@ -0,0 +1,63 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "pacer.h"
+#include "system.h"
+#include "util.h"
+
+FramePacer::FramePacer() {
+	start(0, kPacerDrop);
+}
+
+void FramePacer::startNs(uint64_t frameNs, int policy) {
+	_policy = policy;
+	_frameNs = frameNs;
+	_wakeUpNs = frameNs ? g_system->getTimeStampNs() : 0;
+	_deadlineNs = _wakeUpNs + _frameNs;
+	_framesCount = 0;
+	_lateFramesCount = 0;
+	_droppedFramesCount = 0;
+	_totalFrameNs = 0;
+	_minFrameNs = _maxFrameNs = 0;
+	_maxOversleepNs = 0;
+}
+
+void FramePacer::wait() {
+	uint64_t now = g_system->getTimeStampNs();
+	if (now < _deadlineNs) {
+		g_system->sleepUntilNs(_deadlineNs);
+		now = g_system->getTimeStampNs();
+		_maxOversleepNs = MAX(_maxOversleepNs, now - _deadlineNs);
+	} else {
+		++_lateFramesCount;
+	}
+	const uint64_t frameNs = now - _wakeUpNs;
+	if (_framesCount == 0 || frameNs < _minFrameNs) {
+		_minFrameNs = frameNs;
+	}
+	_maxFrameNs = MAX(_maxFrameNs, frameNs);
+	_totalFrameNs += frameNs;
+	++_framesCount;
+	_wakeUpNs = now;
+
+	_deadlineNs += _frameNs;
+	if (now >= _deadlineNs && _frameNs != 0) {
+		const uint64_t missed = (now - _deadlineNs) / _frameNs + 1;
+		if (_policy == kPacerDrop || missed > kMaxCatchUpFrames) {
+			// the next deadline is the first one after the current time
+			_droppedFramesCount += missed;
+			_deadlineNs += missed * _frameNs;
+		}
+	}
+}
+
+void FramePacer::dumpStats(int debugMask, const char *name) const {
+	if (_framesCount == 0) {
+		return;
+	}
+	debug(debugMask, "%s: %d frames, %d late, %d dropped, frame time %.2f/%.2f/%.2f ms (min/avg/max), oversleep %.3f ms (max)",
+		name, _framesCount, _lateFramesCount, _droppedFramesCount,
+		_minFrameNs / 1e6, _totalFrameNs / 1e6 / _framesCount, _maxFrameNs / 1e6, _maxOversleepNs / 1e6);
+}
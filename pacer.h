@@ -0,0 +1,44 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef PACER_H__
+#define PACER_H__
+
+#include "intern.h"
+
+enum {
+	kPacerCatchUp, // the frames following a late frame are not delayed until the schedule is met again
+	kPacerDrop     // the deadlines missed by a late frame are skipped
+};
+
+// waits for absolute deadlines on the system monotonic clock, the frame rate does not drift with the frames durations
+struct FramePacer {
+	enum {
+		kMaxCatchUpFrames = 4 // further behind, the missed deadlines are skipped with both policies
+	};
+
+	int _policy;
+	uint64_t _frameNs;
+	uint64_t _deadlineNs;
+	uint64_t _wakeUpNs;
+
+	int _framesCount;
+	int _lateFramesCount; // deadline already passed when waiting
+	int _droppedFramesCount; // deadlines skipped
+	uint64_t _totalFrameNs;
+	uint64_t _minFrameNs, _maxFrameNs; // between two wake ups
+	uint64_t _maxOversleepNs;
+
+	FramePacer();
+
+	void start(int frameMs, int policy) {
+		startNs((uint64_t)frameMs * 1000000, policy);
+	}
+	void startNs(uint64_t frameNs, int policy);
+	void wait();
+	void dumpStats(int debugMask, const char *name) const;
+};
+
+#endif // PACER_H__
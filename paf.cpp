@@ -6,6 +6,7 @@
 #include "fs.h"
 #include "paf.h"
 #include "system.h"
+#include "trace.h"
 #include "util.h"
 
 static const char *_filenames[] = {
@@ -47,6 +48,7 @@ PafPlayer::PafPlayer(FileSystem *fs)
 	memset(&_pafCb, 0, sizeof(_pafCb));
 	_volume = 128;
 	_frameMs = kFrameDuration;
+	_turboMode = false;
 }
 
 PafPlayer::~PafPlayer() {
@@ -440,6 +442,8 @@ void PafPlayer::decodeAudioFrame(const uint8_t *src, uint32_t offset, uint32_t s
 }
 
 void PafPlayer::mix(int16_t *buf, int samples) {
+	traceThreadName("audio");
+	TraceScope ts("PafPlayer::mix");
 	while (_audioQueue && samples > 0) {
 		assert(_audioQueue->size != 0);
 		const int count = MIN(samples, _audioQueue->size - _audioQueue->offset);
@@ -459,6 +463,7 @@ void PafPlayer::mix(int16_t *buf, int samples) {
 		_audioQueueTail = 0;
 	}
 	if (samples > 0) {
+		traceInstant("paf_underrun");
 		debug(kDebug_PAF, "audioQueue underrun %d", samples);
 	}
 }
@@ -487,19 +492,25 @@ void PafPlayer::mainLoop() {
 
 	// keep original frame rate for audio
 	const uint32_t frameMs = (_demuxAudioFrameBlocks != 0) ? _pafHdr.frameDuration : (_pafHdr.frameDuration * _frameMs / kFrameDuration);
-	uint32_t frameTime = g_system->getTimeStamp() + frameMs;
+	// the video is late when the audio frames are not decoded in time, catch up to keep them in sync
+	_pacer.start(frameMs, kPacerCatchUp);
+	const uint64_t startTimeNs = getTimeNs();
+	int framesCount = 0;
 
 	uint32_t blocksCountForFrame = _pafHdr.preloadFrameBlocksCount;
 	for (int i = 0; i < (int)_pafHdr.framesCount; ++i) {
 		// read buffering blocks
 		blocksCountForFrame += _pafHdr.frameBlocksCountTable[i];
+		traceBegin("paf_demux");
 		while (blocksCountForFrame != 0) {
 			_file.read(_bufferBlock, _pafHdr.readBufferSize);
 			const uint32_t dstOffset = _pafHdr.frameBlocksOffsetTable[currentFrameBlock] & ~(1 << 31);
 			if (_pafHdr.frameBlocksOffsetTable[currentFrameBlock] & (1 << 31)) {
 				assert(dstOffset + _pafHdr.readBufferSize <= _pafHdr.maxAudioFrameBlocksCount * _pafHdr.readBufferSize);
 				memcpy(_demuxAudioFrameBlocks + dstOffset, _bufferBlock, _pafHdr.readBufferSize);
+				traceBegin("paf_decode_audio");
 				decodeAudioFrame(_demuxAudioFrameBlocks, dstOffset, _pafHdr.readBufferSize);
+				traceEnd("paf_decode_audio");
 			} else {
 				assert(dstOffset + _pafHdr.readBufferSize <= _pafHdr.maxVideoFrameBlocksCount * _pafHdr.readBufferSize);
 				memcpy(_demuxVideoFrameBlocks + dstOffset, _bufferBlock, _pafHdr.readBufferSize);
@@ -507,8 +518,11 @@ void PafPlayer::mainLoop() {
 			++currentFrameBlock;
 			--blocksCountForFrame;
 		}
+		traceEnd("paf_demux");
 		// decode video data
+		traceBegin("paf_decode_video");
 		decodeVideoFrame(_demuxVideoFrameBlocks + _pafHdr.framesOffsetTable[i]);
+		traceEnd("paf_decode_video");
 
 		if (_pafCb.frameProc) {
 			_pafCb.frameProc(_pafCb.userdata, i, _pageBuffers[_currentPageBuffer]);
@@ -521,19 +535,27 @@ void PafPlayer::mainLoop() {
 		}
 		g_system->updateScreen(false);
 		g_system->processEvents();
+		++framesCount;
 		if (g_system->inp.keyPressed(SYS_INP_ESC) || g_system->inp.skip) {
 			break;
 		}
 
-		const int delay = MAX<int>(10, frameTime - g_system->getTimeStamp());
-		g_system->sleep(delay);
-		frameTime = g_system->getTimeStamp() + frameMs;
+		if (!_turboMode) {
+			_pacer.wait();
+		}
 
 		// set next decoding video page
 		++_currentPageBuffer;
 		_currentPageBuffer &= 3;
 	}
 
+	if (_turboMode) {
+		const uint64_t durationNs = getTimeNs() - startTimeNs;
+		fprintf(stdout, "PAF %d: %d frames in %.3f seconds, %.1f fps\n", _videoNum, framesCount, durationNs / 1e9, durationNs ? framesCount * 1e9 / durationNs : 0.);
+	} else {
+		_pacer.dumpStats(kDebug_PAF, "PAF");
+	}
+
 	if (_pafCb.endProc) {
 		_pafCb.endProc(_pafCb.userdata);
 	}
@@ -9,6 +9,7 @@
 #include "intern.h"
 #include "defs.h"
 #include "fileio.h"
+#include "pacer.h"
 
 struct PafHeader {
 	uint32_t preloadFrameBlocksCount;
@@ -100,6 +101,8 @@ struct PafPlayer {
 	PafCallback _pafCb;
 	int _volume;
 	int _frameMs;
+	bool _turboMode;
+	FramePacer _pacer;
 
 	PafPlayer(FileSystem *fs);
 	~PafPlayer();
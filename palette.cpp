@@ -0,0 +1,109 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "palette.h"
+#include "simd.h"
+#include "util.h"
+
+static void expandPalette_C(uint32_t *dst, const uint8_t *src, int count, const uint32_t *palette) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		dst[i]     = palette[src[i]];
+		dst[i + 1] = palette[src[i + 1]];
+		dst[i + 2] = palette[src[i + 2]];
+		dst[i + 3] = palette[src[i + 3]];
+	}
+	for (; i < count; ++i) {
+		dst[i] = palette[src[i]];
+	}
+}
+
+#ifdef SIMD_X86
+
+TARGET_AVX2 static void expandPalette_AVX2(uint32_t *dst, const uint8_t *src, int count, const uint32_t *palette) {
+	const int *table = (const int *)palette;
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const __m256i idx0 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+		const __m256i idx1 = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i + 8)));
+		_mm256_storeu_si256((__m256i *)(dst + i),     _mm256_i32gather_epi32(table, idx0, 4));
+		_mm256_storeu_si256((__m256i *)(dst + i + 8), _mm256_i32gather_epi32(table, idx1, 4));
+	}
+	expandPalette_C(dst + i, src + i, count - i, palette);
+}
+
+#endif
+
+#ifdef SIMD_NEON
+
+// the palette is split in 4 planes of 256 bytes, each plane is looked up with 4 chained 64 bytes tables
+
+static const int kNeonMinCount = 64; // below, the planes setup costs more than the scalar loop
+
+static inline uint8x16_t lookupPlane_NEON(const uint8x16x4_t *tables, uint8x16_t idx) {
+	const uint8x16_t k64 = vdupq_n_u8(64);
+	uint8x16_t b = vqtbl4q_u8(tables[0], idx);
+	idx = vsubq_u8(idx, k64);
+	b = vqtbx4q_u8(b, tables[1], idx);
+	idx = vsubq_u8(idx, k64);
+	b = vqtbx4q_u8(b, tables[2], idx);
+	idx = vsubq_u8(idx, k64);
+	return vqtbx4q_u8(b, tables[3], idx);
+}
+
+static void expandPalette_NEON(uint32_t *dst, const uint8_t *src, int count, const uint32_t *palette) {
+	if (count < kNeonMinCount) {
+		expandPalette_C(dst, src, count, palette);
+		return;
+	}
+	uint8_t planes[4][256];
+	for (int i = 0; i < 256; i += 16) {
+		const uint8x16x4_t p = vld4q_u8((const uint8_t *)(palette + i));
+		vst1q_u8(&planes[0][i], p.val[0]);
+		vst1q_u8(&planes[1][i], p.val[1]);
+		vst1q_u8(&planes[2][i], p.val[2]);
+		vst1q_u8(&planes[3][i], p.val[3]);
+	}
+	uint8x16x4_t tables[4][4];
+	for (int k = 0; k < 4; ++k) {
+		for (int j = 0; j < 4; ++j) {
+			tables[k][j] = vld1q_u8_x4(&planes[k][j * 64]);
+		}
+	}
+	int i = 0;
+	for (; i + 16 <= count; i += 16) {
+		const uint8x16_t idx = vld1q_u8(src + i);
+		uint8x16x4_t p;
+		p.val[0] = lookupPlane_NEON(tables[0], idx);
+		p.val[1] = lookupPlane_NEON(tables[1], idx);
+		p.val[2] = lookupPlane_NEON(tables[2], idx);
+		p.val[3] = lookupPlane_NEON(tables[3], idx);
+		vst4q_u8((uint8_t *)(dst + i), p);
+	}
+	expandPalette_C(dst + i, src + i, count - i, palette);
+}
+
+#endif
+
+ExpandPaletteProc getExpandPaletteProc(uint32_t cpuFeatures, const char **name) {
+	const char *procName = "c";
+	ExpandPaletteProc proc = expandPalette_C;
+#ifdef SIMD_X86
+	if (cpuFeatures & kCpuFeatureAvx2) {
+		procName = "avx2";
+		proc = expandPalette_AVX2;
+	}
+#endif
+#ifdef SIMD_NEON
+	if (cpuFeatures & kCpuFeatureNeon) {
+		procName = "neon";
+		proc = expandPalette_NEON;
+	}
+#endif
+	if (name) {
+		*name = procName;
+	}
+	return proc;
+}
@@ -0,0 +1,16 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef PALETTE_H__
+#define PALETTE_H__
+
+#include "intern.h"
+
+// converts 'count' 8-bit palette indexes to 32-bit pixels
+typedef void (*ExpandPaletteProc)(uint32_t *dst, const uint8_t *src, int count, const uint32_t *palette);
+
+ExpandPaletteProc getExpandPaletteProc(uint32_t cpuFeatures, const char **name);
+
+#endif // PALETTE_H__
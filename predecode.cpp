@@ -0,0 +1,92 @@
+
+#include "game.h"
+#include "lzw.h"
+#include "system.h"
+#include "util.h"
+#include "video.h"
+
+// the backgrounds and the shadow masks of the neighbouring screens are decoded on a worker thread after a screen
+// change, the results are added to the background cache when the next screen setup waits for the worker.
+// The worker thread is created with the first screen change and waits for the next ones.
+
+static const int kPredecodeScreenSize = Video::W * Video::H + Video::SHADOW_SCREEN_MASK_BUFFER_SIZE;
+
+static void predecodeWorkerProc(void *userdata) {
+	((Game *)userdata)->predecodeScreens();
+}
+
+void Game::startPredecode(int screenNum) {
+	if (!_predecodeScreens || _backgroundCache._budget == 0) {
+		return;
+	}
+	finishPredecode();
+	if (!_predecodeBuffer) {
+		_predecodeBuffer = (uint8_t *)malloc(kMaxPredecodedScreens * kPredecodeScreenSize);
+		_predecodeLzw = (LzwDecoder *)malloc(sizeof(LzwDecoder));
+		if (!_predecodeBuffer || !_predecodeLzw) {
+			warning("Unable to allocate %d bytes for the predecoded screens", kMaxPredecodedScreens * kPredecodeScreenSize);
+			_predecodeScreens = false;
+			return;
+		}
+	}
+	if (!_predecodeWorker) {
+		_predecodeWorker = g_system->createWorker("predecode", predecodeWorkerProc, this);
+		if (!_predecodeWorker) {
+			// no threads, the screens are decoded when entered
+			_predecodeScreens = false;
+			return;
+		}
+	}
+	_predecodedScreensCount = 0;
+	for (int i = kPosTopScreen; i <= kPosLeftScreen; ++i) {
+		const int num = _res->_screensGrid[screenNum][i];
+		if (num == kNoScreen || !_res->isLvlBackgroundDataLoaded(num)) {
+			continue;
+		}
+		// the level callbacks can still change the background of the screen before it is entered
+		const LvlBackgroundData *lvl = &_res->_resLvlScreenBackgroundDataTable[num];
+		const uint32_t key = BackgroundCache::makeKey(_currentLevel, num, lvl->currentBackgroundId, lvl->currentShadowId);
+		if (!_backgroundCache.contains(key)) {
+			_predecodedScreens[_predecodedScreensCount].key = key;
+			_predecodeScreensData[_predecodedScreensCount] = *lvl;
+			++_predecodedScreensCount;
+		}
+	}
+	if (_predecodedScreensCount != 0) {
+		g_system->startWorker(_predecodeWorker);
+	}
+}
+
+// the worker is running when there are screens to predecode
+void Game::finishPredecode() {
+	if (_predecodedScreensCount != 0) {
+		g_system->waitWorker(_predecodeWorker);
+		for (int i = 0; i < _predecodedScreensCount; ++i) {
+			_backgroundCache.add(&_predecodedScreens[i]);
+		}
+		_predecodedScreensCount = 0;
+	}
+}
+
+// worker thread, only reads the copied screen data and the level data (not unloaded while the worker runs)
+void Game::predecodeScreens() {
+	for (int i = 0; i < _predecodedScreensCount; ++i) {
+		const LvlBackgroundData *lvl = &_predecodeScreensData[i];
+		BackgroundCacheEntry *entry = &_predecodedScreens[i];
+		uint8_t *p = _predecodeBuffer + i * kPredecodeScreenSize;
+		entry->background = 0;
+		entry->masksData = p + Video::W * Video::H;
+		entry->masksDataSize = 0;
+		entry->masksBits = 0;
+		if (!_res->_isPsx) {
+			const uint8_t *bmp = lvl->backgroundBitmapTable[lvl->currentBackgroundId] + 2;
+			if (decodeLZW(_predecodeLzw, bmp, p, Video::W * Video::H) < 0) {
+				continue; // not cached
+			}
+			entry->background = p;
+		}
+		if (lvl->shadowCount != 0) {
+			entry->masksDataSize = decodeShadowScreenMaskData(_predecodeLzw, lvl, entry->masksData, Video::SHADOW_SCREEN_MASK_BUFFER_SIZE, entry->masks, &entry->masksBits);
+		}
+	}
+}
@@ -0,0 +1,99 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "profiler.h"
+#include "video.h"
+
+const char *Profiler::_stageNames[kProfileStagesCount] = {
+	"andy",
+	"mst",
+	"lvl_objects",
+	"level_tick",
+	"animated_objects",
+	"draw_screen",
+	"game_display",
+	"screen",
+	"levelMainLoop"
+};
+
+// the font has no punctuation, overlay times are in microseconds (average and worst)
+static const char *_overlayNames[kProfileStagesCount] = {
+	"ANDY", "MST", "OBJS", "TICK", "ANIM", "DRAW", "GDSP", "SCRN", "FRAME"
+};
+
+Profiler::Profiler()
+	: _enabled(false), _overlay(false), _csvFp(0), _historyCount(0), _framesCount(0) {
+	memset(_startNs, 0, sizeof(_startNs));
+	memset(_frameNs, 0, sizeof(_frameNs));
+	memset(_historyNs, 0, sizeof(_historyNs));
+}
+
+Profiler::~Profiler() {
+	if (_csvFp) {
+		fclose(_csvFp);
+		_csvFp = 0;
+	}
+}
+
+bool Profiler::openCsv(const char *path) {
+	_csvFp = fopen(path, "w");
+	if (!_csvFp) {
+		warning("Unable to open '%s' for writing", path);
+		return false;
+	}
+	fprintf(_csvFp, "frame");
+	for (int i = 0; i < kProfileStagesCount; ++i) {
+		fprintf(_csvFp, ",%s_ns", _stageNames[i]);
+	}
+	fprintf(_csvFp, "\n");
+	return true;
+}
+
+void Profiler::beginFrame() {
+	if (_enabled) {
+		memset(_frameNs, 0, sizeof(_frameNs));
+	}
+	begin(kProfileFrame);
+}
+
+void Profiler::endFrame() {
+	end(kProfileFrame);
+	if (_enabled) {
+		memcpy(_historyNs[_framesCount % kHistorySize], _frameNs, sizeof(_frameNs));
+		if (_historyCount < kHistorySize) {
+			++_historyCount;
+		}
+		if (_csvFp) {
+			fprintf(_csvFp, "%d", _framesCount);
+			for (int i = 0; i < kProfileStagesCount; ++i) {
+				fprintf(_csvFp, ",%u", _frameNs[i]);
+			}
+			fprintf(_csvFp, "\n");
+		}
+		++_framesCount;
+	}
+}
+
+void Profiler::drawOverlay(Video *video, int y) {
+	if (!_enabled || !_overlay || _historyCount == 0) {
+		return;
+	}
+	const uint8_t color = video->findWhiteColor();
+	for (int i = 0; i < kProfileStagesCount; ++i) {
+		uint64_t totalNs = 0;
+		uint32_t worstNs = 0;
+		for (int j = 0; j < _historyCount; ++j) {
+			const uint32_t ns = _historyNs[j][i];
+			totalNs += ns;
+			if (ns > worstNs) {
+				worstNs = ns;
+			}
+		}
+		char buffer[32];
+		snprintf(buffer, sizeof(buffer), "%-5s %5d %5d", _overlayNames[i], (int)(totalNs / _historyCount / 1000), (int)(worstNs / 1000));
+		video->drawString(buffer, 8, y, color, video->_frontLayer);
+		y += 16;
+	}
+}
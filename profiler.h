@@ -0,0 +1,68 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef PROFILER_H__
+#define PROFILER_H__
+
+#include <stdio.h>
+#include "intern.h"
+#include "trace.h"
+#include "util.h"
+
+struct Video;
+
+enum {
+	kProfileAndy,
+	kProfileMst,
+	kProfileLvlObjects,
+	kProfileLevelTick,
+	kProfileAnimatedObjects,
+	kProfileDrawScreen,
+	kProfileGameDisplay,
+	kProfileScreen,
+	kProfileFrame, // levelMainLoop
+	kProfileStagesCount
+};
+
+struct Profiler {
+	enum {
+		kHistorySize = 64 // frames, for the averages and worst cases
+	};
+
+	static const char *_stageNames[kProfileStagesCount];
+
+	bool _enabled;
+	bool _overlay;
+	FILE *_csvFp;
+	uint64_t _startNs[kProfileStagesCount];
+	uint32_t _frameNs[kProfileStagesCount];
+	uint32_t _historyNs[kHistorySize][kProfileStagesCount];
+	int _historyCount;
+	int _framesCount;
+
+	Profiler();
+	~Profiler();
+
+	bool openCsv(const char *path);
+
+	void begin(int stage) {
+		if (_enabled) {
+			_startNs[stage] = getTimeNs();
+		}
+		traceBegin(_stageNames[stage]);
+	}
+	void end(int stage) {
+		if (_enabled) {
+			_frameNs[stage] += (uint32_t)(getTimeNs() - _startNs[stage]);
+		}
+		traceEnd(_stageNames[stage]);
+	}
+
+	void beginFrame();
+	void endFrame();
+	void drawOverlay(Video *video, int y);
+};
+
+#endif // PROFILER_H__
@@ -0,0 +1,169 @@
+
+#include "game.h"
+#include "level.h"
+#include "paf.h"
+#include "util.h"
+#include "video.h"
+
+// the trace is a text file with one line per frame : 'frame front_layer palette state', hashes are FNV-1a 32 bits
+
+static const uint32_t kFnvOffset = 0x811C9DC5;
+static const uint32_t kFnvPrime = 0x01000193;
+
+static uint32_t hashBytes(uint32_t hash, const uint8_t *p, int size) {
+	for (int i = 0; i < size; ++i) {
+		hash ^= p[i];
+		hash *= kFnvPrime;
+	}
+	return hash;
+}
+
+static uint32_t hashUint32(uint32_t hash, uint32_t value) {
+	for (int i = 0; i < 4; ++i) {
+		hash ^= value & 255;
+		hash *= kFnvPrime;
+		value >>= 8;
+	}
+	return hash;
+}
+
+static uint32_t hashLvlObject(uint32_t hash, const LvlObject *o) {
+	hash = hashUint32(hash, o->xPos);
+	hash = hashUint32(hash, o->yPos);
+	hash = hashUint32(hash, (o->screenNum << 24) | (o->screenState << 16) | (o->frame << 8) | o->spriteNum);
+	hash = hashUint32(hash, (o->anim << 16) | o->flags0);
+	hash = hashUint32(hash, (o->flags1 << 16) | o->flags2);
+	hash = hashUint32(hash, (o->actionKeyMask << 8) | o->directionKeyMask);
+	return hash;
+}
+
+bool Game::replayDemo(const char *demPath, const char *tracePath, const char *goldenPath) {
+	_res->_demPath = demPath;
+	if (!_res->loadHodDem()) {
+		warning("Unable to load demo '%s'", demPath);
+		return false;
+	}
+	_res->unloadHodDem();
+	if (tracePath) {
+		_replayTraceFp = fopen(tracePath, "w");
+		if (!_replayTraceFp) {
+			warning("Unable to open '%s' for writing", tracePath);
+			return false;
+		}
+	}
+	if (goldenPath) {
+		_replayGoldenFp = fopen(goldenPath, "r");
+		if (!_replayGoldenFp) {
+			warning("Unable to open '%s'", goldenPath);
+			if (_replayTraceFp) {
+				fclose(_replayTraceFp);
+				_replayTraceFp = 0;
+			}
+			return false;
+		}
+	}
+	_playDemo = true;
+	_resumeGame = false;
+	_paf->_skipCutscenes = true;
+	_replayMismatchFrame = -1;
+	mainLoop(0, 0, false);
+	const int framesCount = _res->_demOffset;
+	bool ret = true;
+	if (_replayGoldenFp) {
+		char line[64];
+		if (_replayMismatchFrame < 0 && fgets(line, sizeof(line), _replayGoldenFp)) {
+			warning("Replay stopped at frame %d, golden trace is longer", framesCount);
+			_replayMismatchFrame = framesCount;
+		}
+		fclose(_replayGoldenFp);
+		_replayGoldenFp = 0;
+		if (_replayMismatchFrame >= 0) {
+			ret = false;
+		} else {
+			fprintf(stdout, "Replay matches golden trace, %d frames\n", framesCount);
+		}
+	}
+	if (_replayTraceFp) {
+		fclose(_replayTraceFp);
+		_replayTraceFp = 0;
+	}
+	_res->unloadHodDem();
+	_playDemo = false;
+	return ret;
+}
+
+void Game::updateReplayTrace(int frame) {
+	const uint32_t frontHash = hashBytes(kFnvOffset, _video->_frontLayer, Video::W * Video::H);
+	const uint32_t paletteHash = hashBytes(kFnvOffset, _video->_palette, sizeof(_video->_palette));
+	uint32_t stateHash = kFnvOffset;
+	stateHash = hashUint32(stateHash, _rnd._rndSeed);
+	stateHash = hashUint32(stateHash, (_currentLevel << 24) | (_level->_checkpoint << 16) | (_res->_currentScreenResourceNum << 8) | _currentScreen);
+	stateHash = hashUint32(stateHash, (_currentLeftScreen << 24) | (_currentRightScreen << 16) | (uint8_t)_levelRestartCounter);
+	stateHash = hashUint32(stateHash, _res->_demOffset);
+	stateHash = hashLvlObject(stateHash, _andyObject);
+	for (int i = 0; i < _res->_lvlHdr.screensCount; ++i) {
+		for (const LvlObject *o = _screenLvlObjectsList[i]; o; o = o->nextPtr) {
+			stateHash = hashLvlObject(stateHash, o);
+		}
+	}
+	if (_replayTraceFp) {
+		fprintf(_replayTraceFp, "%d %08x %08x %08x\n", frame, frontHash, paletteHash, stateHash);
+	}
+	if (_replayGoldenFp && _replayMismatchFrame < 0) {
+		char line[64];
+		int goldenFrame;
+		uint32_t goldenFrontHash, goldenPaletteHash, goldenStateHash;
+		if (!fgets(line, sizeof(line), _replayGoldenFp) || sscanf(line, "%d %x %x %x", &goldenFrame, &goldenFrontHash, &goldenPaletteHash, &goldenStateHash) != 4) {
+			warning("Replay frame %d, golden trace is shorter", frame);
+			_replayMismatchFrame = frame;
+		} else if (goldenFrame != frame || goldenFrontHash != frontHash || goldenPaletteHash != paletteHash || goldenStateHash != stateHash) {
+			warning("Replay mismatch at frame %d :%s%s%s", frame,
+				(goldenFrontHash != frontHash) ? " front layer" : "",
+				(goldenPaletteHash != paletteHash) ? " palette" : "",
+				(goldenStateHash != stateHash || goldenFrame != frame) ? " game state" : "");
+			_replayMismatchFrame = frame;
+		}
+	}
+}
+
+void Game::startDemoRecording(uint32_t randSeed, int randRounds) {
+	_recordDem.randSeed = randSeed;
+	_recordDem.keyMaskLen = 0;
+	_recordDem.level = _currentLevel;
+	_recordDem.checkpoint = _currentLevelCheckpoint;
+	_recordDem.difficulty = _difficulty;
+	_recordDem.randRounds = randRounds;
+	_recordDemSize = 1024;
+	_recordDem.actionKeyMask = (uint8_t *)malloc(_recordDemSize);
+	_recordDem.directionKeyMask = (uint8_t *)malloc(_recordDemSize);
+	if (!_recordDem.actionKeyMask || !_recordDem.directionKeyMask) {
+		error("Unable to allocate demo recording buffers");
+	}
+}
+
+void Game::recordDemoFrame() {
+	if (_recordDem.keyMaskLen == _recordDemSize) {
+		_recordDemSize *= 2;
+		_recordDem.actionKeyMask = (uint8_t *)realloc(_recordDem.actionKeyMask, _recordDemSize);
+		_recordDem.directionKeyMask = (uint8_t *)realloc(_recordDem.directionKeyMask, _recordDemSize);
+		if (!_recordDem.actionKeyMask || !_recordDem.directionKeyMask) {
+			error("Unable to allocate demo recording buffers");
+		}
+	}
+	_recordDem.actionKeyMask[_recordDem.keyMaskLen] = _andyObject->actionKeyMask;
+	_recordDem.directionKeyMask[_recordDem.keyMaskLen] = _andyObject->directionKeyMask;
+	++_recordDem.keyMaskLen;
+}
+
+void Game::stopDemoRecording() {
+	if (_recordDem.actionKeyMask) {
+		if (_res->writeHodDem(_recordDemPath, &_recordDem)) {
+			fprintf(stdout, "Recorded %d frames of level %d to '%s'\n", _recordDem.keyMaskLen, _recordDem.level, _recordDemPath);
+		}
+		free(_recordDem.actionKeyMask);
+		free(_recordDem.directionKeyMask);
+		memset(&_recordDem, 0, sizeof(_recordDem));
+		_recordDemSize = 0;
+	}
+	_recordDemPath = 0;
+}
@@ -8,13 +8,18 @@
 #include "game.h"
 #include "lzw.h"
 #include "resource.h"
+#include "trace.h"
 #include "util.h"
+#include "video.h"
 
 // load and uncompress .sss pcm on level start
 static const bool kPreloadSssPcm = true;
 
 static const bool kPreloadLvlBackgroundData = true;
 
+// convert the sprites RLE data to spans on level load, trading memory for faster drawing
+static const bool kCompileLvlSprites = true;
+
 static const bool kCheckSssBytecode = false;
 
 // menu settings and player progress
@@ -88,6 +93,9 @@ Resource::Resource(FileSystem *fs)
 	memset(_resLevelData0x2988Table, 0, sizeof(_resLevelData0x2988Table));
 	memset(_resLevelData0x2988PtrTable, 0, sizeof(_resLevelData0x2988PtrTable));
 	memset(_resLvlSpriteDataPtrTable, 0, sizeof(_resLvlSpriteDataPtrTable));
+	memset(_lvlCompiledSpritesDataTable, 0, sizeof(_lvlCompiledSpritesDataTable));
+	_compiledSpritesHash = 0;
+	_compiledSpritesHashMask = 0;
 
 	// backgrounds
 	memset(_resLvlScreenBackgroundDataTable, 0, sizeof(_resLvlScreenBackgroundDataTable));
@@ -148,6 +156,7 @@ Resource::Resource(FileSystem *fs)
 
 	memset(&_dem, 0, sizeof(_dem));
 	_demOffset = 0;
+	_demPath = 0;
 }
 
 Resource::~Resource() {
@@ -230,7 +239,7 @@ void Resource::loadSetupDat() {
 		if (_fontBuffer) {
 			/* size = READ_LE_UINT32(_loadingImageBuffer + offset); */ offset += 4;
 			if (_datHdr.version == 11) {
-				const uint32_t uncompressedSize = decodeLZW(_loadingImageBuffer + offset, _fontBuffer);
+				const uint32_t uncompressedSize = decodeLZW(&_lzw, _loadingImageBuffer + offset, _fontBuffer, kFontSize);
 				assert(uncompressedSize == kFontSize);
 			} else {
 				memcpy(_fontBuffer, _loadingImageBuffer + offset, kFontSize);
@@ -269,7 +278,7 @@ bool Resource::loadDatLoadingImage(uint8_t *dst, uint8_t *pal) {
 	assert(!_isPsx);
 	if (_loadingImageBuffer) {
 		const uint32_t bufferSize = READ_LE_UINT32(_loadingImageBuffer);
-		const int size = decodeLZW(_loadingImageBuffer + 8, dst);
+		const int size = decodeLZW(&_lzw, _loadingImageBuffer + 8, dst, 256 * 192);
 		assert(size == 256 * 192);
 		// palette follows compressed bitmap
 		memcpy(pal, _loadingImageBuffer + 8 + bufferSize, 256 * 3);
@@ -306,6 +315,7 @@ void Resource::unloadDatMenuBuffers() {
 }
 
 void Resource::loadLevelData(int levelNum) {
+	TraceScope ts("loadLevelData");
 
 	char filename[32];
 	const char *levelName = _prefixes[levelNum];
@@ -517,6 +527,101 @@ void Resource::loadLvlSpriteData(int num, const uint8_t *buf) {
 	_resLevelData0x2988PtrTable[dat->spriteNum] = dat;
 	_resLvlSpriteDataPtrTable[num] = ptr;
 	_resLevelData0x2988SizeTable[num] = size;
+
+	if (kCompileLvlSprites) {
+		compileLvlSpriteData(num);
+	}
+}
+
+void Resource::compileLvlSpriteData(int num) {
+	LvlObjectData *dat = &_resLevelData0x2988Table[num];
+	uint32_t spansCount = 0;
+	for (int i = 0; i < dat->framesCount; ++i) {
+		uint16_t w, h;
+		const uint8_t *p = getLvlSpriteFramePtr(dat, i, &w, &h);
+		if (p) {
+			uint32_t count;
+			Video::compileSPR(p, 0, &count);
+			spansCount += count;
+		}
+	}
+	const uint32_t spansOffset = dat->framesCount * sizeof(CompiledSprite);
+	const uint32_t size = spansOffset + spansCount * sizeof(SpriteSpan);
+	uint8_t *ptr = (uint8_t *)malloc(size);
+	if (!ptr) {
+		warning("Unable to allocate %d bytes for sprite %d spans", size, num);
+		return;
+	}
+	CompiledSprite *cs = (CompiledSprite *)ptr;
+	SpriteSpan *spans = (SpriteSpan *)(ptr + spansOffset);
+	for (int i = 0; i < dat->framesCount; ++i) {
+		uint16_t w, h;
+		const uint8_t *p = getLvlSpriteFramePtr(dat, i, &w, &h);
+		uint32_t count = 0;
+		if (p) {
+			Video::compileSPR(p, spans, &count);
+		}
+		cs[i].bitmapBits = p;
+		cs[i].spansCount = count;
+		cs[i].spans = spans;
+		spans += count;
+	}
+	_lvlCompiledSpritesDataTable[num] = ptr;
+}
+
+void Resource::buildCompiledSpritesHash() {
+	free(_compiledSpritesHash);
+	_compiledSpritesHash = 0;
+	_compiledSpritesHashMask = 0;
+	uint32_t framesCount = 0;
+	for (unsigned int i = 0; i < kMaxSpriteTypes; ++i) {
+		if (_lvlCompiledSpritesDataTable[i]) {
+			framesCount += _resLevelData0x2988Table[i].framesCount;
+		}
+	}
+	if (framesCount == 0) {
+		return;
+	}
+	uint32_t size = 1;
+	while (size < framesCount * 2) {
+		size <<= 1;
+	}
+	_compiledSpritesHash = (const CompiledSprite **)calloc(size, sizeof(const CompiledSprite *));
+	if (!_compiledSpritesHash) {
+		return;
+	}
+	_compiledSpritesHashMask = size - 1;
+	for (unsigned int i = 0; i < kMaxSpriteTypes; ++i) {
+		const CompiledSprite *cs = (const CompiledSprite *)_lvlCompiledSpritesDataTable[i];
+		if (!cs) {
+			continue;
+		}
+		for (int j = 0; j < _resLevelData0x2988Table[i].framesCount; ++j) {
+			if (cs[j].bitmapBits) {
+				uint32_t index = ((uintptr_t)cs[j].bitmapBits * 0x9E3779B1) >> 8;
+				while (_compiledSpritesHash[index & _compiledSpritesHashMask]) {
+					++index;
+				}
+				_compiledSpritesHash[index & _compiledSpritesHashMask] = &cs[j];
+			}
+		}
+	}
+}
+
+const CompiledSprite *Resource::findCompiledSprite(const uint8_t *bitmapBits) const {
+	if (_compiledSpritesHash) {
+		uint32_t index = ((uintptr_t)bitmapBits * 0x9E3779B1) >> 8;
+		while (1) {
+			const CompiledSprite *cs = _compiledSpritesHash[index & _compiledSpritesHashMask];
+			if (!cs) {
+				break;
+			} else if (cs->bitmapBits == bitmapBits) {
+				return cs;
+			}
+			++index;
+		}
+	}
+	return 0;
 }
 
 const uint8_t *Resource::getLvlScreenMaskDataPtr(int num) const {
@@ -606,6 +711,7 @@ void Resource::loadLvlData(File *fp) {
 	for (int i = 0; i < _lvlHdr.spritesCount; ++i) {
 		loadLvlSpriteData(i, spr + i * 16);
 	}
+	buildCompiledSpritesHash();
 
 	memset(_resLevelData0x2B88SizeTable, 0, sizeof(_resLevelData0x2B88SizeTable));
 
@@ -634,7 +740,12 @@ void Resource::unloadLvlData() {
 		}
 		free(_resLvlSpriteDataPtrTable[i]);
 		_resLvlSpriteDataPtrTable[i] = 0;
+		free(_lvlCompiledSpritesDataTable[i]);
+		_lvlCompiledSpritesDataTable[i] = 0;
 	}
+	free(_compiledSpritesHash);
+	_compiledSpritesHash = 0;
+	_compiledSpritesHashMask = 0;
 }
 
 static uint32_t resFixPointersLevelData0x2B88(const uint8_t *src, uint8_t *ptr, uint8_t *offsetsPtr, LvlBackgroundData *dat, bool isPsx) {
@@ -694,6 +805,7 @@ static uint32_t resFixPointersLevelData0x2B88(const uint8_t *src, uint8_t *ptr,
 
 void Resource::loadLvlScreenBackgroundData(int num, const uint8_t *buf) {
 	assert((unsigned int)num < kMaxScreens);
+	TraceScope ts("loadLvlScreenBackgroundData");
 
 	static const uint32_t baseOffset = _lvlBackgroundsOffset;
 
@@ -1198,6 +1310,7 @@ static void decodeSssSpuAdpcmUnit(const uint8_t *src, int16_t *dst) { // src: 16
 
 void Resource::loadSssPcm(File *fp, SssPcm *pcm) {
 	assert(!pcm->ptr);
+	TraceScope ts("loadSssPcm");
 	const uint32_t decompressedSize = pcm->pcmSize;
 	debug(kDebug_SOUND, "Loading PCM %p decompressedSize %d", pcm, decompressedSize);
 	int16_t *p = (int16_t *)malloc(decompressedSize);
@@ -2029,7 +2142,12 @@ static const uint32_t _demTag = 0x31434552; // 'REC1'
 bool Resource::loadHodDem() {
 	bool ret = false;
 	File f;
-	if (openDat(_fs, _hodDem, &f)) {
+	if (_demPath) {
+		f.setFp(fopen(_demPath, "rb"));
+	} else {
+		openDat(_fs, _hodDem, &f);
+	}
+	if (f._fp) {
 		const uint32_t tag = f.readUint32();
 		if (tag == _demTag) {
 			f.skipUint32();
@@ -2058,6 +2176,30 @@ void Resource::unloadHodDem() {
 	memset(&_dem, 0, sizeof(_dem));
 }
 
+bool Resource::writeHodDem(const char *path, const Dem *dem) {
+	FILE *fp = fopen(path, "wb");
+	if (fp) {
+		const uint32_t unk = 0;
+		persistUint32(fp, _demTag);
+		persistUint32(fp, unk);
+		persistUint32(fp, dem->randSeed);
+		persistUint32(fp, dem->keyMaskLen);
+		persistUint8(fp, dem->level);
+		persistUint8(fp, dem->checkpoint);
+		persistUint8(fp, dem->difficulty);
+		persistUint8(fp, dem->randRounds);
+		persistUint32(fp, unk);
+		persistUint32(fp, unk);
+		fwrite(dem->actionKeyMask, 1, dem->keyMaskLen, fp);
+		fwrite(dem->directionKeyMask, 1, dem->keyMaskLen, fp);
+		if (fclose(fp) == 0) {
+			return true;
+		}
+	}
+	warning("Failed to save '%s'", path);
+	return false;
+}
+
 bool Resource::writeSetupCfg(const SetupConfig *config) {
 	FILE *fp = _fs->openSaveFile(_setupCfg, true);
 	if (fp) {
@@ -8,6 +8,7 @@
 
 #include "defs.h"
 #include "intern.h"
+#include "lzw.h"
 
 struct DatHdr {
 	uint32_t version; // 0x0
@@ -570,8 +571,11 @@ struct Resource {
 	uint8_t *_menuBuffer1;
 	uint32_t _menuBuffersOffset;
 
+	LzwDecoder _lzw; // used by the main thread
+
 	Dem _dem;
 	uint32_t _demOffset;
+	const char *_demPath; // replay this file instead of HOD.DEM
 
 	uint8_t _currentScreenResourceNum;
 
@@ -589,6 +593,9 @@ struct Resource {
 	LvlObjectData _resLevelData0x2988Table[kMaxSpriteTypes];
 	LvlObjectData *_resLevelData0x2988PtrTable[kMaxSpriteTypes];
 	uint8_t *_resLvlSpriteDataPtrTable[kMaxSpriteTypes];
+	uint8_t *_lvlCompiledSpritesDataTable[kMaxSpriteTypes]; // CompiledSprite for each frame, then the spans
+	const CompiledSprite **_compiledSpritesHash; // indexed by bitmapBits
+	uint32_t _compiledSpritesHashMask;
 	uint32_t _resLevelData0x2B88SizeTable[kMaxScreens]; // backgrounds
 	LvlBackgroundData _resLvlScreenBackgroundDataTable[kMaxScreens];
 	uint8_t *_resLvlScreenBackgroundDataPtrTable[kMaxScreens];
@@ -662,6 +669,9 @@ struct Resource {
 	void loadLvlData(File *fp);
 	void unloadLvlData();
 	void loadLvlSpriteData(int num, const uint8_t *buf = 0);
+	void compileLvlSpriteData(int num);
+	void buildCompiledSpritesHash();
+	const CompiledSprite *findCompiledSprite(const uint8_t *bitmapBits) const;
 	const uint8_t *getLvlScreenMaskDataPtr(int num) const;
 	const uint8_t *getLvlScreenPosDataPtr(int num) const;
 	void loadLvlScreenMaskData();
@@ -690,6 +700,7 @@ struct Resource {
 
 	bool loadHodDem();
 	void unloadHodDem();
+	bool writeHodDem(const char *path, const Dem *dem);
 
 	bool writeSetupCfg(const SetupConfig *config);
 	bool readSetupCfg(SetupConfig *config);
@@ -0,0 +1,43 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "scaler.h"
+
+// the screen texture is not scaled, the backend filters it when drawing
+
+const Scaler scaler_linear = {
+	"linear",
+	2, 4,
+	0,
+	{ 0, 0, 0 },
+	{ 0, 0, 0 }
+};
+
+const Scaler scaler_nearest = {
+	"nearest",
+	2, 4,
+	0,
+	{ 0, 0, 0 },
+	{ 0, 0, 0 }
+};
+
+static const Scaler *_scalers[] = {
+	&scaler_linear,
+	&scaler_nearest,
+	&scaler_integer,
+	&scaler_scalex,
+	&scaler_hqx,
+	&scaler_xbr,
+	0
+};
+
+const Scaler *findScaler(const char *name) {
+	for (int i = 0; _scalers[i]; ++i) {
+		if (strcmp(name, _scalers[i]->name) == 0) {
+			return _scalers[i];
+		}
+	}
+	return 0;
+}
@@ -10,14 +10,26 @@
 
 typedef void (*PaletteProc)(const uint32_t *palette);
 typedef void (*ScaleProc)(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *palette);
+// scales the rows [y1, y2) of a w x h image, 'dst' and 'src' point to the first row of the image
+typedef void (*ScaleRowsProc)(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette);
 
 struct Scaler {
 	const char *name;
 	int factorMin, factorMax;
 	PaletteProc palette; // palette changes
 	ScaleProc scale[3]; // 2x-4x factors
+	ScaleRowsProc scaleRows[3]; // bands of rows, can be run in parallel
 };
 
+extern const Scaler scaler_linear; // scaled by the backend
+extern const Scaler scaler_nearest;
+extern const Scaler scaler_integer;
+extern const Scaler scaler_scalex;
+extern const Scaler scaler_hqx;
 extern const Scaler scaler_xbr;
 
+const Scaler *findScaler(const char *name);
+
+ScaleRowsProc getScaleRowsProc_xbr(int factor, uint32_t cpuFeatures, const char **name);
+
 #endif // SCALER_H__
@@ -0,0 +1,120 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+// https://en.wikipedia.org/wiki/Hqx
+
+#include "scaler.h"
+
+// Simplified hqNx : the neighbours are compared with the hqx YUV thresholds, but instead of the 256
+// patterns tables each corner of the block only checks its two adjacent neighbours.
+//
+//   A B C
+//   D E F
+//   G H I
+//
+// A corner is blended if E differs from both adjacent neighbours : 2:1:1 if they are similar (an edge
+// crosses the corner), 6:1:1 otherwise. At 4x, the two pixels next to an edge corner are also blended.
+
+static uint8_t _diffYuv[256][256];
+
+static inline uint32_t mix(uint32_t a, uint32_t b, uint32_t c, int wa, int wb, int wc, int shift) {
+	static const uint32_t kMask = 0xFF00FF;
+	const uint32_t rb = ((( a       & kMask) * wa + ( b       & kMask) * wb + ( c       & kMask) * wc) >> shift) & kMask;
+	const uint32_t ag = ((((a >> 8) & kMask) * wa + ((b >> 8) & kMask) * wb + ((c >> 8) & kMask) * wc) >> shift) & kMask;
+	return rb | (ag << 8);
+}
+
+struct Corner {
+	uint32_t outer, inner;
+};
+
+static inline void computeCorner(Corner *c, uint8_t E, uint8_t P, uint8_t Q, const uint32_t *palette) {
+	if (_diffYuv[E][P] && _diffYuv[E][Q]) {
+		if (!_diffYuv[P][Q]) {
+			c->outer = mix(palette[E], palette[P], palette[Q], 2, 1, 1, 2);
+			c->inner = mix(palette[E], palette[P], palette[Q], 6, 1, 1, 3);
+		} else {
+			c->outer = mix(palette[E], palette[P], palette[Q], 6, 1, 1, 3);
+			c->inner = palette[E];
+		}
+	} else {
+		c->outer = c->inner = palette[E];
+	}
+}
+
+template <int N>
+static void scaleRows_hqx(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette) {
+	for (int y = y1; y < y2; ++y) {
+		const uint8_t *s1 = src + y * srcPitch;
+		const uint8_t *s0 = (y > 0) ? s1 - srcPitch : s1;
+		const uint8_t *s2 = (y < h - 1) ? s1 + srcPitch : s1;
+		uint32_t *d = dst + y * N * dstPitch;
+		for (int x = 0; x < w; ++x) {
+			const int xp = (x > 0) ? x - 1 : x;
+			const int xn = (x < w - 1) ? x + 1 : x;
+			const uint8_t B = s0[x];
+			const uint8_t D = s1[xp];
+			const uint8_t E = s1[x];
+			const uint8_t F = s1[xn];
+			const uint8_t H = s2[x];
+			const uint32_t color = palette[E];
+			uint32_t *p = d + x * N;
+			for (int j = 0; j < N; ++j) {
+				for (int i = 0; i < N; ++i) {
+					p[j * dstPitch + i] = color;
+				}
+			}
+			Corner c[4];
+			computeCorner(&c[0], E, D, B, palette);
+			computeCorner(&c[1], E, F, B, palette);
+			computeCorner(&c[2], E, D, H, palette);
+			computeCorner(&c[3], E, F, H, palette);
+			const int nl = (N - 1) * dstPitch;
+			p[0]          = c[0].outer;
+			p[N - 1]      = c[1].outer;
+			p[nl]         = c[2].outer;
+			p[nl + N - 1] = c[3].outer;
+			if (N == 4) {
+				p[1] = p[dstPitch] = c[0].inner;
+				p[2] = p[dstPitch + 3] = c[1].inner;
+				p[nl + 1] = p[nl - dstPitch] = c[2].inner;
+				p[nl + 2] = p[nl - dstPitch + 3] = c[3].inner;
+			}
+		}
+	}
+}
+
+template <int N>
+static void scale_hqx(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *palette) {
+	scaleRows_hqx<N>(dst, dstPitch, src, srcPitch, w, h, 0, h, palette);
+}
+
+static void palette_hqx(const uint32_t *palette) {
+	int yuv[256][3];
+	for (int i = 0; i < 256; ++i) {
+		const int r = (palette[i] >> 16) & 255;
+		const int g = (palette[i] >>  8) & 255;
+		const int b =  palette[i]        & 255;
+		yuv[i][0] = ( 299 * r + 587 * g + 114 * b) / 1000;
+		yuv[i][1] = (-169 * r - 331 * g + 500 * b) / 1000 + 128;
+		yuv[i][2] = ( 500 * r - 419 * g -  81 * b) / 1000 + 128;
+	}
+	for (int j = 0; j < 256; ++j) {
+		for (int i = 0; i < 256; ++i) {
+			const int dy = yuv[i][0] - yuv[j][0];
+			const int du = yuv[i][1] - yuv[j][1];
+			const int dv = yuv[i][2] - yuv[j][2];
+			_diffYuv[j][i] = (ABS(dy) > 48 || ABS(du) > 7 || ABS(dv) > 6);
+		}
+	}
+}
+
+const Scaler scaler_hqx = {
+	"hq",
+	2, 4,
+	palette_hqx,
+	{ scale_hqx<2>, scale_hqx<3>, scale_hqx<4> },
+	{ scaleRows_hqx<2>, scaleRows_hqx<3>, scaleRows_hqx<4> }
+};
@@ -0,0 +1,38 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "scaler.h"
+
+// nearest neighbour, each source pixel is replicated to a NxN block
+
+template <int N>
+static void scaleRows_integer(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette) {
+	for (int y = y1; y < y2; ++y) {
+		const uint8_t *s = src + y * srcPitch;
+		uint32_t *d = dst + y * N * dstPitch;
+		for (int x = 0; x < w; ++x) {
+			const uint32_t color = palette[s[x]];
+			for (int i = 0; i < N; ++i) {
+				d[x * N + i] = color;
+			}
+		}
+		for (int j = 1; j < N; ++j) {
+			memcpy(d + j * dstPitch, d, w * N * sizeof(uint32_t));
+		}
+	}
+}
+
+template <int N>
+static void scale_integer(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *palette) {
+	scaleRows_integer<N>(dst, dstPitch, src, srcPitch, w, h, 0, h, palette);
+}
+
+const Scaler scaler_integer = {
+	"integer",
+	2, 4,
+	0,
+	{ scale_integer<2>, scale_integer<3>, scale_integer<4> },
+	{ scaleRows_integer<2>, scaleRows_integer<3>, scaleRows_integer<4> }
+};
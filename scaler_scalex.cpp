@@ -0,0 +1,77 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+// https://www.scale2x.it/algorithm
+
+#include "scaler.h"
+
+//   A B C
+//   D E F
+//   G H I
+//
+// the palette indexes are compared, the pixels outside the image are clamped
+
+template <int N>
+static void scaleRows_scalex(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette) {
+	for (int y = y1; y < y2; ++y) {
+		const uint8_t *s1 = src + y * srcPitch;
+		const uint8_t *s0 = (y > 0) ? s1 - srcPitch : s1;
+		const uint8_t *s2 = (y < h - 1) ? s1 + srcPitch : s1;
+		uint32_t *d = dst + y * N * dstPitch;
+		for (int x = 0; x < w; ++x) {
+			const int xp = (x > 0) ? x - 1 : x;
+			const int xn = (x < w - 1) ? x + 1 : x;
+			const uint8_t B = s0[x];
+			const uint8_t D = s1[xp];
+			const uint8_t E = s1[x];
+			const uint8_t F = s1[xn];
+			const uint8_t H = s2[x];
+			uint32_t *p = d + x * N;
+			if (B == H || D == F) {
+				for (int j = 0; j < N; ++j) {
+					for (int i = 0; i < N; ++i) {
+						p[j * dstPitch + i] = palette[E];
+					}
+				}
+				continue;
+			}
+			if (N == 2) {
+				p[0]            = palette[D == B ? D : E];
+				p[1]            = palette[B == F ? F : E];
+				p[dstPitch]     = palette[D == H ? D : E];
+				p[dstPitch + 1] = palette[H == F ? F : E];
+			} else if (N == 3) {
+				const uint8_t A = s0[xp];
+				const uint8_t C = s0[xn];
+				const uint8_t G = s2[xp];
+				const uint8_t I = s2[xn];
+				const int nl1 = dstPitch;
+				const int nl2 = dstPitch * 2;
+				p[0]       = palette[D == B ? D : E];
+				p[1]       = palette[(D == B && E != C) || (B == F && E != A) ? B : E];
+				p[2]       = palette[B == F ? F : E];
+				p[nl1]     = palette[(D == B && E != G) || (D == H && E != A) ? D : E];
+				p[nl1 + 1] = palette[E];
+				p[nl1 + 2] = palette[(B == F && E != I) || (H == F && E != C) ? F : E];
+				p[nl2]     = palette[D == H ? D : E];
+				p[nl2 + 1] = palette[(D == H && E != I) || (H == F && E != G) ? H : E];
+				p[nl2 + 2] = palette[H == F ? F : E];
+			}
+		}
+	}
+}
+
+template <int N>
+static void scale_scalex(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *palette) {
+	scaleRows_scalex<N>(dst, dstPitch, src, srcPitch, w, h, 0, h, palette);
+}
+
+const Scaler scaler_scalex = {
+	"scale",
+	2, 3,
+	0,
+	{ scale_scalex<2>, scale_scalex<3>, 0 },
+	{ scaleRows_scalex<2>, scaleRows_scalex<3>, 0 }
+};
@@ -3,9 +3,12 @@
 // https://git.ffmpeg.org/gitweb/ffmpeg.git/blob_plain/HEAD:/libavfilter/vf_xbr.c
 
 #include "scaler.h"
+#include "simd.h"
+#include "util.h"
 
 static uint8_t _yuv[256][3];
 static int16_t _diffYuv[256][256];
+static uint32_t _yuvPacked[256];
 
 template <int M, int S>
 static uint32_t interpolate(uint32_t a, uint32_t b) {
@@ -148,107 +151,1024 @@ static uint32_t interpolate(uint32_t a, uint32_t b) {
 } while (0)
 
 template <int N>
-static void scale_xbr(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *palette) {
+static inline void fillPixel(uint32_t *E, int dstPitch, uint32_t color) {
+	for (int j = 0; j < N; ++j) {
+		for (int i = 0; i < N; ++i) {
+			*(E + j * dstPitch + i) = color;
+		}
+	}
+}
+
+// sa0-sa4 point 2 pixels before the current pixel of each of the 5 source rows
+template <int N>
+static inline void filterPixel(uint32_t *E, int dstPitch, const uint8_t *sa0, const uint8_t *sa1, const uint8_t *sa2, const uint8_t *sa3, const uint8_t *sa4, int x, int w, const uint32_t *palette) {
 	const int nl = dstPitch;
 	const int nl1 = dstPitch * 2;
 	const int nl2 = dstPitch * 3;
 
-	for (int y = 0; y < h; ++y) {
+	//    A1 B1 C1
+	// A0 PA PB PC C4
+	// D0 PD PE PF F4
+	// G0 PG PH PI I4
+	//    G5 H5 I5
+
+	const uint32_t B1 = sa0[2];
+	const uint32_t PB = sa1[2];
+	const uint32_t PE = sa2[2];
+	const uint32_t PH = sa3[2];
+	const uint32_t H5 = sa4[2];
+
+	const int pprev = 2 - (x > 0);
+	const uint32_t A1 = sa0[pprev];
+	const uint32_t PA = sa1[pprev];
+	const uint32_t PD = sa2[pprev];
+	const uint32_t PG = sa3[pprev];
+	const uint32_t G5 = sa4[pprev];
+
+	const int pprev2 = pprev - (x > 1);
+	const uint32_t A0 = sa1[pprev2];
+	const uint32_t D0 = sa2[pprev2];
+	const uint32_t G0 = sa3[pprev2];
+
+	const int pnext = 3 - (x == w - 1);
+	const uint32_t C1 = sa0[pnext];
+	const uint32_t PC = sa1[pnext];
+	const uint32_t PF = sa2[pnext];
+	const uint32_t PI = sa3[pnext];
+	const uint32_t I5 = sa4[pnext];
+
+	const int pnext2 = pnext + 1 - (x >= w - 2);
+	const uint32_t C4 = sa1[pnext2];
+	const uint32_t F4 = sa2[pnext2];
+	const uint32_t I4 = sa3[pnext2];
+
+	if (N == 2) {
+		filt2b(PE, PI, PH, PF, PG, PC, PD, PB, PA, G5, C4, G0, D0, C1, B1, F4, I4, H5, I5, A0, A1, 0, 1, nl, nl+1);
+		filt2b(PE, PC, PF, PB, PI, PA, PH, PD, PG, I4, A1, I5, H5, A0, D0, B1, C1, F4, C4, G5, G0, nl, 0, nl+1, 1);
+		filt2b(PE, PA, PB, PD, PC, PG, PF, PH, PI, C1, G0, C4, F4, G5, H5, D0, A0, B1, A1, I4, I5, nl+1, nl, 1, 0);
+		filt2b(PE, PG, PD, PH, PA, PI, PB, PF, PC, A0, I5, A1, B1, I4, F4, H5, G5, D0, G0, C1, C4, 1, nl+1, 0, nl);
+	} else if (N == 3) {
+		filt3a(PE, PI, PH, PF, PG, PC, PD, PB, PA, G5, C4, G0, D0, C1, B1, F4, I4, H5, I5, A0, A1, 0, 1, 2, nl, nl+1, nl+2, nl1, nl1+1, nl1+2);
+		filt3a(PE, PC, PF, PB, PI, PA, PH, PD, PG, I4, A1, I5, H5, A0, D0, B1, C1, F4, C4, G5, G0, nl1, nl, 0, nl1+1, nl+1, 1, nl1+2, nl+2, 2);
+		filt3a(PE, PA, PB, PD, PC, PG, PF, PH, PI, C1, G0, C4, F4, G5, H5, D0, A0, B1, A1, I4, I5, nl1+2, nl1+1, nl1, nl+2, nl+1, nl, 2, 1, 0);
+		filt3a(PE, PG, PD, PH, PA, PI, PB, PF, PC, A0, I5, A1, B1, I4, F4, H5, G5, D0, G0, C1, C4, 2, nl+2, nl1+2, 1, nl+1, nl1+1, 0, nl, nl1);
+	} else if (N == 4) {
+		filt4b(PE, PI, PH, PF, PG, PC, PD, PB, PA, G5, C4, G0, D0, C1, B1, F4, I4, H5, I5, A0, A1, nl2+3, nl2+2, nl1+3, 3, nl+3, nl1+2, nl2+1, nl2, nl1+1, nl+2, 2, 1, nl+1, nl1, nl, 0);
+		filt4b(PE, PC, PF, PB, PI, PA, PH, PD, PG, I4, A1, I5, H5, A0, D0, B1, C1, F4, C4, G5, G0, 3, nl+3, 2, 0, 1, nl+2, nl1+3, nl2+3, nl1+2, nl+1, nl, nl1, nl1+1, nl2+2, nl2+1, nl2);
+		filt4b(PE, PA, PB, PD, PC, PG, PF, PH, PI, C1, G0, C4, F4, G5, H5, D0, A0, B1, A1, I4, I5, 0, 1, nl, nl2, nl1, nl+1, 2, 3, nl+2, nl1+1, nl2+1, nl2+2, nl1+2, nl+3, nl1+3, nl2+3);
+		filt4b(PE, PG, PD, PH, PA, PI, PB, PF, PC, A0, I5, A1, B1, I4, F4, H5, G5, D0, G0, C1, C4, nl2, nl1, nl2+1, nl2+3, nl2+2, nl1+1, nl, 0, nl+1, nl1+2, nl1+3, nl+3, nl+2, 1, 2, 3);
+	}
+}
+
+// the rows above and below the image are clamped to the first and last rows
+static inline void setupRows(const uint8_t *src, int srcPitch, int y, int h, const uint8_t **sa) {
+	sa[2] = src + y * srcPitch - 2;
+	sa[1] = sa[2] - srcPitch;
+	sa[0] = sa[1] - srcPitch;
+	sa[3] = sa[2] + srcPitch;
+	sa[4] = sa[3] + srcPitch;
+	if (y <= 1) {
+		sa[0] = sa[1];
+		if (y == 0) {
+			sa[0] = sa[1] = sa[2];
+		}
+	}
+	if (y >= h - 2) {
+		sa[4] = sa[3];
+		if (y == h - 1) {
+			sa[4] = sa[3] = sa[2];
+		}
+	}
+}
+
+template <int N>
+static inline void scalePixel(uint32_t *E, int dstPitch, const uint8_t **sa, int x, int w, const uint32_t *palette) {
+	fillPixel<N>(E + x * N, dstPitch, COLOR(sa[2][x + 2]));
+	filterPixel<N>(E + x * N, dstPitch, sa[0] + x, sa[1] + x, sa[2] + x, sa[3] + x, sa[4] + x, x, w, palette);
+}
 
+template <int N>
+static void scaleRows_C(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette) {
+	for (int y = y1; y < y2; ++y) {
 		uint32_t *E = dst + y * dstPitch * N;
+		const uint8_t *sa[5];
+		setupRows(src, srcPitch, y, h, sa);
+		for (int x = 0; x < w; ++x) {
+			scalePixel<N>(E, dstPitch, sa, x, w, palette);
+		}
+	}
+}
 
-		const uint8_t *sa2 = src + y * srcPitch - 2;
-		const uint8_t *sa1 = sa2 - srcPitch;
-		const uint8_t *sa0 = sa1 - srcPitch;
-		const uint8_t *sa3 = sa2 + srcPitch;
-		const uint8_t *sa4 = sa3 + srcPitch;
+// The SIMD versions compute the 4 rotations of the filters for 4 (SSE4.1, NEON) or 8 (AVX2) pixels in
+// 32 bits lanes, with the same integer arithmetic as the macros above. The weights are sums of absolute
+// differences of the packed YUV bytes, the conditions are lane masks and the colors are blended on the
+// packed red/blue and alpha/green pairs, then selected with the masks. The source rows are expanded to
+// YUV and colors with the clamped neighbours of the borders.
+//
+// The pixels are first classified by groups : the 4 filters leave a pixel unchanged if, for each
+// rotation, PE has the same color as PH or PF. The indexes are compared, pixels with different indexes
+// for the same color go through the filters. The blocks of the unchanged pixels are only filled with PE.
+// The first column and the columns after the last full group are scaled with the scalar code.
 
-		if (y <= 1) {
-			sa0 = sa1;
-			if (y == 0) {
-				sa0 = sa1 = sa2;
+// neighbours of PE in the 5x5 grid, in the order of the filters parameters
+enum {
+	kPE, kPI, kPH, kPF, kPG, kPC, kPD, kPB, kF4, kI4, kH5, kI5,
+	kRotationPixels
+};
+
+static const int kGridSize = 5;
+static const int kGridPE = 2 * kGridSize + 2;
+
+static const uint8_t _rotationPixels[4][kRotationPixels] = {
+	{ 12, 18, 17, 13, 16,  8, 11,  7, 14, 19, 22, 23 },
+	{ 12,  8, 13,  7, 18,  6, 17, 11,  2,  3, 14,  9 },
+	{ 12,  6,  7, 11,  8, 16, 13, 17, 10,  5,  2,  1 },
+	{ 12, 16, 11, 17,  6, 18,  7, 13, 22, 21, 10, 15 }
+};
+
+// the subpixels blended by each rotation : N1, N2, N3 for 2x, N2, N5, N6, N7, N8 for 3x and
+// N3, N7, N10, N11, N12, N13, N14, N15 for 4x
+static const uint8_t _rotationSubPixels[3][4][8] = {
+	{ { 1, 2, 3 }, { 0, 3, 1 }, { 2, 1, 0 }, { 3, 0, 2 } },
+	{ { 2, 5, 6, 7, 8 }, { 0, 1, 8, 5, 2 }, { 6, 3, 2, 1, 0 }, { 8, 7, 0, 3, 6 } },
+	{ { 3, 7, 10, 11, 12, 13, 14, 15 }, { 0, 1, 6, 2, 15, 11, 7, 3 }, { 12, 8, 5, 4, 3, 2, 1, 0 }, { 15, 14, 9, 13, 0, 4, 8, 12 } }
+};
+
+// the 5 source rows around the current one, expanded to YUV and colors
+struct XbrRows {
+	uint32_t *_buffer;
+	int _pitch;
+	int _nextRow;
+	const uint32_t *_yuv[kGridSize];
+	const uint32_t *_color[kGridSize];
+
+	bool allocate(int w, int y) {
+		_pitch = w + 4;
+		_nextRow = y - 2;
+		_buffer = (uint32_t *)malloc(kGridSize * 2 * _pitch * sizeof(uint32_t));
+		return _buffer != 0;
+	}
+	void setup(const uint8_t *src, int srcPitch, int w, int h, int y, const uint32_t *palette) {
+		for (int i = 0; i < kGridSize; ++i) {
+			const int row = y - 2 + i;
+			uint32_t *yuv = _buffer + ((row + kGridSize) % kGridSize) * 2 * _pitch + 2;
+			uint32_t *color = yuv + _pitch;
+			if (row >= _nextRow) {
+				const uint8_t *p = src + CLIP(row, 0, h - 1) * srcPitch;
+				for (int x = -2; x < w + 2; ++x) {
+					const uint8_t c = p[CLIP(x, 0, w - 1)];
+					yuv[x] = _yuvPacked[c];
+					color[x] = COLOR(c);
+				}
 			}
+			_yuv[i] = yuv;
+			_color[i] = color;
 		}
-		if (y >= h - 2) {
-			sa4 = sa3;
-			if (y == h - 1) {
-				sa4 = sa3 = sa2;
-			}
+		_nextRow = y + 3;
+	}
+};
+
+// byte shuffle replicating each of 4 colors N times, for the N vectors of a row of 4 pixels
+template <int N>
+static void initShuffle(uint8_t *mask) {
+	for (int k = 0; k < N; ++k) {
+		for (int i = 0; i < 16; ++i) {
+			mask[k * 16 + i] = ((k * 4 + i / 4) / N) * 4 + (i & 3);
 		}
+	}
+}
 
-		for (int x = 0; x < w; ++x) {
+#ifdef SIMD_X86
+
+template <int N>
+TARGET_SSE41 static inline void fillPixels_SSE41(uint32_t *E, int dstPitch, __m128i colors, const __m128i *shuffle) {
+	for (int k = 0; k < N; ++k) {
+		const __m128i v = _mm_shuffle_epi8(colors, shuffle[k]);
+		for (int j = 0; j < N; ++j) {
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch + k * 4), v);
+		}
+	}
+}
+
+// returns a mask of the pixels with a different color than their neighbours
+TARGET_SSE41 static inline uint32_t classifyPixels_SSE41(const uint8_t **sa, int x) {
+	const __m128i pe = _mm_loadu_si128((const __m128i *)(sa[2] + x + 2));
+	const __m128i eqB = _mm_cmpeq_epi8(pe, _mm_loadu_si128((const __m128i *)(sa[1] + x + 2)));
+	const __m128i eqD = _mm_cmpeq_epi8(pe, _mm_loadu_si128((const __m128i *)(sa[2] + x + 1)));
+	const __m128i eqF = _mm_cmpeq_epi8(pe, _mm_loadu_si128((const __m128i *)(sa[2] + x + 3)));
+	const __m128i eqH = _mm_cmpeq_epi8(pe, _mm_loadu_si128((const __m128i *)(sa[3] + x + 2)));
+	__m128i flat = _mm_and_si128(_mm_or_si128(eqH, eqF), _mm_or_si128(eqF, eqB));
+	flat = _mm_and_si128(flat, _mm_and_si128(_mm_or_si128(eqB, eqD), _mm_or_si128(eqD, eqH)));
+	return ~_mm_movemask_epi8(flat) & 0xFFFF;
+}
+
+// _diffYuv of the packed YUV bytes
+TARGET_SSE41 static inline __m128i diff_SSE41(__m128i a, __m128i b) {
+	const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+	return _mm_madd_epi16(_mm_maddubs_epi16(d, _mm_set1_epi8(1)), _mm_set1_epi16(1));
+}
+
+template <int M, int S>
+TARGET_SSE41 static inline __m128i interpolate_SSE41(__m128i a, __m128i b) {
+	const __m128i mask = _mm_set1_epi32(0xFF00FF);
+
+	const __m128i a_rb = _mm_and_si128(a, mask);
+	const __m128i a_ag = _mm_and_si128(_mm_srli_epi32(a, 8), mask);
+
+	const __m128i b_rb = _mm_and_si128(b, mask);
+	const __m128i b_ag = _mm_and_si128(_mm_srli_epi32(b, 8), mask);
+
+	__m128i d1 = _mm_sub_epi32(b_rb, a_rb);
+	__m128i d2 = _mm_sub_epi32(b_ag, a_ag);
+	if (M == 3) {
+		d1 = _mm_add_epi32(_mm_slli_epi32(d1, 1), d1);
+		d2 = _mm_add_epi32(_mm_slli_epi32(d2, 1), d2);
+	} else if (M == 7) {
+		d1 = _mm_sub_epi32(_mm_slli_epi32(d1, 3), d1);
+		d2 = _mm_sub_epi32(_mm_slli_epi32(d2, 3), d2);
+	}
+	const __m128i m1 = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(d1, S), a_rb), mask);
+	const __m128i m2 = _mm_and_si128(_mm_add_epi32(_mm_srli_epi32(d2, S), a_ag), mask);
+
+	return _mm_or_si128(m1, _mm_slli_epi32(m2, 8));
+}
+
+// the mask lanes select 'b'
+TARGET_SSE41 static inline __m128i select_SSE41(__m128i a, __m128i b, __m128i mask) {
+	return _mm_blendv_epi8(a, b, mask);
+}
+
+template <int N>
+TARGET_SSE41 static inline void filterRotation_SSE41(__m128i *E, const __m128i *yuv, const __m128i *color, const uint8_t *p, const uint8_t *n) {
+	const __m128i cE = color[p[kPE]];
+	const __m128i cH = color[p[kPH]];
+	const __m128i cF = color[p[kPF]];
+	const __m128i unchanged = _mm_or_si128(_mm_cmpeq_epi32(cE, cH), _mm_cmpeq_epi32(cE, cF));
+	if (_mm_movemask_epi8(unchanged) == 0xFFFF) {
+		return;
+	}
+
+	const __m128i dEC = diff_SSE41(yuv[p[kPE]], yuv[p[kPC]]);
+	const __m128i dEG = diff_SSE41(yuv[p[kPE]], yuv[p[kPG]]);
+	const __m128i dEI = diff_SSE41(yuv[p[kPE]], yuv[p[kPI]]);
+	const __m128i dEF = diff_SSE41(yuv[p[kPE]], yuv[p[kPF]]);
+	const __m128i dEH = diff_SSE41(yuv[p[kPE]], yuv[p[kPH]]);
+	const __m128i dIH5 = diff_SSE41(yuv[p[kPI]], yuv[p[kH5]]);
+	const __m128i dIF4 = diff_SSE41(yuv[p[kPI]], yuv[p[kF4]]);
+	const __m128i dHF = diff_SSE41(yuv[p[kPH]], yuv[p[kPF]]);
+	const __m128i dHD = diff_SSE41(yuv[p[kPH]], yuv[p[kPD]]);
+	const __m128i dHI5 = diff_SSE41(yuv[p[kPH]], yuv[p[kI5]]);
+	const __m128i dFI4 = diff_SSE41(yuv[p[kPF]], yuv[p[kI4]]);
+	const __m128i dFB = diff_SSE41(yuv[p[kPF]], yuv[p[kPB]]);
+
+	const __m128i e = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(dEC, dEG), _mm_add_epi32(dIH5, dIF4)), _mm_slli_epi32(dHF, 2));
+	const __m128i i = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(dHD, dHI5), _mm_add_epi32(dFI4, dFB)), _mm_slli_epi32(dEI, 2));
+	const __m128i blend = _mm_andnot_si128(_mm_or_si128(unchanged, _mm_cmpgt_epi32(e, i)), _mm_set1_epi32(-1));
+	if (_mm_testz_si128(blend, blend)) {
+		return;
+	}
+	const __m128i px = select_SSE41(cF, cH, _mm_cmpgt_epi32(dEF, dEH));
+
+	const __m128i k155 = _mm_set1_epi32(155);
+	const __m128i eqFB = _mm_cmpgt_epi32(k155, dFB);
+	const __m128i eqHD = _mm_cmpgt_epi32(k155, dHD);
+	const __m128i eqEI = _mm_cmpgt_epi32(k155, dEI);
+	const __m128i eqFI4 = _mm_cmpgt_epi32(k155, dFI4);
+	const __m128i eqHI5 = _mm_cmpgt_epi32(k155, dHI5);
+	const __m128i eqEG = _mm_cmpgt_epi32(k155, dEG);
+	const __m128i eqEC = _mm_cmpgt_epi32(k155, dEC);
+	__m128i cond;
+	if (N == 3) {
+		const __m128i eqFC = _mm_cmpgt_epi32(k155, diff_SSE41(yuv[p[kPF]], yuv[p[kPC]]));
+		const __m128i eqHG = _mm_cmpgt_epi32(k155, diff_SSE41(yuv[p[kPH]], yuv[p[kPG]]));
+		const __m128i eqFF4 = _mm_cmpgt_epi32(k155, diff_SSE41(yuv[p[kPF]], yuv[p[kF4]]));
+		const __m128i eqHH5 = _mm_cmpgt_epi32(k155, diff_SSE41(yuv[p[kPH]], yuv[p[kH5]]));
+		cond = _mm_or_si128(_mm_cmpeq_epi32(_mm_or_si128(eqFB, eqFC), _mm_setzero_si128()), _mm_cmpeq_epi32(_mm_or_si128(eqHD, eqHG), _mm_setzero_si128()));
+		cond = _mm_or_si128(cond, _mm_andnot_si128(_mm_or_si128(eqFF4, eqFI4), eqEI));
+		cond = _mm_or_si128(cond, _mm_cmpeq_epi32(_mm_or_si128(eqHH5, eqHI5), _mm_setzero_si128()));
+	} else {
+		cond = _mm_cmpeq_epi32(_mm_or_si128(eqFB, eqHD), _mm_setzero_si128());
+		cond = _mm_or_si128(cond, _mm_andnot_si128(_mm_or_si128(eqFI4, eqHI5), eqEI));
+	}
+	cond = _mm_or_si128(cond, _mm_or_si128(eqEG, eqEC));
+
+	const __m128i strong = _mm_and_si128(_mm_and_si128(blend, _mm_cmpgt_epi32(i, e)), cond);
+	const __m128i cG = color[p[kPG]];
+	const __m128i cC = color[p[kPC]];
+	const __m128i ke = diff_SSE41(yuv[p[kPF]], yuv[p[kPG]]);
+	const __m128i ki = diff_SSE41(yuv[p[kPH]], yuv[p[kPC]]);
+	const __m128i notLeft = _mm_or_si128(_mm_cmpgt_epi32(_mm_slli_epi32(ke, 1), ki), _mm_or_si128(_mm_cmpeq_epi32(cE, cG), _mm_cmpeq_epi32(color[p[kPD]], cG)));
+	const __m128i notUp = _mm_or_si128(_mm_cmpgt_epi32(_mm_slli_epi32(ki, 1), ke), _mm_or_si128(_mm_cmpeq_epi32(cE, cC), _mm_cmpeq_epi32(color[p[kPB]], cC)));
+	const __m128i left = _mm_andnot_si128(notLeft, strong);
+	const __m128i up = _mm_andnot_si128(notUp, strong);
+	const __m128i leftUp = _mm_and_si128(left, up);
+	const __m128i upOnly = _mm_andnot_si128(left, up);
+	const __m128i weak = _mm_andnot_si128(strong, blend);
+
+	if (N == 2) {
+		const __m128i e1 = E[n[0]], e2 = E[n[1]], e3 = E[n[2]];
+		__m128i v = select_SSE41(e3, interpolate_SSE41<1,1>(e3, px), blend);
+		v = select_SSE41(v, interpolate_SSE41<3,2>(e3, px), _mm_or_si128(left, up));
+		E[n[2]] = select_SSE41(v, interpolate_SSE41<7,3>(e3, px), leftUp);
+		E[n[1]] = select_SSE41(e2, interpolate_SSE41<1,2>(e2, px), left);
+		E[n[0]] = select_SSE41(select_SSE41(e1, interpolate_SSE41<1,2>(e1, px), upOnly), E[n[1]], leftUp);
+	} else if (N == 3) {
+		const __m128i leftOnly = _mm_andnot_si128(up, left);
+		const __m128i neither = _mm_andnot_si128(_mm_or_si128(left, up), strong);
+		const __m128i e2 = E[n[0]], e5 = E[n[1]], e6 = E[n[2]], e7 = E[n[3]], e8 = E[n[4]];
+		__m128i v = select_SSE41(e7, interpolate_SSE41<1,3>(e7, px), neither);
+		v = select_SSE41(v, interpolate_SSE41<1,2>(e7, px), upOnly);
+		E[n[3]] = select_SSE41(v, interpolate_SSE41<3,2>(e7, px), left);
+		E[n[2]] = select_SSE41(e6, interpolate_SSE41<1,2>(e6, px), left);
+		v = select_SSE41(e5, interpolate_SSE41<1,3>(e5, px), neither);
+		v = select_SSE41(v, interpolate_SSE41<3,2>(e5, px), upOnly);
+		v = select_SSE41(v, interpolate_SSE41<1,2>(e5, px), leftOnly);
+		E[n[1]] = select_SSE41(v, E[n[3]], leftUp);
+		E[n[0]] = select_SSE41(select_SSE41(e2, interpolate_SSE41<1,2>(e2, px), upOnly), E[n[2]], leftUp);
+		v = select_SSE41(e8, interpolate_SSE41<1,1>(e8, px), weak);
+		v = select_SSE41(v, interpolate_SSE41<7,3>(e8, px), neither);
+		E[n[4]] = select_SSE41(v, px, _mm_or_si128(left, up));
+	} else if (N == 4) {
+		const __m128i leftOnly = _mm_andnot_si128(up, left);
+		const __m128i neither = _mm_andnot_si128(_mm_or_si128(left, up), strong);
+		const __m128i e3 = E[n[0]], e7 = E[n[1]], e10 = E[n[2]], e11 = E[n[3]], e12 = E[n[4]], e13 = E[n[5]], e14 = E[n[6]], e15 = E[n[7]];
+		E[n[5]] = select_SSE41(e13, interpolate_SSE41<3,2>(e13, px), left);
+		E[n[4]] = select_SSE41(e12, interpolate_SSE41<1,2>(e12, px), left);
+		E[n[7]] = select_SSE41(select_SSE41(e15, interpolate_SSE41<1,1>(e15, px), weak), px, strong);
+		__m128i v = select_SSE41(e14, interpolate_SSE41<1,1>(e14, px), neither);
+		v = select_SSE41(v, interpolate_SSE41<3,2>(e14, px), upOnly);
+		E[n[6]] = select_SSE41(v, px, left);
+		v = select_SSE41(e11, interpolate_SSE41<1,1>(e11, px), neither);
+		v = select_SSE41(v, interpolate_SSE41<3,2>(e11, px), leftOnly);
+		E[n[3]] = select_SSE41(v, px, up);
+		v = select_SSE41(e10, interpolate_SSE41<1,2>(e10, px), _mm_or_si128(leftOnly, upOnly));
+		E[n[2]] = select_SSE41(v, E[n[4]], leftUp);
+		E[n[0]] = select_SSE41(select_SSE41(e3, interpolate_SSE41<1,2>(e3, px), upOnly), E[n[4]], leftUp);
+		E[n[1]] = select_SSE41(select_SSE41(e7, interpolate_SSE41<3,2>(e7, px), upOnly), E[n[5]], leftUp);
+	}
+}
+
+// interleaves the subpixels a, b and c of 4 pixels : a0 b0 c0 a1, b1 c1 a2 b2, c2 a3 b3 c3
+TARGET_SSE41 static inline void interleave3_SSE41(__m128i a, __m128i b, __m128i c, __m128i *v) {
+	v[0] = _mm_blend_epi16(_mm_blend_epi16(_mm_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 0, 0)), _mm_shuffle_epi32(b, 0), 0x0C), _mm_shuffle_epi32(c, 0), 0x30);
+	v[1] = _mm_blend_epi16(_mm_blend_epi16(_mm_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 1, 1)), _mm_shuffle_epi32(c, _MM_SHUFFLE(1, 1, 1, 1)), 0x0C), _mm_shuffle_epi32(a, _MM_SHUFFLE(2, 2, 2, 2)), 0x30);
+	v[2] = _mm_blend_epi16(_mm_blend_epi16(_mm_shuffle_epi32(c, _MM_SHUFFLE(3, 2, 2, 2)), _mm_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 3, 3)), 0x0C), _mm_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 3, 3)), 0x30);
+}
+
+// filters the 4 pixels at 'x'
+template <int N>
+TARGET_SSE41 static inline void filterPixels_SSE41(uint32_t *E, int dstPitch, const XbrRows *rows, int x) {
+	__m128i yuv[kGridSize * kGridSize];
+	__m128i color[kGridSize * kGridSize];
+	for (int j = 0; j < kGridSize; ++j) {
+		for (int i = 0; i < kGridSize; ++i) {
+			yuv[j * kGridSize + i] = _mm_loadu_si128((const __m128i *)(rows->_yuv[j] + x + i - 2));
+			color[j * kGridSize + i] = _mm_loadu_si128((const __m128i *)(rows->_color[j] + x + i - 2));
+		}
+	}
+	__m128i sub[N * N];
+	for (int k = 0; k < N * N; ++k) {
+		sub[k] = color[kGridPE];
+	}
+	for (int r = 0; r < 4; ++r) {
+		filterRotation_SSE41<N>(sub, yuv, color, _rotationPixels[r], _rotationSubPixels[N - 2][r]);
+	}
+	if (N == 2) {
+		for (int j = 0; j < N; ++j) {
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch),     _mm_unpacklo_epi32(sub[j * N], sub[j * N + 1]));
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch + 4), _mm_unpackhi_epi32(sub[j * N], sub[j * N + 1]));
+		}
+	} else if (N == 4) {
+		for (int j = 0; j < N; ++j) {
+			const __m128i t0 = _mm_unpacklo_epi32(sub[j * N],     sub[j * N + 1]);
+			const __m128i t1 = _mm_unpacklo_epi32(sub[j * N + 2], sub[j * N + 3]);
+			const __m128i t2 = _mm_unpackhi_epi32(sub[j * N],     sub[j * N + 1]);
+			const __m128i t3 = _mm_unpackhi_epi32(sub[j * N + 2], sub[j * N + 3]);
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch),      _mm_unpacklo_epi64(t0, t1));
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch + 4),  _mm_unpackhi_epi64(t0, t1));
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch + 8),  _mm_unpacklo_epi64(t2, t3));
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch + 12), _mm_unpackhi_epi64(t2, t3));
+		}
+	} else if (N == 3) {
+		for (int j = 0; j < N; ++j) {
+			__m128i v[3];
+			interleave3_SSE41(sub[j * N], sub[j * N + 1], sub[j * N + 2], v);
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch),     v[0]);
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch + 4), v[1]);
+			_mm_storeu_si128((__m128i *)(E + j * dstPitch + 8), v[2]);
+		}
+	}
+}
 
-			//    A1 B1 C1
-			// A0 PA PB PC C4
-			// D0 PD PE PF F4
-			// G0 PG PH PI I4
-			//    G5 H5 I5
-
-			const uint32_t B1 = sa0[2];
-			const uint32_t PB = sa1[2];
-			const uint32_t PE = sa2[2];
-			const uint32_t PH = sa3[2];
-			const uint32_t H5 = sa4[2];
-
-			const int pprev = 2 - (x > 0);
-			const uint32_t A1 = sa0[pprev];
-			const uint32_t PA = sa1[pprev];
-			const uint32_t PD = sa2[pprev];
-			const uint32_t PG = sa3[pprev];
-			const uint32_t G5 = sa4[pprev];
-
-			const int pprev2 = pprev - (x > 1);
-			const uint32_t A0 = sa1[pprev2];
-			const uint32_t D0 = sa2[pprev2];
-			const uint32_t G0 = sa3[pprev2];
-
-			const int pnext = 3 - (x == w - 1);
-			const uint32_t C1 = sa0[pnext];
-			const uint32_t PC = sa1[pnext];
-			const uint32_t PF = sa2[pnext];
-			const uint32_t PI = sa3[pnext];
-			const uint32_t I5 = sa4[pnext];
-
-			const int pnext2 = pnext + 1 - (x >= w - 2);
-			const uint32_t C4 = sa1[pnext2];
-			const uint32_t F4 = sa2[pnext2];
-			const uint32_t I4 = sa3[pnext2];
-
-			for (int j = 0; j < N; ++j) {
-				for (int i = 0; i < N; ++i) {
-					*(E + j * dstPitch + i) = COLOR(PE);
+template <int N>
+TARGET_SSE41 static void scaleRows_SSE41(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette) {
+	XbrRows rows;
+	if (!rows.allocate(w, y1)) {
+		scaleRows_C<N>(dst, dstPitch, src, srcPitch, w, h, y1, y2, palette);
+		return;
+	}
+	uint8_t mask[N * 16];
+	initShuffle<N>(mask);
+	__m128i shuffle[N];
+	for (int k = 0; k < N; ++k) {
+		shuffle[k] = _mm_loadu_si128((const __m128i *)(mask + k * 16));
+	}
+	for (int y = y1; y < y2; ++y) {
+		uint32_t *E = dst + y * dstPitch * N;
+		const uint8_t *sa[5];
+		setupRows(src, srcPitch, y, h, sa);
+		rows.setup(src, srcPitch, w, h, y, palette);
+		int x = 0;
+		if (w > 0) {
+			scalePixel<N>(E, dstPitch, sa, x++, w, palette);
+		}
+		for (; x + 16 < w; x += 16) {
+			const uint32_t edges = classifyPixels_SSE41(sa, x);
+			for (int i = 0; i < 16; i += 4) {
+				if (edges & (15 << i)) {
+					filterPixels_SSE41<N>(E + (x + i) * N, dstPitch, &rows, x + i);
+				} else {
+					fillPixels_SSE41<N>(E + (x + i) * N, dstPitch, _mm_loadu_si128((const __m128i *)(rows._color[2] + x + i)), shuffle);
 				}
 			}
+		}
+		for (; x < w; ++x) {
+			scalePixel<N>(E, dstPitch, sa, x, w, palette);
+		}
+	}
+	free(rows._buffer);
+}
+
+// permutation replicating each of the 8 colors N times, for the N vectors of a row of 8 pixels
+template <int N>
+static void initPermute_AVX2(int *index) {
+	for (int k = 0; k < N; ++k) {
+		for (int i = 0; i < 8; ++i) {
+			index[k * 8 + i] = (k * 8 + i) / N;
+		}
+	}
+}
+
+template <int N>
+TARGET_AVX2 static inline void fillPixels_AVX2(uint32_t *E, int dstPitch, __m256i colors, const __m256i *permute) {
+	for (int k = 0; k < N; ++k) {
+		const __m256i v = _mm256_permutevar8x32_epi32(colors, permute[k]);
+		for (int j = 0; j < N; ++j) {
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch + k * 8), v);
+		}
+	}
+}
 
+TARGET_AVX2 static inline uint32_t classifyPixels_AVX2(const uint8_t **sa, int x) {
+	const __m256i pe = _mm256_loadu_si256((const __m256i *)(sa[2] + x + 2));
+	const __m256i eqB = _mm256_cmpeq_epi8(pe, _mm256_loadu_si256((const __m256i *)(sa[1] + x + 2)));
+	const __m256i eqD = _mm256_cmpeq_epi8(pe, _mm256_loadu_si256((const __m256i *)(sa[2] + x + 1)));
+	const __m256i eqF = _mm256_cmpeq_epi8(pe, _mm256_loadu_si256((const __m256i *)(sa[2] + x + 3)));
+	const __m256i eqH = _mm256_cmpeq_epi8(pe, _mm256_loadu_si256((const __m256i *)(sa[3] + x + 2)));
+	__m256i flat = _mm256_and_si256(_mm256_or_si256(eqH, eqF), _mm256_or_si256(eqF, eqB));
+	flat = _mm256_and_si256(flat, _mm256_and_si256(_mm256_or_si256(eqB, eqD), _mm256_or_si256(eqD, eqH)));
+	return ~(uint32_t)_mm256_movemask_epi8(flat);
+}
+
+TARGET_AVX2 static inline __m256i diff_AVX2(__m256i a, __m256i b) {
+	const __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+	return _mm256_madd_epi16(_mm256_maddubs_epi16(d, _mm256_set1_epi8(1)), _mm256_set1_epi16(1));
+}
 
-			if (N == 2) {
-				filt2b(PE, PI, PH, PF, PG, PC, PD, PB, PA, G5, C4, G0, D0, C1, B1, F4, I4, H5, I5, A0, A1, 0, 1, nl, nl+1);
-				filt2b(PE, PC, PF, PB, PI, PA, PH, PD, PG, I4, A1, I5, H5, A0, D0, B1, C1, F4, C4, G5, G0, nl, 0, nl+1, 1);
-				filt2b(PE, PA, PB, PD, PC, PG, PF, PH, PI, C1, G0, C4, F4, G5, H5, D0, A0, B1, A1, I4, I5, nl+1, nl, 1, 0);
-				filt2b(PE, PG, PD, PH, PA, PI, PB, PF, PC, A0, I5, A1, B1, I4, F4, H5, G5, D0, G0, C1, C4, 1, nl+1, 0, nl);
-			} else if (N == 3) {
-				filt3a(PE, PI, PH, PF, PG, PC, PD, PB, PA, G5, C4, G0, D0, C1, B1, F4, I4, H5, I5, A0, A1, 0, 1, 2, nl, nl+1, nl+2, nl1, nl1+1, nl1+2);
-				filt3a(PE, PC, PF, PB, PI, PA, PH, PD, PG, I4, A1, I5, H5, A0, D0, B1, C1, F4, C4, G5, G0, nl1, nl, 0, nl1+1, nl+1, 1, nl1+2, nl+2, 2);
-				filt3a(PE, PA, PB, PD, PC, PG, PF, PH, PI, C1, G0, C4, F4, G5, H5, D0, A0, B1, A1, I4, I5, nl1+2, nl1+1, nl1, nl+2, nl+1, nl, 2, 1, 0);
-				filt3a(PE, PG, PD, PH, PA, PI, PB, PF, PC, A0, I5, A1, B1, I4, F4, H5, G5, D0, G0, C1, C4, 2, nl+2, nl1+2, 1, nl+1, nl1+1, 0, nl, nl1);
-			} else if (N == 4) {
-				filt4b(PE, PI, PH, PF, PG, PC, PD, PB, PA, G5, C4, G0, D0, C1, B1, F4, I4, H5, I5, A0, A1, nl2+3, nl2+2, nl1+3, 3, nl+3, nl1+2, nl2+1, nl2, nl1+1, nl+2, 2, 1, nl+1, nl1, nl, 0);
-				filt4b(PE, PC, PF, PB, PI, PA, PH, PD, PG, I4, A1, I5, H5, A0, D0, B1, C1, F4, C4, G5, G0, 3, nl+3, 2, 0, 1, nl+2, nl1+3, nl2+3, nl1+2, nl+1, nl, nl1, nl1+1, nl2+2, nl2+1, nl2);
-				filt4b(PE, PA, PB, PD, PC, PG, PF, PH, PI, C1, G0, C4, F4, G5, H5, D0, A0, B1, A1, I4, I5, 0, 1, nl, nl2, nl1, nl+1, 2, 3, nl+2, nl1+1, nl2+1, nl2+2, nl1+2, nl+3, nl1+3, nl2+3);
-				filt4b(PE, PG, PD, PH, PA, PI, PB, PF, PC, A0, I5, A1, B1, I4, F4, H5, G5, D0, G0, C1, C4, nl2, nl1, nl2+1, nl2+3, nl2+2, nl1+1, nl, 0, nl+1, nl1+2, nl1+3, nl+3, nl+2, 1, 2, 3);
+template <int M, int S>
+TARGET_AVX2 static inline __m256i interpolate_AVX2(__m256i a, __m256i b) {
+	const __m256i mask = _mm256_set1_epi32(0xFF00FF);
+
+	const __m256i a_rb = _mm256_and_si256(a, mask);
+	const __m256i a_ag = _mm256_and_si256(_mm256_srli_epi32(a, 8), mask);
+
+	const __m256i b_rb = _mm256_and_si256(b, mask);
+	const __m256i b_ag = _mm256_and_si256(_mm256_srli_epi32(b, 8), mask);
+
+	__m256i d1 = _mm256_sub_epi32(b_rb, a_rb);
+	__m256i d2 = _mm256_sub_epi32(b_ag, a_ag);
+	if (M == 3) {
+		d1 = _mm256_add_epi32(_mm256_slli_epi32(d1, 1), d1);
+		d2 = _mm256_add_epi32(_mm256_slli_epi32(d2, 1), d2);
+	} else if (M == 7) {
+		d1 = _mm256_sub_epi32(_mm256_slli_epi32(d1, 3), d1);
+		d2 = _mm256_sub_epi32(_mm256_slli_epi32(d2, 3), d2);
+	}
+	const __m256i m1 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(d1, S), a_rb), mask);
+	const __m256i m2 = _mm256_and_si256(_mm256_add_epi32(_mm256_srli_epi32(d2, S), a_ag), mask);
+
+	return _mm256_or_si256(m1, _mm256_slli_epi32(m2, 8));
+}
+
+TARGET_AVX2 static inline __m256i select_AVX2(__m256i a, __m256i b, __m256i mask) {
+	return _mm256_blendv_epi8(a, b, mask);
+}
+
+template <int N>
+TARGET_AVX2 static inline void filterRotation_AVX2(__m256i *E, const __m256i *yuv, const __m256i *color, const uint8_t *p, const uint8_t *n) {
+	const __m256i cE = color[p[kPE]];
+	const __m256i cH = color[p[kPH]];
+	const __m256i cF = color[p[kPF]];
+	const __m256i unchanged = _mm256_or_si256(_mm256_cmpeq_epi32(cE, cH), _mm256_cmpeq_epi32(cE, cF));
+	if (_mm256_movemask_epi8(unchanged) == -1) {
+		return;
+	}
+
+	const __m256i dEC = diff_AVX2(yuv[p[kPE]], yuv[p[kPC]]);
+	const __m256i dEG = diff_AVX2(yuv[p[kPE]], yuv[p[kPG]]);
+	const __m256i dEI = diff_AVX2(yuv[p[kPE]], yuv[p[kPI]]);
+	const __m256i dEF = diff_AVX2(yuv[p[kPE]], yuv[p[kPF]]);
+	const __m256i dEH = diff_AVX2(yuv[p[kPE]], yuv[p[kPH]]);
+	const __m256i dIH5 = diff_AVX2(yuv[p[kPI]], yuv[p[kH5]]);
+	const __m256i dIF4 = diff_AVX2(yuv[p[kPI]], yuv[p[kF4]]);
+	const __m256i dHF = diff_AVX2(yuv[p[kPH]], yuv[p[kPF]]);
+	const __m256i dHD = diff_AVX2(yuv[p[kPH]], yuv[p[kPD]]);
+	const __m256i dHI5 = diff_AVX2(yuv[p[kPH]], yuv[p[kI5]]);
+	const __m256i dFI4 = diff_AVX2(yuv[p[kPF]], yuv[p[kI4]]);
+	const __m256i dFB = diff_AVX2(yuv[p[kPF]], yuv[p[kPB]]);
+
+	const __m256i e = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(dEC, dEG), _mm256_add_epi32(dIH5, dIF4)), _mm256_slli_epi32(dHF, 2));
+	const __m256i i = _mm256_add_epi32(_mm256_add_epi32(_mm256_add_epi32(dHD, dHI5), _mm256_add_epi32(dFI4, dFB)), _mm256_slli_epi32(dEI, 2));
+	const __m256i blend = _mm256_andnot_si256(_mm256_or_si256(unchanged, _mm256_cmpgt_epi32(e, i)), _mm256_set1_epi32(-1));
+	if (_mm256_testz_si256(blend, blend)) {
+		return;
+	}
+	const __m256i px = select_AVX2(cF, cH, _mm256_cmpgt_epi32(dEF, dEH));
+
+	const __m256i k155 = _mm256_set1_epi32(155);
+	const __m256i eqFB = _mm256_cmpgt_epi32(k155, dFB);
+	const __m256i eqHD = _mm256_cmpgt_epi32(k155, dHD);
+	const __m256i eqEI = _mm256_cmpgt_epi32(k155, dEI);
+	const __m256i eqFI4 = _mm256_cmpgt_epi32(k155, dFI4);
+	const __m256i eqHI5 = _mm256_cmpgt_epi32(k155, dHI5);
+	const __m256i eqEG = _mm256_cmpgt_epi32(k155, dEG);
+	const __m256i eqEC = _mm256_cmpgt_epi32(k155, dEC);
+	__m256i cond;
+	if (N == 3) {
+		const __m256i eqFC = _mm256_cmpgt_epi32(k155, diff_AVX2(yuv[p[kPF]], yuv[p[kPC]]));
+		const __m256i eqHG = _mm256_cmpgt_epi32(k155, diff_AVX2(yuv[p[kPH]], yuv[p[kPG]]));
+		const __m256i eqFF4 = _mm256_cmpgt_epi32(k155, diff_AVX2(yuv[p[kPF]], yuv[p[kF4]]));
+		const __m256i eqHH5 = _mm256_cmpgt_epi32(k155, diff_AVX2(yuv[p[kPH]], yuv[p[kH5]]));
+		cond = _mm256_or_si256(_mm256_cmpeq_epi32(_mm256_or_si256(eqFB, eqFC), _mm256_setzero_si256()), _mm256_cmpeq_epi32(_mm256_or_si256(eqHD, eqHG), _mm256_setzero_si256()));
+		cond = _mm256_or_si256(cond, _mm256_andnot_si256(_mm256_or_si256(eqFF4, eqFI4), eqEI));
+		cond = _mm256_or_si256(cond, _mm256_cmpeq_epi32(_mm256_or_si256(eqHH5, eqHI5), _mm256_setzero_si256()));
+	} else {
+		cond = _mm256_cmpeq_epi32(_mm256_or_si256(eqFB, eqHD), _mm256_setzero_si256());
+		cond = _mm256_or_si256(cond, _mm256_andnot_si256(_mm256_or_si256(eqFI4, eqHI5), eqEI));
+	}
+	cond = _mm256_or_si256(cond, _mm256_or_si256(eqEG, eqEC));
+
+	const __m256i strong = _mm256_and_si256(_mm256_and_si256(blend, _mm256_cmpgt_epi32(i, e)), cond);
+	const __m256i cG = color[p[kPG]];
+	const __m256i cC = color[p[kPC]];
+	const __m256i ke = diff_AVX2(yuv[p[kPF]], yuv[p[kPG]]);
+	const __m256i ki = diff_AVX2(yuv[p[kPH]], yuv[p[kPC]]);
+	const __m256i notLeft = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_slli_epi32(ke, 1), ki), _mm256_or_si256(_mm256_cmpeq_epi32(cE, cG), _mm256_cmpeq_epi32(color[p[kPD]], cG)));
+	const __m256i notUp = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_slli_epi32(ki, 1), ke), _mm256_or_si256(_mm256_cmpeq_epi32(cE, cC), _mm256_cmpeq_epi32(color[p[kPB]], cC)));
+	const __m256i left = _mm256_andnot_si256(notLeft, strong);
+	const __m256i up = _mm256_andnot_si256(notUp, strong);
+	const __m256i leftUp = _mm256_and_si256(left, up);
+	const __m256i upOnly = _mm256_andnot_si256(left, up);
+	const __m256i weak = _mm256_andnot_si256(strong, blend);
+
+	if (N == 2) {
+		const __m256i e1 = E[n[0]], e2 = E[n[1]], e3 = E[n[2]];
+		__m256i v = select_AVX2(e3, interpolate_AVX2<1,1>(e3, px), blend);
+		v = select_AVX2(v, interpolate_AVX2<3,2>(e3, px), _mm256_or_si256(left, up));
+		E[n[2]] = select_AVX2(v, interpolate_AVX2<7,3>(e3, px), leftUp);
+		E[n[1]] = select_AVX2(e2, interpolate_AVX2<1,2>(e2, px), left);
+		E[n[0]] = select_AVX2(select_AVX2(e1, interpolate_AVX2<1,2>(e1, px), upOnly), E[n[1]], leftUp);
+	} else if (N == 3) {
+		const __m256i leftOnly = _mm256_andnot_si256(up, left);
+		const __m256i neither = _mm256_andnot_si256(_mm256_or_si256(left, up), strong);
+		const __m256i e2 = E[n[0]], e5 = E[n[1]], e6 = E[n[2]], e7 = E[n[3]], e8 = E[n[4]];
+		__m256i v = select_AVX2(e7, interpolate_AVX2<1,3>(e7, px), neither);
+		v = select_AVX2(v, interpolate_AVX2<1,2>(e7, px), upOnly);
+		E[n[3]] = select_AVX2(v, interpolate_AVX2<3,2>(e7, px), left);
+		E[n[2]] = select_AVX2(e6, interpolate_AVX2<1,2>(e6, px), left);
+		v = select_AVX2(e5, interpolate_AVX2<1,3>(e5, px), neither);
+		v = select_AVX2(v, interpolate_AVX2<3,2>(e5, px), upOnly);
+		v = select_AVX2(v, interpolate_AVX2<1,2>(e5, px), leftOnly);
+		E[n[1]] = select_AVX2(v, E[n[3]], leftUp);
+		E[n[0]] = select_AVX2(select_AVX2(e2, interpolate_AVX2<1,2>(e2, px), upOnly), E[n[2]], leftUp);
+		v = select_AVX2(e8, interpolate_AVX2<1,1>(e8, px), weak);
+		v = select_AVX2(v, interpolate_AVX2<7,3>(e8, px), neither);
+		E[n[4]] = select_AVX2(v, px, _mm256_or_si256(left, up));
+	} else if (N == 4) {
+		const __m256i leftOnly = _mm256_andnot_si256(up, left);
+		const __m256i neither = _mm256_andnot_si256(_mm256_or_si256(left, up), strong);
+		const __m256i e3 = E[n[0]], e7 = E[n[1]], e10 = E[n[2]], e11 = E[n[3]], e12 = E[n[4]], e13 = E[n[5]], e14 = E[n[6]], e15 = E[n[7]];
+		E[n[5]] = select_AVX2(e13, interpolate_AVX2<3,2>(e13, px), left);
+		E[n[4]] = select_AVX2(e12, interpolate_AVX2<1,2>(e12, px), left);
+		E[n[7]] = select_AVX2(select_AVX2(e15, interpolate_AVX2<1,1>(e15, px), weak), px, strong);
+		__m256i v = select_AVX2(e14, interpolate_AVX2<1,1>(e14, px), neither);
+		v = select_AVX2(v, interpolate_AVX2<3,2>(e14, px), upOnly);
+		E[n[6]] = select_AVX2(v, px, left);
+		v = select_AVX2(e11, interpolate_AVX2<1,1>(e11, px), neither);
+		v = select_AVX2(v, interpolate_AVX2<3,2>(e11, px), leftOnly);
+		E[n[3]] = select_AVX2(v, px, up);
+		v = select_AVX2(e10, interpolate_AVX2<1,2>(e10, px), _mm256_or_si256(leftOnly, upOnly));
+		E[n[2]] = select_AVX2(v, E[n[4]], leftUp);
+		E[n[0]] = select_AVX2(select_AVX2(e3, interpolate_AVX2<1,2>(e3, px), upOnly), E[n[4]], leftUp);
+		E[n[1]] = select_AVX2(select_AVX2(e7, interpolate_AVX2<3,2>(e7, px), upOnly), E[n[5]], leftUp);
+	}
+}
+
+// interleaves the subpixels a, b and c of the 4 pixels of each 128 bits lane
+TARGET_AVX2 static inline void interleave3_AVX2(__m256i a, __m256i b, __m256i c, __m256i *v) {
+	v[0] = _mm256_blend_epi32(_mm256_blend_epi32(_mm256_shuffle_epi32(a, _MM_SHUFFLE(1, 0, 0, 0)), _mm256_shuffle_epi32(b, 0), 0x22), _mm256_shuffle_epi32(c, 0), 0x44);
+	v[1] = _mm256_blend_epi32(_mm256_blend_epi32(_mm256_shuffle_epi32(b, _MM_SHUFFLE(2, 1, 1, 1)), _mm256_shuffle_epi32(c, _MM_SHUFFLE(1, 1, 1, 1)), 0x22), _mm256_shuffle_epi32(a, _MM_SHUFFLE(2, 2, 2, 2)), 0x44);
+	v[2] = _mm256_blend_epi32(_mm256_blend_epi32(_mm256_shuffle_epi32(c, _MM_SHUFFLE(3, 2, 2, 2)), _mm256_shuffle_epi32(a, _MM_SHUFFLE(3, 3, 3, 3)), 0x22), _mm256_shuffle_epi32(b, _MM_SHUFFLE(3, 3, 3, 3)), 0x44);
+}
+
+// filters the 8 pixels at 'x'
+template <int N>
+TARGET_AVX2 static inline void filterPixels_AVX2(uint32_t *E, int dstPitch, const XbrRows *rows, int x) {
+	__m256i yuv[kGridSize * kGridSize];
+	__m256i color[kGridSize * kGridSize];
+	for (int j = 0; j < kGridSize; ++j) {
+		for (int i = 0; i < kGridSize; ++i) {
+			yuv[j * kGridSize + i] = _mm256_loadu_si256((const __m256i *)(rows->_yuv[j] + x + i - 2));
+			color[j * kGridSize + i] = _mm256_loadu_si256((const __m256i *)(rows->_color[j] + x + i - 2));
+		}
+	}
+	__m256i sub[N * N];
+	for (int k = 0; k < N * N; ++k) {
+		sub[k] = color[kGridPE];
+	}
+	for (int r = 0; r < 4; ++r) {
+		filterRotation_AVX2<N>(sub, yuv, color, _rotationPixels[r], _rotationSubPixels[N - 2][r]);
+	}
+	// the 128 bits lanes hold the pixels 0-3 and 4-7
+	if (N == 2) {
+		for (int j = 0; j < N; ++j) {
+			const __m256i lo = _mm256_unpacklo_epi32(sub[j * N], sub[j * N + 1]);
+			const __m256i hi = _mm256_unpackhi_epi32(sub[j * N], sub[j * N + 1]);
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch),     _mm256_permute2x128_si256(lo, hi, 0x20));
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch + 8), _mm256_permute2x128_si256(lo, hi, 0x31));
+		}
+	} else if (N == 4) {
+		for (int j = 0; j < N; ++j) {
+			const __m256i t0 = _mm256_unpacklo_epi32(sub[j * N],     sub[j * N + 1]);
+			const __m256i t1 = _mm256_unpacklo_epi32(sub[j * N + 2], sub[j * N + 3]);
+			const __m256i t2 = _mm256_unpackhi_epi32(sub[j * N],     sub[j * N + 1]);
+			const __m256i t3 = _mm256_unpackhi_epi32(sub[j * N + 2], sub[j * N + 3]);
+			const __m256i p0 = _mm256_unpacklo_epi64(t0, t1);
+			const __m256i p1 = _mm256_unpackhi_epi64(t0, t1);
+			const __m256i p2 = _mm256_unpacklo_epi64(t2, t3);
+			const __m256i p3 = _mm256_unpackhi_epi64(t2, t3);
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch),      _mm256_permute2x128_si256(p0, p1, 0x20));
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch + 8),  _mm256_permute2x128_si256(p2, p3, 0x20));
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch + 16), _mm256_permute2x128_si256(p0, p1, 0x31));
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch + 24), _mm256_permute2x128_si256(p2, p3, 0x31));
+		}
+	} else if (N == 3) {
+		for (int j = 0; j < N; ++j) {
+			__m256i v[3];
+			interleave3_AVX2(sub[j * N], sub[j * N + 1], sub[j * N + 2], v);
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch),      _mm256_permute2x128_si256(v[0], v[1], 0x20));
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch + 8),  _mm256_permute2x128_si256(v[2], v[0], 0x30));
+			_mm256_storeu_si256((__m256i *)(E + j * dstPitch + 16), _mm256_permute2x128_si256(v[1], v[2], 0x31));
+		}
+	}
+}
+
+template <int N>
+TARGET_AVX2 static void scaleRows_AVX2(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette) {
+	XbrRows rows;
+	if (!rows.allocate(w, y1)) {
+		scaleRows_C<N>(dst, dstPitch, src, srcPitch, w, h, y1, y2, palette);
+		return;
+	}
+	int index[N * 8];
+	initPermute_AVX2<N>(index);
+	__m256i permute[N];
+	for (int k = 0; k < N; ++k) {
+		permute[k] = _mm256_loadu_si256((const __m256i *)(index + k * 8));
+	}
+	for (int y = y1; y < y2; ++y) {
+		uint32_t *E = dst + y * dstPitch * N;
+		const uint8_t *sa[5];
+		setupRows(src, srcPitch, y, h, sa);
+		rows.setup(src, srcPitch, w, h, y, palette);
+		int x = 0;
+		if (w > 0) {
+			scalePixel<N>(E, dstPitch, sa, x++, w, palette);
+		}
+		for (; x + 32 < w; x += 32) {
+			const uint32_t edges = classifyPixels_AVX2(sa, x);
+			for (int i = 0; i < 32; i += 8) {
+				if (edges & (255U << i)) {
+					filterPixels_AVX2<N>(E + (x + i) * N, dstPitch, &rows, x + i);
+				} else {
+					fillPixels_AVX2<N>(E + (x + i) * N, dstPitch, _mm256_loadu_si256((const __m256i *)(rows._color[2] + x + i)), permute);
+				}
 			}
+		}
+		for (; x < w; ++x) {
+			scalePixel<N>(E, dstPitch, sa, x, w, palette);
+		}
+	}
+	free(rows._buffer);
+}
+
+#endif
 
-			++sa0;
-			++sa1;
-			++sa2;
-			++sa3;
-			++sa4;
+#ifdef SIMD_NEON
 
-			E += N;
+template <int N>
+static inline void fillPixels_NEON(uint32_t *E, int dstPitch, uint32x4_t colors, const uint8x16_t *shuffle) {
+	for (int k = 0; k < N; ++k) {
+		const uint32x4_t v = vreinterpretq_u32_u8(vqtbl1q_u8(vreinterpretq_u8_u32(colors), shuffle[k]));
+		for (int j = 0; j < N; ++j) {
+			vst1q_u32(E + j * dstPitch + k * 4, v);
 		}
 	}
 }
 
+// returns a mask of the pixels with the same color as their neighbours
+static inline uint8x16_t classifyPixels_NEON(const uint8_t **sa, int x) {
+	const uint8x16_t pe = vld1q_u8(sa[2] + x + 2);
+	const uint8x16_t eqB = vceqq_u8(pe, vld1q_u8(sa[1] + x + 2));
+	const uint8x16_t eqD = vceqq_u8(pe, vld1q_u8(sa[2] + x + 1));
+	const uint8x16_t eqF = vceqq_u8(pe, vld1q_u8(sa[2] + x + 3));
+	const uint8x16_t eqH = vceqq_u8(pe, vld1q_u8(sa[3] + x + 2));
+	uint8x16_t flat = vandq_u8(vorrq_u8(eqH, eqF), vorrq_u8(eqF, eqB));
+	return vandq_u8(flat, vandq_u8(vorrq_u8(eqB, eqD), vorrq_u8(eqD, eqH)));
+}
+
+static inline uint32x4_t diff_NEON(uint32x4_t a, uint32x4_t b) {
+	return vpaddlq_u16(vpaddlq_u8(vabdq_u8(vreinterpretq_u8_u32(a), vreinterpretq_u8_u32(b))));
+}
+
+template <int M, int S>
+static inline uint32x4_t interpolate_NEON(uint32x4_t a, uint32x4_t b) {
+	const uint32x4_t mask = vdupq_n_u32(0xFF00FF);
+
+	const uint32x4_t a_rb = vandq_u32(a, mask);
+	const uint32x4_t a_ag = vandq_u32(vshrq_n_u32(a, 8), mask);
+
+	const uint32x4_t b_rb = vandq_u32(b, mask);
+	const uint32x4_t b_ag = vandq_u32(vshrq_n_u32(b, 8), mask);
+
+	uint32x4_t d1 = vsubq_u32(b_rb, a_rb);
+	uint32x4_t d2 = vsubq_u32(b_ag, a_ag);
+	if (M != 1) {
+		d1 = vmulq_n_u32(d1, M);
+		d2 = vmulq_n_u32(d2, M);
+	}
+	const uint32x4_t m1 = vandq_u32(vaddq_u32(vshrq_n_u32(d1, S), a_rb), mask);
+	const uint32x4_t m2 = vandq_u32(vaddq_u32(vshrq_n_u32(d2, S), a_ag), mask);
+
+	return vorrq_u32(m1, vshlq_n_u32(m2, 8));
+}
+
+static inline uint32x4_t select_NEON(uint32x4_t a, uint32x4_t b, uint32x4_t mask) {
+	return vbslq_u32(mask, b, a);
+}
+
+template <int N>
+static inline void filterRotation_NEON(uint32x4_t *E, const uint32x4_t *yuv, const uint32x4_t *color, const uint8_t *p, const uint8_t *n) {
+	const uint32x4_t cE = color[p[kPE]];
+	const uint32x4_t cH = color[p[kPH]];
+	const uint32x4_t cF = color[p[kPF]];
+	const uint32x4_t unchanged = vorrq_u32(vceqq_u32(cE, cH), vceqq_u32(cE, cF));
+	if (vminvq_u32(unchanged) != 0) {
+		return;
+	}
+
+	const uint32x4_t dEC = diff_NEON(yuv[p[kPE]], yuv[p[kPC]]);
+	const uint32x4_t dEG = diff_NEON(yuv[p[kPE]], yuv[p[kPG]]);
+	const uint32x4_t dEI = diff_NEON(yuv[p[kPE]], yuv[p[kPI]]);
+	const uint32x4_t dEF = diff_NEON(yuv[p[kPE]], yuv[p[kPF]]);
+	const uint32x4_t dEH = diff_NEON(yuv[p[kPE]], yuv[p[kPH]]);
+	const uint32x4_t dIH5 = diff_NEON(yuv[p[kPI]], yuv[p[kH5]]);
+	const uint32x4_t dIF4 = diff_NEON(yuv[p[kPI]], yuv[p[kF4]]);
+	const uint32x4_t dHF = diff_NEON(yuv[p[kPH]], yuv[p[kPF]]);
+	const uint32x4_t dHD = diff_NEON(yuv[p[kPH]], yuv[p[kPD]]);
+	const uint32x4_t dHI5 = diff_NEON(yuv[p[kPH]], yuv[p[kI5]]);
+	const uint32x4_t dFI4 = diff_NEON(yuv[p[kPF]], yuv[p[kI4]]);
+	const uint32x4_t dFB = diff_NEON(yuv[p[kPF]], yuv[p[kPB]]);
+
+	const uint32x4_t e = vaddq_u32(vaddq_u32(vaddq_u32(dEC, dEG), vaddq_u32(dIH5, dIF4)), vshlq_n_u32(dHF, 2));
+	const uint32x4_t i = vaddq_u32(vaddq_u32(vaddq_u32(dHD, dHI5), vaddq_u32(dFI4, dFB)), vshlq_n_u32(dEI, 2));
+	const uint32x4_t blend = vmvnq_u32(vorrq_u32(unchanged, vcgtq_u32(e, i)));
+	if (vmaxvq_u32(blend) == 0) {
+		return;
+	}
+	const uint32x4_t px = select_NEON(cF, cH, vcgtq_u32(dEF, dEH));
+
+	const uint32x4_t k155 = vdupq_n_u32(155);
+	const uint32x4_t eqFB = vcltq_u32(dFB, k155);
+	const uint32x4_t eqHD = vcltq_u32(dHD, k155);
+	const uint32x4_t eqEI = vcltq_u32(dEI, k155);
+	const uint32x4_t eqFI4 = vcltq_u32(dFI4, k155);
+	const uint32x4_t eqHI5 = vcltq_u32(dHI5, k155);
+	const uint32x4_t eqEG = vcltq_u32(dEG, k155);
+	const uint32x4_t eqEC = vcltq_u32(dEC, k155);
+	uint32x4_t cond;
+	if (N == 3) {
+		const uint32x4_t eqFC = vcltq_u32(diff_NEON(yuv[p[kPF]], yuv[p[kPC]]), k155);
+		const uint32x4_t eqHG = vcltq_u32(diff_NEON(yuv[p[kPH]], yuv[p[kPG]]), k155);
+		const uint32x4_t eqFF4 = vcltq_u32(diff_NEON(yuv[p[kPF]], yuv[p[kF4]]), k155);
+		const uint32x4_t eqHH5 = vcltq_u32(diff_NEON(yuv[p[kPH]], yuv[p[kH5]]), k155);
+		cond = vorrq_u32(vmvnq_u32(vorrq_u32(eqFB, eqFC)), vmvnq_u32(vorrq_u32(eqHD, eqHG)));
+		cond = vorrq_u32(cond, vbicq_u32(eqEI, vorrq_u32(eqFF4, eqFI4)));
+		cond = vorrq_u32(cond, vmvnq_u32(vorrq_u32(eqHH5, eqHI5)));
+	} else {
+		cond = vmvnq_u32(vorrq_u32(eqFB, eqHD));
+		cond = vorrq_u32(cond, vbicq_u32(eqEI, vorrq_u32(eqFI4, eqHI5)));
+	}
+	cond = vorrq_u32(cond, vorrq_u32(eqEG, eqEC));
+
+	const uint32x4_t strong = vandq_u32(vandq_u32(blend, vcgtq_u32(i, e)), cond);
+	const uint32x4_t cG = color[p[kPG]];
+	const uint32x4_t cC = color[p[kPC]];
+	const uint32x4_t ke = diff_NEON(yuv[p[kPF]], yuv[p[kPG]]);
+	const uint32x4_t ki = diff_NEON(yuv[p[kPH]], yuv[p[kPC]]);
+	const uint32x4_t notLeft = vorrq_u32(vcgtq_u32(vshlq_n_u32(ke, 1), ki), vorrq_u32(vceqq_u32(cE, cG), vceqq_u32(color[p[kPD]], cG)));
+	const uint32x4_t notUp = vorrq_u32(vcgtq_u32(vshlq_n_u32(ki, 1), ke), vorrq_u32(vceqq_u32(cE, cC), vceqq_u32(color[p[kPB]], cC)));
+	const uint32x4_t left = vbicq_u32(strong, notLeft);
+	const uint32x4_t up = vbicq_u32(strong, notUp);
+	const uint32x4_t leftUp = vandq_u32(left, up);
+	const uint32x4_t upOnly = vbicq_u32(up, left);
+	const uint32x4_t weak = vbicq_u32(blend, strong);
+
+	if (N == 2) {
+		const uint32x4_t e1 = E[n[0]], e2 = E[n[1]], e3 = E[n[2]];
+		uint32x4_t v = select_NEON(e3, interpolate_NEON<1,1>(e3, px), blend);
+		v = select_NEON(v, interpolate_NEON<3,2>(e3, px), vorrq_u32(left, up));
+		E[n[2]] = select_NEON(v, interpolate_NEON<7,3>(e3, px), leftUp);
+		E[n[1]] = select_NEON(e2, interpolate_NEON<1,2>(e2, px), left);
+		E[n[0]] = select_NEON(select_NEON(e1, interpolate_NEON<1,2>(e1, px), upOnly), E[n[1]], leftUp);
+	} else if (N == 3) {
+		const uint32x4_t leftOnly = vbicq_u32(left, up);
+		const uint32x4_t neither = vbicq_u32(strong, vorrq_u32(left, up));
+		const uint32x4_t e2 = E[n[0]], e5 = E[n[1]], e6 = E[n[2]], e7 = E[n[3]], e8 = E[n[4]];
+		uint32x4_t v = select_NEON(e7, interpolate_NEON<1,3>(e7, px), neither);
+		v = select_NEON(v, interpolate_NEON<1,2>(e7, px), upOnly);
+		E[n[3]] = select_NEON(v, interpolate_NEON<3,2>(e7, px), left);
+		E[n[2]] = select_NEON(e6, interpolate_NEON<1,2>(e6, px), left);
+		v = select_NEON(e5, interpolate_NEON<1,3>(e5, px), neither);
+		v = select_NEON(v, interpolate_NEON<3,2>(e5, px), upOnly);
+		v = select_NEON(v, interpolate_NEON<1,2>(e5, px), leftOnly);
+		E[n[1]] = select_NEON(v, E[n[3]], leftUp);
+		E[n[0]] = select_NEON(select_NEON(e2, interpolate_NEON<1,2>(e2, px), upOnly), E[n[2]], leftUp);
+		v = select_NEON(e8, interpolate_NEON<1,1>(e8, px), weak);
+		v = select_NEON(v, interpolate_NEON<7,3>(e8, px), neither);
+		E[n[4]] = select_NEON(v, px, vorrq_u32(left, up));
+	} else if (N == 4) {
+		const uint32x4_t leftOnly = vbicq_u32(left, up);
+		const uint32x4_t neither = vbicq_u32(strong, vorrq_u32(left, up));
+		const uint32x4_t e3 = E[n[0]], e7 = E[n[1]], e10 = E[n[2]], e11 = E[n[3]], e12 = E[n[4]], e13 = E[n[5]], e14 = E[n[6]], e15 = E[n[7]];
+		E[n[5]] = select_NEON(e13, interpolate_NEON<3,2>(e13, px), left);
+		E[n[4]] = select_NEON(e12, interpolate_NEON<1,2>(e12, px), left);
+		E[n[7]] = select_NEON(select_NEON(e15, interpolate_NEON<1,1>(e15, px), weak), px, strong);
+		uint32x4_t v = select_NEON(e14, interpolate_NEON<1,1>(e14, px), neither);
+		v = select_NEON(v, interpolate_NEON<3,2>(e14, px), upOnly);
+		E[n[6]] = select_NEON(v, px, left);
+		v = select_NEON(e11, interpolate_NEON<1,1>(e11, px), neither);
+		v = select_NEON(v, interpolate_NEON<3,2>(e11, px), leftOnly);
+		E[n[3]] = select_NEON(v, px, up);
+		v = select_NEON(e10, interpolate_NEON<1,2>(e10, px), vorrq_u32(leftOnly, upOnly));
+		E[n[2]] = select_NEON(v, E[n[4]], leftUp);
+		E[n[0]] = select_NEON(select_NEON(e3, interpolate_NEON<1,2>(e3, px), upOnly), E[n[4]], leftUp);
+		E[n[1]] = select_NEON(select_NEON(e7, interpolate_NEON<3,2>(e7, px), upOnly), E[n[5]], leftUp);
+	}
+}
+
+// filters the 4 pixels at 'x'
+template <int N>
+static inline void filterPixels_NEON(uint32_t *E, int dstPitch, const XbrRows *rows, int x) {
+	uint32x4_t yuv[kGridSize * kGridSize];
+	uint32x4_t color[kGridSize * kGridSize];
+	for (int j = 0; j < kGridSize; ++j) {
+		for (int i = 0; i < kGridSize; ++i) {
+			yuv[j * kGridSize + i] = vld1q_u32(rows->_yuv[j] + x + i - 2);
+			color[j * kGridSize + i] = vld1q_u32(rows->_color[j] + x + i - 2);
+		}
+	}
+	uint32x4_t sub[N * N];
+	for (int k = 0; k < N * N; ++k) {
+		sub[k] = color[kGridPE];
+	}
+	for (int r = 0; r < 4; ++r) {
+		filterRotation_NEON<N>(sub, yuv, color, _rotationPixels[r], _rotationSubPixels[N - 2][r]);
+	}
+	// the interleaving stores write the N subpixels of each pixel
+	for (int j = 0; j < N; ++j) {
+		if (N == 2) {
+			uint32x4x2_t v;
+			v.val[0] = sub[j * N];
+			v.val[1] = sub[j * N + 1];
+			vst2q_u32(E + j * dstPitch, v);
+		} else if (N == 3) {
+			uint32x4x3_t v;
+			v.val[0] = sub[j * N];
+			v.val[1] = sub[j * N + 1];
+			v.val[2] = sub[j * N + 2];
+			vst3q_u32(E + j * dstPitch, v);
+		} else if (N == 4) {
+			uint32x4x4_t v;
+			v.val[0] = sub[j * N];
+			v.val[1] = sub[j * N + 1];
+			v.val[2] = sub[j * N + 2];
+			v.val[3] = sub[j * N + 3];
+			vst4q_u32(E + j * dstPitch, v);
+		}
+	}
+}
+
+template <int N>
+static void scaleRows_NEON(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette) {
+	XbrRows rows;
+	if (!rows.allocate(w, y1)) {
+		scaleRows_C<N>(dst, dstPitch, src, srcPitch, w, h, y1, y2, palette);
+		return;
+	}
+	uint8_t mask[N * 16];
+	initShuffle<N>(mask);
+	uint8x16_t shuffle[N];
+	for (int k = 0; k < N; ++k) {
+		shuffle[k] = vld1q_u8(mask + k * 16);
+	}
+	for (int y = y1; y < y2; ++y) {
+		uint32_t *E = dst + y * dstPitch * N;
+		const uint8_t *sa[5];
+		setupRows(src, srcPitch, y, h, sa);
+		rows.setup(src, srcPitch, w, h, y, palette);
+		int x = 0;
+		if (w > 0) {
+			scalePixel<N>(E, dstPitch, sa, x++, w, palette);
+		}
+		for (; x + 16 < w; x += 16) {
+			uint32_t flat[4];
+			vst1q_u32(flat, vreinterpretq_u32_u8(classifyPixels_NEON(sa, x)));
+			for (int i = 0; i < 4; ++i) {
+				if (flat[i] != 0xFFFFFFFF) {
+					filterPixels_NEON<N>(E + (x + i * 4) * N, dstPitch, &rows, x + i * 4);
+				} else {
+					fillPixels_NEON<N>(E + (x + i * 4) * N, dstPitch, vld1q_u32(rows._color[2] + x + i * 4), shuffle);
+				}
+			}
+		}
+		for (; x < w; ++x) {
+			scalePixel<N>(E, dstPitch, sa, x, w, palette);
+		}
+	}
+	free(rows._buffer);
+}
+
+#endif
+
+template <int N>
+static ScaleRowsProc getScaleRowsProc(uint32_t cpuFeatures, const char **name) {
+	const char *procName = "c";
+	ScaleRowsProc proc = scaleRows_C<N>;
+#ifdef SIMD_X86
+	if (cpuFeatures & kCpuFeatureAvx2) {
+		procName = "avx2";
+		proc = scaleRows_AVX2<N>;
+	} else if (cpuFeatures & kCpuFeatureSse41) {
+		procName = "sse41";
+		proc = scaleRows_SSE41<N>;
+	}
+#endif
+#ifdef SIMD_NEON
+	if (cpuFeatures & kCpuFeatureNeon) {
+		procName = "neon";
+		proc = scaleRows_NEON<N>;
+	}
+#endif
+	if (name) {
+		*name = procName;
+	}
+	return proc;
+}
+
+ScaleRowsProc getScaleRowsProc_xbr(int factor, uint32_t cpuFeatures, const char **name) {
+	switch (factor) {
+	case 2:
+		return getScaleRowsProc<2>(cpuFeatures, name);
+	case 3:
+		return getScaleRowsProc<3>(cpuFeatures, name);
+	case 4:
+		return getScaleRowsProc<4>(cpuFeatures, name);
+	}
+	return 0;
+}
+
+template <int N>
+static void scaleRows_xbr(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, int y1, int y2, const uint32_t *palette) {
+	static const ScaleRowsProc proc = getScaleRowsProc<N>(getCpuFeatures(), 0);
+	(*proc)(dst, dstPitch, src, srcPitch, w, h, y1, y2, palette);
+}
+
+template <int N>
+static void scale_xbr(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *palette) {
+	scaleRows_xbr<N>(dst, dstPitch, src, srcPitch, w, h, 0, h, palette);
+}
+
 static void palette_xbr(const uint32_t *palette) {
 	for (int i = 0; i < 256; ++i) {
 		const int r = (palette[i] >> 16) & 255;
@@ -257,6 +1177,7 @@ static void palette_xbr(const uint32_t *palette) {
 		_yuv[i][0] = ( 299 * r + 587 * g + 114 * b) / 1000;
 		_yuv[i][1] = (-169 * r - 331 * g + 500 * b) / 1000 + 128;
 		_yuv[i][2] = ( 500 * r - 419 * g -  81 * b) / 1000 + 128;
+		_yuvPacked[i] = _yuv[i][0] | (_yuv[i][1] << 8) | (_yuv[i][2] << 16);
 	}
 	for (int j = 0; j < 256; ++j) {
 		for (int i = 0; i < j; ++i) {
@@ -279,5 +1200,6 @@ const Scaler scaler_xbr = {
 	"xbr",
 	2, 4,
 	palette_xbr,
-	{ scale_xbr<2>, scale_xbr<3>, scale_xbr<4> }
+	{ scale_xbr<2>, scale_xbr<3>, scale_xbr<4> },
+	{ scaleRows_xbr<2>, scaleRows_xbr<3>, scaleRows_xbr<4> }
 };
@@ -0,0 +1,30 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef SIMD_H__
+#define SIMD_H__
+
+// the x86 kernels are compiled for their instruction set and selected at runtime with getCpuFeatures()
+
+#if (defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)) && !defined(DISABLE_SIMD)
+#define SIMD_X86
+#include <immintrin.h>
+#if defined(__GNUC__)
+#define TARGET_SSE2  __attribute__((target("sse2")))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2  __attribute__((target("avx2")))
+#else
+#define TARGET_SSE2
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+#endif
+
+#if (defined(__aarch64__) || defined(_M_ARM64)) && !defined(DISABLE_SIMD)
+#define SIMD_NEON
+#include <arm_neon.h>
+#endif
+
+#endif // SIMD_H__
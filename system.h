@@ -37,6 +37,8 @@ struct AudioCallback {
 	void *userdata;
 };
 
+typedef void (*WorkerProc)(void *userdata);
+
 struct System {
 	PlayerInput inp, pad;
 
@@ -46,6 +48,8 @@ struct System {
 	virtual void destroy() = 0;
 
 	virtual void setScaler(const char *name, int multiplier) = 0;
+	virtual void setScalerThreads(int count) = 0;
+	virtual void setRenderThread(bool enable) = 0;
 	virtual void setGamma(float gamma) = 0;
 
 	virtual void setPalette(const uint8_t *pal, int n, int depth) = 0;
@@ -56,10 +60,18 @@ struct System {
 	virtual void copyRectWidescreen(int w, int h, const uint8_t *buf, const uint8_t *pal) = 0;
 	virtual void shakeScreen(int dx, int dy) = 0;
 	virtual void updateScreen(bool drawWidescreen) = 0;
+	virtual int getDisplayRefreshRate() = 0; // 0 if unknown
 
 	virtual void processEvents() = 0;
 	virtual void sleep(int duration) = 0;
 	virtual uint32_t getTimeStamp() = 0;
+	virtual uint64_t getTimeStampNs() = 0; // monotonic
+	virtual void sleepUntilNs(uint64_t timeStampNs) = 0;
+
+	virtual void *createWorker(const char *name, WorkerProc proc, void *userdata) = 0; // 0 if there are no threads
+	virtual void startWorker(void *worker) = 0; // calls 'proc' on the worker thread
+	virtual void waitWorker(void *worker) = 0; // returns when 'proc' has returned
+	virtual void destroyWorker(void *worker) = 0;
 
 	virtual void startAudio(AudioCallback callback) = 0;
 	virtual void stopAudio() = 0;
@@ -72,6 +84,9 @@ extern void System_earlyInit();
 extern void System_printLog(FILE *, const char *s);
 extern void System_fatalError(const char *s);
 extern bool System_hasCommandLine();
+extern void System_setInputFile(const char *path); // headless
+extern void System_setMaxFrames(uint32_t count); // headless
+extern bool System_hasInputEnd(); // headless, false if the input never quits
 
 extern System *const g_system;
 
@@ -0,0 +1,423 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include <ctype.h>
+#include "system.h"
+#include "util.h"
+
+// System implementation without display, audio or input devices.
+//
+// Time is simulated : sleep() advances the clock and runs the audio callback
+// for the corresponding number of samples. Input is read from a text script,
+// one key mask per processEvents() call. The menus and cutscenes also call
+// processEvents(), .dem recordings are indexed by level frame and are replayed
+// with --demo instead. The run ends on a 'quit' entry or after --frames calls.
+
+static const uint32_t _demTag = 0x31434552; // 'REC1'
+
+struct InputScriptEntry {
+	uint32_t frame;
+	uint8_t mask;
+	uint8_t flags;
+};
+
+enum {
+	kInputFlagSkip = 1 << 0,
+	kInputFlagExit = 1 << 1,
+	kInputFlagQuit = 1 << 2,
+	kInputFlagScreenshot = 1 << 3
+};
+
+struct System_Headless : System {
+	enum {
+		kAudioHz = 22050,
+		kAudioBufferSamples = 4096 // stereo
+	};
+
+	uint8_t *_offscreen;
+	uint32_t _pal[256];
+	int _screenW, _screenH;
+	int _shakeDx, _shakeDy;
+	uint32_t _timeStamp;
+	uint32_t _audioFrac;
+	AudioCallback _audioCb;
+	bool _audioStarted;
+	int16_t _audioBuffer[kAudioBufferSamples];
+	InputScriptEntry *_inputScript;
+	int _inputScriptSize;
+	int _inputScriptPos;
+	uint32_t _frameCounter;
+	uint32_t _maxFrames; // 0 if not limited
+
+	System_Headless();
+	virtual ~System_Headless();
+	virtual void init(const char *title, int w, int h, bool fullscreen, bool widescreen, bool yuv);
+	virtual void destroy();
+	virtual void setScaler(const char *name, int multiplier);
+	virtual void setScalerThreads(int count);
+	virtual void setRenderThread(bool enable);
+	virtual void setGamma(float gamma);
+	virtual void setPalette(const uint8_t *pal, int n, int depth);
+	virtual void clearPalette();
+	virtual void copyRect(int x, int y, int w, int h, const uint8_t *buf, int pitch);
+	virtual void copyYuv(int w, int h, const uint8_t *y, int ypitch, const uint8_t *u, int upitch, const uint8_t *v, int vpitch);
+	virtual void fillRect(int x, int y, int w, int h, uint8_t color);
+	virtual void copyRectWidescreen(int w, int h, const uint8_t *buf, const uint8_t *pal);
+	virtual void shakeScreen(int dx, int dy);
+	virtual void updateScreen(bool drawWidescreen);
+	virtual int getDisplayRefreshRate();
+	virtual void processEvents();
+	virtual void sleep(int duration);
+	virtual uint32_t getTimeStamp();
+	virtual uint64_t getTimeStampNs();
+	virtual void sleepUntilNs(uint64_t timeStampNs);
+
+	virtual void *createWorker(const char *name, WorkerProc proc, void *userdata);
+	virtual void startWorker(void *worker);
+	virtual void waitWorker(void *worker);
+	virtual void destroyWorker(void *worker);
+
+	virtual void startAudio(AudioCallback callback);
+	virtual void stopAudio();
+	virtual void lockAudio();
+	virtual void unlockAudio();
+	virtual AudioCallback setAudioCallback(AudioCallback callback);
+
+	void addInputScriptEntry(uint32_t frame, uint8_t mask, uint8_t flags);
+	bool loadInputScript(FILE *fp);
+	void mixAudio(int samples);
+};
+
+static System_Headless system_headless;
+System *const g_system = &system_headless;
+
+void System_printLog(FILE *fp, const char *s) {
+	if (fp == stderr) {
+		fprintf(stderr, "WARNING: %s\n", s);
+	} else {
+		fprintf(fp, "%s\n", s);
+	}
+}
+
+void System_fatalError(const char *s) {
+	fprintf(stderr, "ERROR: %s\n", s);
+	exit(-1);
+}
+
+bool System_hasCommandLine() {
+	return true;
+}
+
+System_Headless::System_Headless() :
+	_offscreen(0), _timeStamp(0), _audioFrac(0), _audioStarted(false),
+	_inputScript(0), _inputScriptSize(0), _inputScriptPos(0), _frameCounter(0), _maxFrames(0) {
+	memset(&_audioCb, 0, sizeof(_audioCb));
+}
+
+System_Headless::~System_Headless() {
+	free(_inputScript);
+}
+
+void System_Headless::init(const char *title, int w, int h, bool fullscreen, bool widescreen, bool yuv) {
+	memset(&inp, 0, sizeof(inp));
+	memset(&pad, 0, sizeof(pad));
+	_screenW = w;
+	_screenH = h;
+	_shakeDx = _shakeDy = 0;
+	memset(_pal, 0, sizeof(_pal));
+	_offscreen = (uint8_t *)calloc(w * h, 1);
+	if (!_offscreen) {
+		error("System_Headless::init() Unable to allocate offscreen buffer");
+	}
+}
+
+void System_Headless::destroy() {
+	free(_offscreen);
+	_offscreen = 0;
+}
+
+void System_Headless::setScaler(const char *name, int multiplier) {
+}
+
+void System_Headless::setScalerThreads(int count) {
+}
+
+void System_Headless::setRenderThread(bool enable) {
+}
+
+void System_Headless::setGamma(float gamma) {
+}
+
+void System_Headless::setPalette(const uint8_t *pal, int n, int depth) {
+	assert(n <= 256);
+	assert(depth <= 8);
+	const int shift = 8 - depth;
+	for (int i = 0; i < n; ++i) {
+		int r = pal[i * 3 + 0];
+		int g = pal[i * 3 + 1];
+		int b = pal[i * 3 + 2];
+		if (shift != 0) {
+			r = (r << shift) | (r >> (depth - shift));
+			g = (g << shift) | (g >> (depth - shift));
+			b = (b << shift) | (b >> (depth - shift));
+		}
+		_pal[i] = (r << 16) | (g << 8) | b;
+	}
+}
+
+void System_Headless::clearPalette() {
+	memset(_pal, 0, sizeof(_pal));
+}
+
+void System_Headless::copyRect(int x, int y, int w, int h, const uint8_t *buf, int pitch) {
+	assert(x >= 0 && x + w <= _screenW && y >= 0 && y + h <= _screenH);
+	for (int i = 0; i < h; ++i) {
+		memcpy(_offscreen + (y + i) * _screenW + x, buf, w);
+		buf += pitch;
+	}
+}
+
+void System_Headless::copyYuv(int w, int h, const uint8_t *y, int ypitch, const uint8_t *u, int upitch, const uint8_t *v, int vpitch) {
+}
+
+void System_Headless::fillRect(int x, int y, int w, int h, uint8_t color) {
+	assert(x >= 0 && x + w <= _screenW && y >= 0 && y + h <= _screenH);
+	for (int i = 0; i < h; ++i) {
+		memset(_offscreen + (y + i) * _screenW + x, color, w);
+	}
+}
+
+void System_Headless::copyRectWidescreen(int w, int h, const uint8_t *buf, const uint8_t *pal) {
+}
+
+void System_Headless::shakeScreen(int dx, int dy) {
+	_shakeDx = dx;
+	_shakeDy = dy;
+}
+
+void System_Headless::updateScreen(bool drawWidescreen) {
+	_shakeDx = _shakeDy = 0;
+}
+
+int System_Headless::getDisplayRefreshRate() {
+	return 0;
+}
+
+void System_Headless::processEvents() {
+	inp.prevMask = inp.mask;
+	inp.mask = 0;
+	inp.skip = inp.exit = false;
+	if (_inputScript) {
+		while (_inputScriptPos < _inputScriptSize && _inputScript[_inputScriptPos].frame <= _frameCounter) {
+			++_inputScriptPos;
+		}
+		if (_inputScriptPos == 0) {
+			// before the first entry, no key is pressed
+		} else {
+			const InputScriptEntry *entry = &_inputScript[_inputScriptPos - 1];
+			inp.mask = entry->mask;
+			inp.skip = (entry->flags & kInputFlagSkip) != 0;
+			inp.exit = (entry->flags & kInputFlagExit) != 0;
+			if (entry->flags & kInputFlagQuit) {
+				inp.quit = true;
+			}
+			if ((entry->flags & kInputFlagScreenshot) != 0 && entry->frame == _frameCounter) {
+				inp.screenshot = true;
+			}
+		}
+	}
+	if (_maxFrames != 0 && _frameCounter >= _maxFrames) {
+		inp.quit = true;
+	}
+	++_frameCounter;
+}
+
+void System_Headless::sleep(int duration) {
+	if (duration <= 0) {
+		return;
+	}
+	_timeStamp += duration;
+	if (_audioStarted && _audioCb.proc) {
+		_audioFrac += duration * kAudioHz;
+		const int samples = _audioFrac / 1000;
+		_audioFrac %= 1000;
+		mixAudio(samples);
+	}
+}
+
+uint32_t System_Headless::getTimeStamp() {
+	return _timeStamp;
+}
+
+uint64_t System_Headless::getTimeStampNs() {
+	return (uint64_t)_timeStamp * 1000000;
+}
+
+void System_Headless::sleepUntilNs(uint64_t timeStampNs) {
+	const uint64_t now = getTimeStampNs();
+	if (timeStampNs > now) {
+		sleep((timeStampNs - now + 999999) / 1000000);
+	}
+}
+
+void *System_Headless::createWorker(const char *name, WorkerProc proc, void *userdata) {
+	return 0;
+}
+
+void System_Headless::startWorker(void *worker) {
+}
+
+void System_Headless::waitWorker(void *worker) {
+}
+
+void System_Headless::destroyWorker(void *worker) {
+}
+
+void System_Headless::mixAudio(int samples) {
+	while (samples > 0) {
+		const int count = MIN(samples, (int)kAudioBufferSamples / 2);
+		memset(_audioBuffer, 0, count * 2 * sizeof(int16_t));
+		_audioCb.proc(_audioCb.userdata, _audioBuffer, count * 2);
+		samples -= count;
+	}
+}
+
+void System_Headless::startAudio(AudioCallback callback) {
+	_audioCb = callback;
+	_audioFrac = 0;
+	_audioStarted = true;
+}
+
+void System_Headless::stopAudio() {
+	_audioStarted = false;
+}
+
+void System_Headless::lockAudio() {
+}
+
+void System_Headless::unlockAudio() {
+}
+
+AudioCallback System_Headless::setAudioCallback(AudioCallback callback) {
+	AudioCallback cb = _audioCb;
+	_audioCb = callback;
+	return cb;
+}
+
+void System_Headless::addInputScriptEntry(uint32_t frame, uint8_t mask, uint8_t flags) {
+	if ((_inputScriptSize & 255) == 0) {
+		_inputScript = (InputScriptEntry *)realloc(_inputScript, (_inputScriptSize + 256) * sizeof(InputScriptEntry));
+		if (!_inputScript) {
+			error("Unable to allocate input script");
+		}
+	}
+	InputScriptEntry *entry = &_inputScript[_inputScriptSize++];
+	entry->frame = frame;
+	entry->mask = mask;
+	entry->flags = flags;
+}
+
+// one entry per line : frame number followed by the keys held from that frame
+// until the next entry, the keys of the last entry are held until 'quit'
+//   120 right run
+//   180 jump
+//   240 quit
+//   # comment
+bool System_Headless::loadInputScript(FILE *fp) {
+	static const struct {
+		const char *name;
+		uint8_t mask;
+		uint8_t flags;
+	} _keys[] = {
+		{ "up", SYS_INP_UP, 0 },
+		{ "right", SYS_INP_RIGHT, 0 },
+		{ "down", SYS_INP_DOWN, 0 },
+		{ "left", SYS_INP_LEFT, 0 },
+		{ "run", SYS_INP_RUN, 0 },
+		{ "jump", SYS_INP_JUMP, 0 },
+		{ "shoot", SYS_INP_SHOOT, 0 },
+		{ "esc", SYS_INP_ESC, 0 },
+		{ "skip", 0, kInputFlagSkip },
+		{ "exit", 0, kInputFlagExit },
+		{ "quit", 0, kInputFlagQuit },
+		{ "screenshot", 0, kInputFlagScreenshot },
+		{ 0, 0, 0 }
+	};
+	fseek(fp, 0, SEEK_SET);
+	char buf[256];
+	int line = 0;
+	while (fgets(buf, sizeof(buf), fp)) {
+		++line;
+		if (buf[0] == '#') {
+			continue;
+		}
+		char *p = strtok(buf, " \t\r\n");
+		if (!p) {
+			continue;
+		}
+		if (!isdigit(*p)) {
+			warning("Invalid frame number '%s' line %d", p, line);
+			return false;
+		}
+		const uint32_t frame = strtoul(p, 0, 10);
+		if (_inputScriptSize != 0 && frame < _inputScript[_inputScriptSize - 1].frame) {
+			warning("Unordered frame number %d line %d", frame, line);
+			return false;
+		}
+		uint8_t mask = 0;
+		uint8_t flags = 0;
+		while ((p = strtok(0, " \t\r\n")) != 0) {
+			int i = 0;
+			for (; _keys[i].name; ++i) {
+				if (strcasecmp(_keys[i].name, p) == 0) {
+					mask |= _keys[i].mask;
+					flags |= _keys[i].flags;
+					break;
+				}
+			}
+			if (!_keys[i].name) {
+				warning("Unknown key '%s' line %d", p, line);
+			}
+		}
+		addInputScriptEntry(frame, mask, flags);
+	}
+	return true;
+}
+
+void System_setInputFile(const char *path) {
+	FILE *fp = fopen(path, "rb");
+	if (!fp) {
+		warning("Unable to open input file '%s'", path);
+		return;
+	}
+	uint8_t tag[4];
+	if (fread(tag, 1, sizeof(tag), fp) == sizeof(tag) && READ_LE_UINT32(tag) == _demTag) {
+		warning("'%s' is a .dem recording, use --demo to replay it", path);
+	} else if (!system_headless.loadInputScript(fp)) {
+		system_headless._inputScriptSize = 0;
+	}
+	fclose(fp);
+	if (system_headless._inputScriptSize == 0) {
+		free(system_headless._inputScript);
+		system_headless._inputScript = 0;
+	}
+	debug(kDebug_GAME, "Loaded %d input entries from '%s'", system_headless._inputScriptSize, path);
+}
+
+void System_setMaxFrames(uint32_t count) {
+	system_headless._maxFrames = count;
+}
+
+bool System_hasInputEnd() {
+	if (system_headless._maxFrames != 0) {
+		return true;
+	}
+	for (int i = 0; i < system_headless._inputScriptSize; ++i) {
+		if (system_headless._inputScript[i].flags & kInputFlagQuit) {
+			return true;
+		}
+	}
+	return false;
+}
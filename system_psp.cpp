@@ -23,6 +23,8 @@ struct System_PSP : System {
 	virtual void init(const char *title, int w, int h, bool fullscreen, bool widescreen, bool yuv);
 	virtual void destroy();
 	virtual void setScaler(const char *name, int multiplier);
+	virtual void setScalerThreads(int count);
+	virtual void setRenderThread(bool enable);
 	virtual void setGamma(float gamma);
 	virtual void setPalette(const uint8_t *pal, int n, int depth);
 	virtual void clearPalette();
@@ -32,9 +34,17 @@ struct System_PSP : System {
 	virtual void copyRectWidescreen(int w, int h, const uint8_t *buf, const uint8_t *pal);
 	virtual void shakeScreen(int dx, int dy);
 	virtual void updateScreen(bool drawWidescreen);
+	virtual int getDisplayRefreshRate();
 	virtual void processEvents();
 	virtual void sleep(int duration);
 	virtual uint32_t getTimeStamp();
+	virtual uint64_t getTimeStampNs();
+	virtual void sleepUntilNs(uint64_t timeStampNs);
+
+	virtual void *createWorker(const char *name, WorkerProc proc, void *userdata);
+	virtual void startWorker(void *worker);
+	virtual void waitWorker(void *worker);
+	virtual void destroyWorker(void *worker);
 	virtual void startAudio(AudioCallback callback);
 	virtual void stopAudio();
 	virtual void lockAudio();
@@ -185,6 +195,12 @@ void System_PSP::destroy() {
 void System_PSP::setScaler(const char *name, int multiplier) {
 }
 
+void System_PSP::setScalerThreads(int count) {
+}
+
+void System_PSP::setRenderThread(bool enable) {
+}
+
 void System_PSP::setGamma(float gamma) {
 }
 
@@ -323,6 +339,10 @@ void System_PSP::updateScreen(bool drawWidescreen) {
 	sceGuSwapBuffers();
 }
 
+int System_PSP::getDisplayRefreshRate() {
+	return 0;
+}
+
 void System_PSP::processEvents() {
 	inp.prevMask = inp.mask;
 	inp.mask = 0;
@@ -381,6 +401,32 @@ uint32_t System_PSP::getTimeStamp() {
 	return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+uint64_t System_PSP::getTimeStampNs() {
+	struct timeval tv;
+	sceKernelLibcGettimeofday(&tv, 0);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+}
+
+void System_PSP::sleepUntilNs(uint64_t timeStampNs) {
+	const uint64_t now = getTimeStampNs();
+	if (timeStampNs > now) {
+		sceKernelDelayThread((timeStampNs - now) / 1000);
+	}
+}
+
+void *System_PSP::createWorker(const char *name, WorkerProc proc, void *userdata) {
+	return 0;
+}
+
+void System_PSP::startWorker(void *worker) {
+}
+
+void System_PSP::waitWorker(void *worker) {
+}
+
+void System_PSP::destroyWorker(void *worker) {
+}
+
 static void audioCallback(void *buf, unsigned int samples, void *userdata) { // 44100hz S16 stereo
 	int16_t buf22khz[samples];
 	memset(buf22khz, 0, sizeof(buf22khz));
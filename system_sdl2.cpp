@@ -6,8 +6,10 @@
 #include <SDL.h>
 #include <stdarg.h>
 #include <math.h>
+#include "palette.h"
 #include "scaler.h"
 #include "system.h"
+#include "trace.h"
 #include "util.h"
 
 static const char *kIconBmp = "icon.bmp";
@@ -16,29 +18,156 @@ static const char *kIconBmp = "icon.bmp";
 static bool axis[4]= { false, false, false, false };
 #endif
 
+static const bool kUseDirtyRects = true;
+static const int kWidescreenBlurScale = 4; // the widescreen background is blurred at a reduced resolution
+static const int kWidescreenBlurRadius = 8;
+static const int kScalerBorder = 2; // pixels read around each source pixel by the scalers
+static const uint64_t kSleepSpinNs = 1000000;
+
 static int _scalerMultiplier = 3;
 static const Scaler *_scaler = &scaler_xbr;
 static ScaleProc _scalerProc;
-
-const Scaler scaler_linear = {
-	"linear",
-	2, 4,
-	0,
-	{ 0, 0, 0 }
+static ScaleRowsProc _scaleRowsProc;
+static int _scalerThreadsCount = 0; // 0 uses one thread per CPU
+static ExpandPaletteProc _expandPaletteProc;
+static bool _renderThreadEnabled = false;
+
+static const int kMaxScalerThreads = 8;
+static const int kScalerBandMinRows = 16; // smaller bands are not worth waking up the threads
+
+// scales horizontal bands of the screen in parallel, the calling thread also scales one band
+struct ScalerThreads {
+	SDL_mutex *_mutex;
+	SDL_cond *_startCond;
+	SDL_cond *_doneCond;
+	SDL_Thread *_threads[kMaxScalerThreads];
+	int _threadsCount;
+	bool _quit;
+	int _bandsCount;
+	int _nextBand;
+	int _pendingBands;
+	ScaleRowsProc _proc;
+	uint32_t *_dst;
+	int _dstPitch;
+	const uint8_t *_src;
+	int _srcPitch;
+	int _w, _h;
+	const uint32_t *_palette;
+
+	void init(int count);
+	void fini();
+	bool scaleNextBand();
+	void scale(ScaleRowsProc proc, uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *palette);
 };
 
-const Scaler scaler_nearest = {
-	"nearest",
-	2, 4,
-	0,
-	{ 0, 0, 0 }
-};
+static int scalerThreadProc(void *userdata) {
+	traceThreadName("scaler", true);
+	ScalerThreads *st = (ScalerThreads *)userdata;
+	SDL_LockMutex(st->_mutex);
+	while (!st->_quit) {
+		if (!st->scaleNextBand()) {
+			SDL_CondWait(st->_startCond, st->_mutex);
+		}
+	}
+	SDL_UnlockMutex(st->_mutex);
+	return 0;
+}
+
+void ScalerThreads::init(int count) {
+	_mutex = SDL_CreateMutex();
+	_startCond = SDL_CreateCond();
+	_doneCond = SDL_CreateCond();
+	_threadsCount = 0;
+	_quit = false;
+	_bandsCount = _nextBand = _pendingBands = 0;
+	for (int i = 0; i < count - 1 && i < kMaxScalerThreads; ++i) {
+		_threads[i] = SDL_CreateThread(scalerThreadProc, "scaler", this);
+		if (!_threads[i]) {
+			warning("Unable to create scaler thread, %s", SDL_GetError());
+			break;
+		}
+		++_threadsCount;
+	}
+}
+
+void ScalerThreads::fini() {
+	if (!_mutex) {
+		return;
+	}
+	SDL_LockMutex(_mutex);
+	_quit = true;
+	SDL_CondBroadcast(_startCond);
+	SDL_UnlockMutex(_mutex);
+	for (int i = 0; i < _threadsCount; ++i) {
+		SDL_WaitThread(_threads[i], 0);
+	}
+	_threadsCount = 0;
+	SDL_DestroyCond(_doneCond);
+	_doneCond = 0;
+	SDL_DestroyCond(_startCond);
+	_startCond = 0;
+	SDL_DestroyMutex(_mutex);
+	_mutex = 0;
+}
+
+// called with _mutex locked, returns false if all the bands have been started
+bool ScalerThreads::scaleNextBand() {
+	if (_nextBand >= _bandsCount) {
+		return false;
+	}
+	const int band = _nextBand++;
+	SDL_UnlockMutex(_mutex);
+	// each band reads the 2 source rows above and below, the kernel clamps them to the image and not to the band
+	const int y1 = _h * band / _bandsCount;
+	const int y2 = _h * (band + 1) / _bandsCount;
+	traceBegin("scaleBand");
+	(*_proc)(_dst, _dstPitch, _src, _srcPitch, _w, _h, y1, y2, _palette);
+	traceEnd("scaleBand");
+	SDL_LockMutex(_mutex);
+	--_pendingBands;
+	if (_pendingBands == 0) {
+		SDL_CondSignal(_doneCond);
+	}
+	return true;
+}
 
-static const Scaler *_scalers[] = {
-	&scaler_linear,
-	&scaler_nearest,
-	&scaler_xbr,
-	0
+void ScalerThreads::scale(ScaleRowsProc proc, uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h, const uint32_t *palette) {
+	const int count = MIN(_threadsCount + 1, h / kScalerBandMinRows);
+	if (count <= 1) {
+		(*proc)(dst, dstPitch, src, srcPitch, w, h, 0, h, palette);
+		return;
+	}
+	SDL_LockMutex(_mutex);
+	_proc = proc;
+	_dst = dst;
+	_dstPitch = dstPitch;
+	_src = src;
+	_srcPitch = srcPitch;
+	_w = w;
+	_h = h;
+	_palette = palette;
+	_bandsCount = count;
+	_nextBand = 0;
+	_pendingBands = count;
+	SDL_CondBroadcast(_startCond);
+	while (scaleNextBand()) {
+	}
+	while (_pendingBands != 0) {
+		SDL_CondWait(_doneCond, _mutex);
+	}
+	SDL_UnlockMutex(_mutex);
+}
+
+static const int kRenderFramesCount = 3; // written by the game thread, waiting for the render thread and rendered
+
+// the screen pixels and state published by the game thread to the renderer
+struct RenderFrame {
+	uint8_t *buffer;
+	uint32_t *palette;
+	int shakeDx, shakeDy;
+	bool drawWidescreen;
+	uint32_t *widescreen; // blurred background, updated when the version changes
+	uint32_t widescreenVersion;
 };
 
 struct KeyMapping {
@@ -54,6 +183,10 @@ struct System_SDL2 : System {
 	};
 
 	uint8_t *_offscreenLut;
+	uint8_t *_textureLut; // offscreen pixels converted to the texture
+	int _dirtyTileW;
+	bool _fullScreenUpdate;
+	uint32_t *_scaleBuffer;
 	SDL_Window *_window;
 	SDL_Renderer *_renderer;
 	SDL_Texture *_texture;
@@ -64,18 +197,40 @@ struct System_SDL2 : System {
 	int _screenW, _screenH;
 	int _shakeDx, _shakeDy;
 	SDL_Texture *_widescreenTexture;
+	uint32_t *_widescreenBuffer;
+	uint8_t *_widescreenBitmap; // indexes and palette of the blurred background
+	uint8_t _widescreenPalette[256 * 3];
+	bool _widescreenCached;
+	uint32_t *_widescreenPixels;
+	uint32_t _widescreenVersion;
+	uint32_t _widescreenTextureVersion;
+	uint32_t _texturePal[256]; // palette of the texture pixels
 	KeyMapping _keyMappings[kKeyMappingsSize];
 	int _keyMappingsCount;
 	AudioCallback _audioCb;
 	uint8_t _gammaLut[256];
 	SDL_GameController *_controller;
 	SDL_Joystick *_joystick;
+	ScalerThreads _scalerThreads;
+	SDL_Thread *_renderThread;
+	SDL_mutex *_renderMutex;
+	SDL_cond *_renderCond;
+	RenderFrame _renderFrames[kRenderFramesCount];
+	uint32_t _renderPalettes[kRenderFramesCount][256];
+	int _renderWriteFrame, _renderReadyFrame, _renderReadFrame;
+	bool _renderFrameReady;
+	bool _renderQuit;
+	uint32_t *_renderPixels; // texture pixels converted by the render thread, uploaded by the game thread
+	SDL_Rect _renderDirtyRect;
+	bool _renderPixelsReady;
 
 	System_SDL2();
 	virtual ~System_SDL2() {}
 	virtual void init(const char *title, int w, int h, bool fullscreen, bool widescreen, bool yuv);
 	virtual void destroy();
 	virtual void setScaler(const char *name, int multiplier);
+	virtual void setScalerThreads(int count);
+	virtual void setRenderThread(bool enable);
 	virtual void setGamma(float gamma);
 	virtual void setPalette(const uint8_t *pal, int n, int depth);
 	virtual void clearPalette();
@@ -85,9 +240,17 @@ struct System_SDL2 : System {
 	virtual void copyRectWidescreen(int w, int h, const uint8_t *buf, const uint8_t *pal);
 	virtual void shakeScreen(int dx, int dy);
 	virtual void updateScreen(bool drawWidescreen);
+	virtual int getDisplayRefreshRate();
 	virtual void processEvents();
 	virtual void sleep(int duration);
 	virtual uint32_t getTimeStamp();
+	virtual uint64_t getTimeStampNs();
+	virtual void sleepUntilNs(uint64_t timeStampNs);
+
+	virtual void *createWorker(const char *name, WorkerProc proc, void *userdata);
+	virtual void startWorker(void *worker);
+	virtual void waitWorker(void *worker);
+	virtual void destroyWorker(void *worker);
 
 	virtual void startAudio(AudioCallback callback);
 	virtual void stopAudio();
@@ -99,6 +262,17 @@ struct System_SDL2 : System {
 	void setupDefaultKeyMappings();
 	void updateKeys(PlayerInput *inp);
 	void prepareScaledGfx(const char *caption, bool fullscreen, bool widescreen, bool yuv);
+	void scaleRect(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h);
+	void updateTextureRect(const uint8_t *buffer, int x, int y, int w, int h);
+	bool lockTextureRect(const SDL_Rect *r, void **pixels, int *pitch);
+	void unlockTextureRect();
+	void renderFrame(const RenderFrame *frame);
+	void updateWidescreenTexture(const RenderFrame *frame);
+	void presentScreen(const RenderFrame *frame);
+	void presentRenderedFrame();
+	void initRenderThread();
+	void finiRenderThread();
+	void renderLoop();
 };
 
 static System_SDL2 system_sdl2;
@@ -123,9 +297,10 @@ bool System_hasCommandLine() {
 }
 
 System_SDL2::System_SDL2() :
-	_offscreenLut(0),
-	_window(0), _renderer(0), _texture(0), _backgroundTexture(0), _fmt(0), _widescreenTexture(0),
-	_controller(0), _joystick(0) {
+	_offscreenLut(0), _textureLut(0), _scaleBuffer(0),
+	_window(0), _renderer(0), _texture(0), _backgroundTexture(0), _fmt(0),
+	_widescreenTexture(0), _widescreenBuffer(0), _widescreenBitmap(0), _widescreenPixels(0),
+	_controller(0), _joystick(0), _renderThread(0), _renderMutex(0), _renderCond(0), _renderPixels(0) {
 	for (int i = 0; i < 256; ++i) {
 		_gammaLut[i] = i;
 	}
@@ -141,13 +316,40 @@ void System_SDL2::init(const char *title, int w, int h, bool fullscreen, bool wi
 	_screenH = h;
 	_shakeDx = _shakeDy = 0;
 	memset(_pal, 0, sizeof(_pal));
+	_expandPaletteProc = getExpandPaletteProc(getCpuFeatures(), 0);
 	const int offscreenSize = w * h;
 	_offscreenLut = (uint8_t *)malloc(offscreenSize);
 	if (!_offscreenLut) {
 		error("System_SDL2::init() Unable to allocate offscreen buffer");
 	}
 	memset(_offscreenLut, 0, offscreenSize);
+	_textureLut = (uint8_t *)malloc(offscreenSize);
+	if (!_textureLut) {
+		error("System_SDL2::init() Unable to allocate texture buffer");
+	}
+	_dirtyTileW = (w + 31) / 32;
+	_fullScreenUpdate = true;
 	prepareScaledGfx(title, fullscreen, widescreen, yuv);
+	memset(_texturePal, 0, sizeof(_texturePal));
+	if (_scaler->palette) {
+		_scaler->palette(_texturePal);
+	}
+	memset(&_scalerThreads, 0, sizeof(_scalerThreads));
+	if (_scaleRowsProc) {
+		const int count = (_scalerThreadsCount > 0) ? _scalerThreadsCount : SDL_GetCPUCount();
+		if (count > 1) {
+			_scalerThreads.init(MIN(count, kMaxScalerThreads + 1));
+		}
+	}
+	_renderThread = 0;
+	if (_renderThreadEnabled) {
+		if (yuv) {
+			// the PSX backgrounds are uploaded to the textures by copyYuv()
+			warning("Render thread is not supported with the PSX backgrounds");
+		} else {
+			initRenderThread();
+		}
+	}
 
 	SDL_GameControllerAddMappingsFromFile("gamecontrollerdb.txt");
 	_joystick = 0;
@@ -172,8 +374,21 @@ void System_SDL2::init(const char *title, int w, int h, bool fullscreen, bool wi
 }
 
 void System_SDL2::destroy() {
+	finiRenderThread();
+	_scalerThreads.fini();
+
 	free(_offscreenLut);
 	_offscreenLut = 0;
+	free(_textureLut);
+	_textureLut = 0;
+	free(_scaleBuffer);
+	_scaleBuffer = 0;
+	free(_widescreenBuffer);
+	_widescreenBuffer = 0;
+	free(_widescreenBitmap);
+	_widescreenBitmap = 0;
+	free(_widescreenPixels);
+	_widescreenPixels = 0;
 
 	if (_fmt) {
 		SDL_FreeFormat(_fmt);
@@ -265,7 +480,7 @@ static void blur(int radius, const uint32_t *src, int srcPitch, int w, int h, co
 
 			color = ((r / count) << rshift) | ((g / count) << gshift) | ((b / count) << bshift);
 			if (vertical) {
-				dst[i * srcPitch] = color;
+				dst[i * dstPitch] = color;
 			} else {
 				dst[i] = color;
 			}
@@ -285,32 +500,48 @@ void System_SDL2::copyRectWidescreen(int w, int h, const uint8_t *buf, const uin
 	}
 
 	assert(w == _screenW && h == _screenH);
-	void *ptr = 0;
-	int pitch = 0;
-	if (SDL_LockTexture(_widescreenTexture, 0, &ptr, &pitch) == 0) {
-		assert((pitch & 3) == 0);
-
-		uint32_t *src = (uint32_t *)malloc(w * h * sizeof(uint32_t));
-		uint32_t *tmp = (uint32_t *)malloc(w * h * sizeof(uint32_t));
-		uint32_t *dst = (uint32_t *)ptr;
-
-		if (src && tmp) {
-			for (int i = 0; i < w * h; ++i) {
-				const uint8_t color = buf[i];
-				src[i] = SDL_MapRGB(_fmt, _gammaLut[pal[color * 3]], _gammaLut[pal[color * 3 + 1]], _gammaLut[pal[color * 3 + 2]]);
+	// the palette changes without a new background (pause menu, ...) do not need a new blur
+	if (_widescreenCached && memcmp(_widescreenBitmap, buf, w * h) == 0 && memcmp(_widescreenPalette, pal, sizeof(_widescreenPalette)) == 0) {
+		return;
+	}
+	memcpy(_widescreenBitmap, buf, w * h);
+	memcpy(_widescreenPalette, pal, sizeof(_widescreenPalette));
+	_widescreenCached = true;
+
+	uint8_t r[256], g[256], b[256];
+	for (int i = 0; i < 256; ++i) {
+		r[i] = _gammaLut[pal[i * 3]];
+		g[i] = _gammaLut[pal[i * 3 + 1]];
+		b[i] = _gammaLut[pal[i * 3 + 2]];
+	}
+	// average the blocks of pixels, the texture filtering smoothes them back to the screen size
+	const int blurW = w / kWidescreenBlurScale;
+	const int blurH = h / kWidescreenBlurScale;
+	uint32_t *src = _widescreenBuffer;
+	uint32_t *tmp = _widescreenBuffer + blurW * blurH;
+	for (int y = 0; y < blurH; ++y) {
+		for (int x = 0; x < blurW; ++x) {
+			const uint8_t *p = buf + (y * w + x) * kWidescreenBlurScale;
+			int sumR = 0, sumG = 0, sumB = 0;
+			for (int j = 0; j < kWidescreenBlurScale; ++j) {
+				for (int i = 0; i < kWidescreenBlurScale; ++i) {
+					const uint8_t color = p[j * w + i];
+					sumR += r[color];
+					sumG += g[color];
+					sumB += b[color];
+				}
 			}
-			static const int radius = 8;
-			// horizontal pass
-			blur<false>(radius, src, w, w, h, _fmt, tmp, w);
-			// vertical pass
-			blur<true>(radius, tmp, w, w, h, _fmt, dst, pitch / sizeof(uint32_t));
+			static const int count = kWidescreenBlurScale * kWidescreenBlurScale;
+			src[y * blurW + x] = SDL_MapRGB(_fmt, sumR / count, sumG / count, sumB / count);
 		}
-
-		free(src);
-		free(tmp);
-
-		SDL_UnlockTexture(_widescreenTexture);
 	}
+	static const int radius = kWidescreenBlurRadius / kWidescreenBlurScale;
+	// horizontal pass
+	blur<false>(radius, src, blurW, blurW, blurH, _fmt, tmp, blurW);
+	// vertical pass
+	blur<true>(radius, tmp, blurW, blurW, blurH, _fmt, _widescreenPixels, blurW);
+	// the texture is updated by the renderer
+	++_widescreenVersion;
 }
 
 void System_SDL2::setScaler(const char *name, int multiplier) {
@@ -318,13 +549,7 @@ void System_SDL2::setScaler(const char *name, int multiplier) {
 		_scalerMultiplier = multiplier;
 	}
 	if (name) {
-		const Scaler *scaler = 0;
-		for (int i = 0; _scalers[i]; ++i) {
-			if (strcmp(name, _scalers[i]->name) == 0) {
-				scaler = _scalers[i];
-				break;
-			}
-		}
+		const Scaler *scaler = findScaler(name);
 		if (!scaler) {
 			warning("Unknown scaler '%s', using default '%s'", name, _scaler->name);
 		} else {
@@ -333,6 +558,14 @@ void System_SDL2::setScaler(const char *name, int multiplier) {
 	}
 }
 
+void System_SDL2::setScalerThreads(int count) {
+	_scalerThreadsCount = count;
+}
+
+void System_SDL2::setRenderThread(bool enable) {
+	_renderThreadEnabled = enable;
+}
+
 void System_SDL2::setGamma(float gamma) {
 	for (int i = 0; i < 256; ++i) {
 		_gammaLut[i] = (uint8_t)round(pow(i / 255., 1. / gamma) * 255);
@@ -360,9 +593,6 @@ void System_SDL2::setPalette(const uint8_t *pal, int n, int depth) {
 	if (_backgroundTexture) {
 		_pal[0] = 0;
 	}
-	if (_scaler->palette) {
-		_scaler->palette(_pal);
-	}
 }
 
 void System_SDL2::clearPalette() {
@@ -418,57 +648,356 @@ static void clearScreen(uint32_t *dst, int dstPitch, int x, int y, int w, int h,
 	}
 }
 
+void System_SDL2::scaleRect(uint32_t *dst, int dstPitch, const uint8_t *src, int srcPitch, int w, int h) {
+	if (_scalerThreads._threadsCount != 0) {
+		_scalerThreads.scale(_scaleRowsProc, dst, dstPitch, src, srcPitch, w, h, _texturePal);
+	} else {
+		_scalerProc(dst, dstPitch, src, srcPitch, w, h, _texturePal);
+	}
+}
+
+void System_SDL2::updateTextureRect(const uint8_t *buffer, int x, int y, int w, int h) {
+	void *texturePtr = 0;
+	int texturePitch = 0;
+	if (!_scalerProc) {
+		SDL_Rect r;
+		r.x = x;
+		r.y = y;
+		r.w = w;
+		r.h = h;
+		if (!lockTextureRect(&r, &texturePtr, &texturePitch)) {
+			return;
+		}
+		const uint8_t *src = buffer + y * _screenW + x;
+		uint32_t *dst = (uint32_t *)texturePtr;
+		for (int j = 0; j < h; ++j) {
+			_expandPaletteProc(dst, src, w, _texturePal);
+			src += _screenW;
+			dst += texturePitch / sizeof(uint32_t);
+		}
+		unlockTextureRect();
+		return;
+	}
+	// a source pixel change modifies the scaled pixels up to kScalerBorder pixels away
+	const int x1 = MAX(x - kScalerBorder, 0);
+	const int y1 = MAX(y - kScalerBorder, 0);
+	const int x2 = MIN(x + w + kScalerBorder, _screenW);
+	const int y2 = MIN(y + h + kScalerBorder, _screenH);
+	// scale a larger area to have the same neighbour pixels as a full screen update
+	const int sx1 = MAX(x1 - kScalerBorder, 0);
+	const int sy1 = MAX(y1 - kScalerBorder, 0);
+	const int sx2 = MIN(x2 + kScalerBorder, _screenW);
+	const int sy2 = MIN(y2 + kScalerBorder, _screenH);
+	scaleRect(_scaleBuffer, _texW, buffer + sy1 * _screenW + sx1, _screenW, sx2 - sx1, sy2 - sy1);
+	SDL_Rect r;
+	r.x = x1 * _texScale;
+	r.y = y1 * _texScale;
+	r.w = (x2 - x1) * _texScale;
+	r.h = (y2 - y1) * _texScale;
+	if (!lockTextureRect(&r, &texturePtr, &texturePitch)) {
+		return;
+	}
+	const uint32_t *src = _scaleBuffer + ((y1 - sy1) * _texW + (x1 - sx1)) * _texScale;
+	uint8_t *dst = (uint8_t *)texturePtr;
+	for (int j = 0; j < r.h; ++j) {
+		memcpy(dst, src, r.w * sizeof(uint32_t));
+		src += _texW;
+		dst += texturePitch;
+	}
+	unlockTextureRect();
+}
+
 void System_SDL2::updateScreen(bool drawWidescreen) {
+	if (_renderThread) {
+		RenderFrame *frame = &_renderFrames[_renderWriteFrame];
+		memcpy(frame->buffer, _offscreenLut, _screenW * _screenH);
+		memcpy(frame->palette, _pal, sizeof(_pal));
+		frame->shakeDx = _shakeDx;
+		frame->shakeDy = _shakeDy;
+		frame->drawWidescreen = drawWidescreen;
+		if (frame->widescreen && frame->widescreenVersion != _widescreenVersion) {
+			const int size = (_screenW / kWidescreenBlurScale) * (_screenH / kWidescreenBlurScale);
+			memcpy(frame->widescreen, _widescreenPixels, size * sizeof(uint32_t));
+			frame->widescreenVersion = _widescreenVersion;
+		}
+		SDL_LockMutex(_renderMutex);
+		SWAP(_renderWriteFrame, _renderReadyFrame);
+		_renderFrameReady = true;
+		SDL_CondBroadcast(_renderCond);
+		// wait for the conversion of this frame, the callers drawing a single frame (loading and hint screens) expect it on screen
+		while (!_renderPixelsReady) {
+			SDL_CondWait(_renderCond, _renderMutex);
+		}
+		SDL_UnlockMutex(_renderMutex);
+		presentRenderedFrame();
+	} else {
+		RenderFrame frame;
+		frame.buffer = _offscreenLut;
+		frame.palette = _pal;
+		frame.shakeDx = _shakeDx;
+		frame.shakeDy = _shakeDy;
+		frame.drawWidescreen = drawWidescreen;
+		frame.widescreen = _widescreenPixels;
+		frame.widescreenVersion = _widescreenVersion;
+		updateWidescreenTexture(&frame);
+		renderFrame(&frame);
+		presentScreen(&frame);
+	}
+	_shakeDx = _shakeDy = 0;
+}
+
+static int renderThreadProc(void *userdata) {
+	traceThreadName("render");
+	((System_SDL2 *)userdata)->renderLoop();
+	return 0;
+}
+
+void System_SDL2::initRenderThread() {
+	const int size = _screenW * _screenH;
+	const int widescreenSize = (_screenW / kWidescreenBlurScale) * (_screenH / kWidescreenBlurScale);
+	for (int i = 0; i < kRenderFramesCount; ++i) {
+		RenderFrame *frame = &_renderFrames[i];
+		memset(frame, 0, sizeof(RenderFrame));
+		frame->buffer = (uint8_t *)calloc(size, 1);
+		if (!frame->buffer) {
+			error("System_SDL2::initRenderThread() Unable to allocate frame buffer");
+		}
+		frame->palette = _renderPalettes[i];
+		memset(frame->palette, 0, sizeof(_renderPalettes[i]));
+		if (_widescreenPixels) {
+			frame->widescreen = (uint32_t *)calloc(widescreenSize, sizeof(uint32_t));
+			if (!frame->widescreen) {
+				error("System_SDL2::initRenderThread() Unable to allocate widescreen buffer");
+			}
+		}
+	}
+	_renderWriteFrame = 0;
+	_renderReadyFrame = 1;
+	_renderReadFrame = 2;
+	_renderPixels = (uint32_t *)calloc(_texW * _texH, sizeof(uint32_t));
+	if (!_renderPixels) {
+		error("System_SDL2::initRenderThread() Unable to allocate texture pixels");
+	}
+	memset(&_renderDirtyRect, 0, sizeof(_renderDirtyRect));
+	_renderPixelsReady = false;
+	_renderFrameReady = false;
+	_renderQuit = false;
+	_renderMutex = SDL_CreateMutex();
+	_renderCond = SDL_CreateCond();
+	// SDL renderers can only be used from the thread that created them : the render thread converts and scales
+	// the frames to _renderPixels, the game thread uploads them to the texture and presents
+	_renderThread = SDL_CreateThread(renderThreadProc, "render", this);
+	if (!_renderThread) {
+		warning("Unable to create render thread, %s", SDL_GetError());
+		finiRenderThread();
+	}
+}
+
+void System_SDL2::finiRenderThread() {
+	if (!_renderMutex) {
+		return;
+	}
+	if (_renderThread) {
+		SDL_LockMutex(_renderMutex);
+		_renderQuit = true;
+		SDL_CondSignal(_renderCond);
+		SDL_UnlockMutex(_renderMutex);
+		SDL_WaitThread(_renderThread, 0);
+		_renderThread = 0;
+	}
+	for (int i = 0; i < kRenderFramesCount; ++i) {
+		free(_renderFrames[i].buffer);
+		_renderFrames[i].buffer = 0;
+		free(_renderFrames[i].widescreen);
+		_renderFrames[i].widescreen = 0;
+	}
+	free(_renderPixels);
+	_renderPixels = 0;
+	SDL_DestroyCond(_renderCond);
+	_renderCond = 0;
+	SDL_DestroyMutex(_renderMutex);
+	_renderMutex = 0;
+}
+
+void System_SDL2::renderLoop() {
+	SDL_LockMutex(_renderMutex);
+	while (1) {
+		// the pixels of the previous frame are kept until uploaded by the game thread
+		while ((!_renderFrameReady || _renderPixelsReady) && !_renderQuit) {
+			SDL_CondWait(_renderCond, _renderMutex);
+		}
+		if (_renderQuit) {
+			break;
+		}
+		SWAP(_renderReadyFrame, _renderReadFrame);
+		_renderFrameReady = false;
+		SDL_UnlockMutex(_renderMutex);
+		traceBegin("renderFrame");
+		renderFrame(&_renderFrames[_renderReadFrame]);
+		traceEnd("renderFrame");
+		SDL_LockMutex(_renderMutex);
+		_renderPixelsReady = true;
+		SDL_CondBroadcast(_renderCond);
+	}
+	SDL_UnlockMutex(_renderMutex);
+}
+
+// called by the game thread once the frame is converted, uploads the pixels and presents
+void System_SDL2::presentRenderedFrame() {
+	// the render thread does not modify the frame and the pixels until _renderPixelsReady is cleared
+	const RenderFrame frame = _renderFrames[_renderReadFrame];
+	if (!SDL_RectEmpty(&_renderDirtyRect)) {
+		const SDL_Rect *r = &_renderDirtyRect;
+		SDL_UpdateTexture(_texture, r, _renderPixels + r->y * _texW + r->x, _texW * sizeof(uint32_t));
+		memset(&_renderDirtyRect, 0, sizeof(_renderDirtyRect));
+	}
+	updateWidescreenTexture(&frame);
+	SDL_LockMutex(_renderMutex);
+	_renderPixelsReady = false;
+	SDL_CondBroadcast(_renderCond);
+	SDL_UnlockMutex(_renderMutex);
+	presentScreen(&frame);
+}
+
+// the render thread writes to _renderPixels and records the modified area
+bool System_SDL2::lockTextureRect(const SDL_Rect *r, void **pixels, int *pitch) {
+	if (!_renderThread) {
+		return SDL_LockTexture(_texture, r, pixels, pitch) == 0;
+	}
+	SDL_Rect full;
+	if (!r) {
+		full.x = full.y = 0;
+		full.w = _texW;
+		full.h = _texH;
+		r = &full;
+	}
+	SDL_UnionRect(&_renderDirtyRect, r, &_renderDirtyRect);
+	*pixels = _renderPixels + r->y * _texW + r->x;
+	*pitch = _texW * sizeof(uint32_t);
+	return true;
+}
+
+void System_SDL2::unlockTextureRect() {
+	if (!_renderThread) {
+		SDL_UnlockTexture(_texture);
+	}
+}
+
+void System_SDL2::updateWidescreenTexture(const RenderFrame *frame) {
+	if (frame->widescreen && frame->widescreenVersion != _widescreenTextureVersion) {
+		const int blurW = _screenW / kWidescreenBlurScale;
+		SDL_UpdateTexture(_widescreenTexture, 0, frame->widescreen, blurW * sizeof(uint32_t));
+		_widescreenTextureVersion = frame->widescreenVersion;
+	}
+}
+
+void System_SDL2::renderFrame(const RenderFrame *frame) {
+	// the scalers palette tables are only accessed by the thread rendering the frames
+	if (memcmp(_texturePal, frame->palette, sizeof(_texturePal)) != 0) {
+		memcpy(_texturePal, frame->palette, sizeof(_texturePal));
+		if (_scaler->palette) {
+			_scaler->palette(_texturePal);
+		}
+		_fullScreenUpdate = true;
+	}
+	const int shakeDx = frame->shakeDx;
+	const int shakeDy = frame->shakeDy;
+	if (kUseDirtyRects && !_fullScreenUpdate && shakeDx == 0 && shakeDy == 0) {
+		// compare with the pixels of the previous update, one texture update per run of modified tiles on consecutive rows
+		for (int y = 0; y < _screenH; ) {
+			const int y1 = y;
+			uint32_t mask = 0;
+			for (; y < _screenH; ++y) {
+				const uint8_t *src = frame->buffer + y * _screenW;
+				uint8_t *dst = _textureLut + y * _screenW;
+				if (memcmp(src, dst, _screenW) == 0) {
+					break;
+				}
+				for (int tile = 0, x = 0; x < _screenW; ++tile, x += _dirtyTileW) {
+					const int w = MIN(_dirtyTileW, _screenW - x);
+					if (memcmp(src + x, dst + x, w) != 0) {
+						mask |= 1U << tile;
+					}
+				}
+				memcpy(dst, src, _screenW);
+			}
+			for (int tile = 0; mask != 0; ) {
+				if ((mask & (1U << tile)) == 0) {
+					++tile;
+					continue;
+				}
+				const int tile1 = tile;
+				while (tile < 32 && (mask & (1U << tile)) != 0) {
+					mask &= ~(1U << tile);
+					++tile;
+				}
+				const int x = tile1 * _dirtyTileW;
+				const int w = MIN(tile * _dirtyTileW, _screenW) - x;
+				updateTextureRect(frame->buffer, x, y1, w, y - y1);
+			}
+			if (y == y1) {
+				++y;
+			}
+		}
+		return;
+	}
 	void *texturePtr = 0;
 	int texturePitch = 0;
-	if (SDL_LockTexture(_texture, 0, &texturePtr, &texturePitch) != 0) {
+	if (!lockTextureRect(0, &texturePtr, &texturePitch)) {
 		return;
 	}
+	memcpy(_textureLut, frame->buffer, _screenW * _screenH);
+	// the next frame is not shaken, redraw everything
+	_fullScreenUpdate = (shakeDx != 0 || shakeDy != 0);
 	int w = _screenW;
 	int h = _screenH;
-	const uint8_t *src = _offscreenLut;
+	const uint8_t *src = frame->buffer;
 	uint32_t *dst = (uint32_t *)texturePtr;
 	assert((texturePitch & 3) == 0);
 	const int dstPitch = texturePitch / sizeof(uint32_t);
 	const int srcPitch = _screenW;
 	if (!_widescreenTexture) {
-		if (_shakeDy > 0) {
-			clearScreen(dst, dstPitch, 0, 0, w, _shakeDy, _texScale);
-			h -= _shakeDy;
-			dst += _shakeDy * dstPitch * _texScale;
-		} else if (_shakeDy < 0) {
-			h += _shakeDy;
-			clearScreen(dst, dstPitch, 0, h, w, -_shakeDy, _texScale);
-			src -= _shakeDy * srcPitch;
-		}
-		if (_shakeDx > 0) {
-			clearScreen(dst, dstPitch, 0, 0, _shakeDx, h, _texScale);
-			w -= _shakeDx;
-			dst += _shakeDx * _texScale;
-		} else if (_shakeDx < 0) {
-			w += _shakeDx;
-			clearScreen(dst, dstPitch, w, 0, -_shakeDx, h, _texScale);
-			src -= _shakeDx;
+		if (shakeDy > 0) {
+			clearScreen(dst, dstPitch, 0, 0, w, shakeDy, _texScale);
+			h -= shakeDy;
+			dst += shakeDy * dstPitch * _texScale;
+		} else if (shakeDy < 0) {
+			h += shakeDy;
+			clearScreen(dst, dstPitch, 0, h, w, -shakeDy, _texScale);
+			src -= shakeDy * srcPitch;
+		}
+		if (shakeDx > 0) {
+			clearScreen(dst, dstPitch, 0, 0, shakeDx, h, _texScale);
+			w -= shakeDx;
+			dst += shakeDx * _texScale;
+		} else if (shakeDx < 0) {
+			w += shakeDx;
+			clearScreen(dst, dstPitch, w, 0, -shakeDx, h, _texScale);
+			src -= shakeDx;
 		}
 	}
 	if (!_scalerProc) {
-		for (int i = 0; i < w * h; ++i) {
-			dst[i] = _pal[src[i]];
+		for (int j = 0; j < h; ++j) {
+			_expandPaletteProc(dst, src, w, _texturePal);
+			src += srcPitch;
+			dst += dstPitch;
 		}
 	} else {
-		_scalerProc(dst, dstPitch, src, srcPitch, w, h, _pal);
+		scaleRect(dst, dstPitch, src, srcPitch, w, h);
 	}
-	SDL_UnlockTexture(_texture);
+	unlockTextureRect();
+}
 
+void System_SDL2::presentScreen(const RenderFrame *frame) {
 	SDL_RenderClear(_renderer);
 
 	if (_widescreenTexture) {
-		if (drawWidescreen) {
+		if (frame->drawWidescreen) {
 			SDL_RenderCopy(_renderer, _widescreenTexture, 0, 0);
 		}
 		SDL_Rect r;
-		r.x = _shakeDx * _scalerMultiplier;
-		r.y = _shakeDy * _scalerMultiplier;
+		r.x = frame->shakeDx * _scalerMultiplier;
+		r.y = frame->shakeDy * _scalerMultiplier;
 		SDL_RenderGetLogicalSize(_renderer, &r.w, &r.h);
 		const int w = _screenW * _scalerMultiplier;
 		const int h = _screenH * _scalerMultiplier;
@@ -487,7 +1016,15 @@ void System_SDL2::updateScreen(bool drawWidescreen) {
 		SDL_RenderCopy(_renderer, _texture, 0, 0);
 	}
 	SDL_RenderPresent(_renderer);
-	_shakeDx = _shakeDy = 0;
+}
+
+int System_SDL2::getDisplayRefreshRate() {
+	SDL_DisplayMode mode;
+	const int index = SDL_GetWindowDisplayIndex(_window);
+	if (index < 0 || SDL_GetCurrentDisplayMode(index, &mode) != 0) {
+		return 0;
+	}
+	return mode.refresh_rate;
 }
 
 void System_SDL2::processEvents() {
@@ -756,6 +1293,110 @@ uint32_t System_SDL2::getTimeStamp() {
 	return SDL_GetTicks();
 }
 
+uint64_t System_SDL2::getTimeStampNs() {
+	static const uint64_t freq = SDL_GetPerformanceFrequency();
+	const uint64_t counter = SDL_GetPerformanceCounter();
+	return counter / freq * 1000000000 + counter % freq * 1000000000 / freq;
+}
+
+void System_SDL2::sleepUntilNs(uint64_t timeStampNs) {
+	// SDL_Delay() can return late by up to the scheduler granularity, wake up early and spin until the deadline
+	const uint64_t now = getTimeStampNs();
+	if (timeStampNs > now + kSleepSpinNs) {
+		SDL_Delay((timeStampNs - now - kSleepSpinNs) / 1000000);
+	}
+	while (getTimeStampNs() < timeStampNs) {
+		// yields the CPU to the other threads instead of busy waiting
+		SDL_Delay(0);
+	}
+}
+
+// persistent thread waiting for startWorker() calls
+struct Worker {
+	SDL_Thread *thread;
+	SDL_mutex *mutex;
+	SDL_cond *cond;
+	const char *name;
+	WorkerProc proc;
+	void *userdata;
+	bool running;
+	bool quit;
+};
+
+static int workerThreadProc(void *userdata) {
+	Worker *w = (Worker *)userdata;
+	traceThreadName(w->name, true);
+	SDL_LockMutex(w->mutex);
+	while (!w->quit) {
+		if (!w->running) {
+			SDL_CondWait(w->cond, w->mutex);
+			continue;
+		}
+		SDL_UnlockMutex(w->mutex);
+		w->proc(w->userdata);
+		SDL_LockMutex(w->mutex);
+		w->running = false;
+		SDL_CondBroadcast(w->cond);
+	}
+	SDL_UnlockMutex(w->mutex);
+	return 0;
+}
+
+void *System_SDL2::createWorker(const char *name, WorkerProc proc, void *userdata) {
+	Worker *w = (Worker *)calloc(1, sizeof(Worker));
+	if (w) {
+		w->name = name;
+		w->proc = proc;
+		w->userdata = userdata;
+		w->mutex = SDL_CreateMutex();
+		w->cond = SDL_CreateCond();
+		if (w->mutex && w->cond) {
+			w->thread = SDL_CreateThread(workerThreadProc, name, w);
+		}
+		if (!w->thread) {
+			warning("Unable to create %s thread, %s", name, SDL_GetError());
+			if (w->cond) {
+				SDL_DestroyCond(w->cond);
+			}
+			if (w->mutex) {
+				SDL_DestroyMutex(w->mutex);
+			}
+			free(w);
+			w = 0;
+		}
+	}
+	return w;
+}
+
+void System_SDL2::startWorker(void *worker) {
+	Worker *w = (Worker *)worker;
+	SDL_LockMutex(w->mutex);
+	w->running = true;
+	SDL_CondBroadcast(w->cond);
+	SDL_UnlockMutex(w->mutex);
+}
+
+void System_SDL2::waitWorker(void *worker) {
+	Worker *w = (Worker *)worker;
+	SDL_LockMutex(w->mutex);
+	while (w->running) {
+		SDL_CondWait(w->cond, w->mutex);
+	}
+	SDL_UnlockMutex(w->mutex);
+}
+
+void System_SDL2::destroyWorker(void *worker) {
+	Worker *w = (Worker *)worker;
+	SDL_LockMutex(w->mutex);
+	w->quit = true;
+	SDL_CondBroadcast(w->cond);
+	SDL_UnlockMutex(w->mutex);
+	SDL_WaitThread(w->thread, 0);
+	SDL_DestroyCond(w->cond);
+	SDL_DestroyMutex(w->mutex);
+	free(w);
+}
+
 static void mixAudioS16(void *param, uint8_t *buf, int len) {
 	memset(buf, 0, len);
 	system_sdl2._audioCb.proc(system_sdl2._audioCb.userdata, (int16_t *)buf, len / 2);
@@ -864,6 +1505,7 @@ void System_SDL2::prepareScaledGfx(const char *caption, bool fullscreen, bool wi
 			_scalerMultiplier = _scaler->factorMax;
 		}
 		_scalerProc = _scaler->scale[_scalerMultiplier - 2];
+		_scaleRowsProc = _scaler->scaleRows[_scalerMultiplier - 2];
 	}
 	if (_scalerProc) {
 		_texW = w;
@@ -889,11 +1531,31 @@ void System_SDL2::prepareScaledGfx(const char *caption, bool fullscreen, bool wi
 
 	const int pixelFormat = yuv ? SDL_PIXELFORMAT_RGBA8888 : SDL_PIXELFORMAT_RGB888;
 	_texture = SDL_CreateTexture(_renderer, pixelFormat, SDL_TEXTUREACCESS_STREAMING, _texW, _texH);
+	if (_scalerProc) {
+		_scaleBuffer = (uint32_t *)malloc(_texW * _texH * sizeof(uint32_t));
+		if (!_scaleBuffer) {
+			error("System_SDL2::prepareScaledGfx() Unable to allocate scale buffer");
+		}
+	}
+	_fullScreenUpdate = true;
 	if (widescreen) {
 		if (yuv) {
 			_widescreenTexture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_TARGET, 16, 16);
 		} else {
-			_widescreenTexture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, _screenW, _screenH);
+			const int blurW = _screenW / kWidescreenBlurScale;
+			const int blurH = _screenH / kWidescreenBlurScale;
+			// the reduced background is always smoothed when stretched
+			SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
+			_widescreenTexture = SDL_CreateTexture(_renderer, SDL_PIXELFORMAT_RGB888, SDL_TEXTUREACCESS_STREAMING, blurW, blurH);
+			SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, (_scaler == &scaler_nearest) ? "0" : "1");
+			_widescreenBuffer = (uint32_t *)malloc(blurW * blurH * 2 * sizeof(uint32_t));
+			_widescreenBitmap = (uint8_t *)malloc(_screenW * _screenH);
+			_widescreenPixels = (uint32_t *)calloc(blurW * blurH, sizeof(uint32_t));
+			if (!_widescreenBuffer || !_widescreenBitmap || !_widescreenPixels) {
+				error("System_SDL2::prepareScaledGfx() Unable to allocate widescreen buffers");
+			}
+			_widescreenCached = false;
+			_widescreenVersion = _widescreenTextureVersion = 0;
 		}
 	} else {
 		_widescreenTexture = 0;
@@ -33,6 +33,8 @@ struct System_Wii : System {
 	virtual void init(const char *title, int w, int h, bool fullscreen, bool widescreen, bool yuv);
 	virtual void destroy();
 	virtual void setScaler(const char *name, int multiplier);
+	virtual void setScalerThreads(int count);
+	virtual void setRenderThread(bool enable);
 	virtual void setGamma(float gamma);
 	virtual void setPalette(const uint8_t *pal, int n, int depth);
 	virtual void clearPalette();
@@ -42,9 +44,17 @@ struct System_Wii : System {
 	virtual void copyRectWidescreen(int w, int h, const uint8_t *buf, const uint8_t *pal);
 	virtual void shakeScreen(int dx, int dy);
 	virtual void updateScreen(bool drawWidescreen);
+	virtual int getDisplayRefreshRate();
 	virtual void processEvents();
 	virtual void sleep(int duration);
 	virtual uint32_t getTimeStamp();
+	virtual uint64_t getTimeStampNs();
+	virtual void sleepUntilNs(uint64_t timeStampNs);
+
+	virtual void *createWorker(const char *name, WorkerProc proc, void *userdata);
+	virtual void startWorker(void *worker);
+	virtual void waitWorker(void *worker);
+	virtual void destroyWorker(void *worker);
 	virtual void startAudio(AudioCallback callback);
 	virtual void stopAudio();
 	virtual void lockAudio();
@@ -163,6 +173,12 @@ void System_Wii::destroy() {
 void System_Wii::setScaler(const char *name, int multiplier) {
 }
 
+void System_Wii::setScalerThreads(int count) {
+}
+
+void System_Wii::setRenderThread(bool enable) {
+}
+
 void System_Wii::setGamma(float gamma) {
 	if (gamma < 1.7f) {
 		_gamma = GX_GM_1_0;
@@ -256,6 +272,10 @@ void System_Wii::updateScreen(bool drawWidescreen) {
 	VIDEO_WaitVSync();
 }
 
+int System_Wii::getDisplayRefreshRate() {
+	return 0;
+}
+
 void System_Wii::processEvents() {
 	inp.prevMask = inp.mask;
 	inp.mask = 0;
@@ -317,6 +337,31 @@ uint32_t System_Wii::getTimeStamp() {
 	return ticks_to_millisecs(ticks);
 }
 
+uint64_t System_Wii::getTimeStampNs() {
+	const uint64_t ticks = diff_ticks(_startTime, gettime());
+	return ticks_to_nanosecs(ticks);
+}
+
+void System_Wii::sleepUntilNs(uint64_t timeStampNs) {
+	const uint64_t now = getTimeStampNs();
+	if (timeStampNs > now) {
+		usleep((timeStampNs - now) / 1000);
+	}
+}
+
+void *System_Wii::createWorker(const char *name, WorkerProc proc, void *userdata) {
+	return 0;
+}
+
+void System_Wii::startWorker(void *worker) {
+}
+
+void System_Wii::waitWorker(void *worker) {
+}
+
+void System_Wii::destroyWorker(void *worker) {
+}
+
 static void *audioThread(void *arg) {
 	while (system_wii._audioOut) {
 
@@ -0,0 +1,114 @@
+
+// Decodes the backgrounds of the PSX levels with the C and SIMD versions of the MDEC IDCT and compares the planes.
+// Usage: test_mdec DATAPATH, exits with 77 (skipped) if DATAPATH does not contain the PSX game data files.
+
+#include "fileio.h"
+#include "fs.h"
+#include "mdec.h"
+#include "resource.h"
+#include "util.h"
+#include "video.h"
+
+static const int kSkipped = 77;
+
+static const char *_levels[] = {
+	"rock", "fort", "pwr1", "isld", "lava", "pwr2", "lar1", "lar2", "dark"
+};
+
+static bool hasAssetFile(FileSystem *fs, const char *name) {
+	FILE *fp = fs->openAssetFile(name);
+	if (fp) {
+		fs->closeFile(fp);
+		return true;
+	}
+	return false;
+}
+
+struct Planes {
+	MdecOutput output;
+	int sizes[3];
+
+	void init(MdecIdctProc proc) {
+		memset(&output, 0, sizeof(output));
+		output.w = Video::W;
+		output.h = Video::H;
+		sizes[kOutputPlaneY] = Video::W * Video::H;
+		sizes[kOutputPlaneCb] = sizes[kOutputPlaneCr] = (Video::W / 2) * (Video::H / 2);
+		for (int i = 0; i < 3; ++i) {
+			output.planes[i].ptr = (uint8_t *)calloc(sizes[i], 1);
+			output.planes[i].pitch = (i == kOutputPlaneY) ? Video::W : Video::W / 2;
+		}
+		output.idctProc = proc;
+	}
+	void fini() {
+		for (int i = 0; i < 3; ++i) {
+			free(output.planes[i].ptr);
+		}
+	}
+};
+
+int main(int argc, char *argv[]) {
+	if (argc < 2) {
+		fprintf(stderr, "Usage: %s DATAPATH\n", argv[0]);
+		return kSkipped;
+	}
+	if (argv[1][0] == 0) {
+		fprintf(stdout, "No data path, skipping\n");
+		return kSkipped;
+	}
+	FileSystem fs(argv[1], argv[1]);
+	if (!hasAssetFile(&fs, "SETUP.DAX")) {
+		fprintf(stdout, "No PSX game data in '%s', skipping\n", argv[1]);
+		return kSkipped;
+	}
+	const char *name;
+	const MdecIdctProc proc = getMdecIdctProc(getCpuFeatures(), &name);
+	fprintf(stdout, "Comparing the 'c' and '%s' MDEC IDCT\n", name);
+
+	Resource *res = new Resource(&fs);
+	res->loadSetupDat();
+	Planes c, simd;
+	c.init(0);
+	simd.init(proc);
+	int backgroundsCount = 0;
+	int failedCount = 0;
+	for (int level = 0; level < kLvl_test; ++level) {
+		char filename[32];
+		snprintf(filename, sizeof(filename), "%s_HOD.LVL", _levels[level]);
+		if (!hasAssetFile(&fs, filename)) {
+			continue;
+		}
+		res->loadLevelData(level);
+		for (int screen = 0; screen < res->_lvlHdr.screensCount; ++screen) {
+			if (!res->isLvlBackgroundDataLoaded(screen)) {
+				res->loadLvlScreenBackgroundData(screen);
+			}
+			const LvlBackgroundData *dat = &res->_resLvlScreenBackgroundDataTable[screen];
+			for (int i = 0; i < dat->backgroundCount && i < 4; ++i) {
+				const uint8_t *bitmap = dat->backgroundBitmapTable[i];
+				if (!bitmap) {
+					continue;
+				}
+				// same parameters as Video::decodeBackgroundPsx()
+				decodeMDEC(bitmap + 4, Video::W * Video::H * sizeof(uint16_t), 0, 0, Video::W, Video::H, &c.output);
+				decodeMDEC(bitmap + 4, Video::W * Video::H * sizeof(uint16_t), 0, 0, Video::W, Video::H, &simd.output);
+				for (int p = 0; p < 3; ++p) {
+					if (memcmp(c.output.planes[p].ptr, simd.output.planes[p].ptr, c.sizes[p]) != 0) {
+						fprintf(stderr, "Level '%s' screen %d background %d plane %d differs\n", _levels[level], screen, i, p);
+						++failedCount;
+						break;
+					}
+				}
+				++backgroundsCount;
+			}
+		}
+	}
+	c.fini();
+	simd.fini();
+	delete res;
+	fprintf(stdout, "%d backgrounds decoded, %d different\n", backgroundsCount, failedCount);
+	if (backgroundsCount == 0) {
+		return kSkipped;
+	}
+	return (failedCount == 0) ? 0 : 1;
+}
@@ -0,0 +1,169 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "trace.h"
+#include "util.h"
+
+#ifdef _MSC_VER
+#include <windows.h>
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+struct TraceEntry {
+	uint64_t timeNs;
+	const char *name;
+	char phase;
+};
+
+struct TraceBuffer {
+	TraceEntry *entries;
+	uint32_t count; // older entries are overwritten when greater than kTraceBufferSize
+	const char *threadName;
+};
+
+static const int kTraceMaxThreads = 32;
+static const int kTraceMaxWorkerThreads = 24; // the last slots are kept for the game, audio and render threads
+static const uint32_t kTraceBufferSize = 1 << 16; // entries per thread, allocated with the first event
+
+bool g_traceEnabled = false;
+
+static char *_tracePath;
+static uint64_t _traceStartNs;
+static TraceBuffer _traceBuffers[kTraceMaxThreads];
+static volatile int _traceBuffersCount;
+static volatile int _traceDroppedThreadsCount;
+static TraceBuffer _traceNoBuffer; // threads without a slot
+static TRACE_THREAD_LOCAL TraceBuffer *_traceBuffer;
+
+static int fetchAndIncrement(volatile int *p) {
+#ifdef _MSC_VER
+	return InterlockedIncrement((volatile long *)p) - 1;
+#else
+	return __sync_fetch_and_add(p, 1);
+#endif
+}
+
+static bool compareAndSwap(volatile int *p, int oldValue, int newValue) {
+#ifdef _MSC_VER
+	return InterlockedCompareExchange((volatile long *)p, newValue, oldValue) == oldValue;
+#else
+	return __sync_bool_compare_and_swap(p, oldValue, newValue);
+#endif
+}
+
+// returns the index of a free slot lower than 'limit', or -1
+static int allocateSlot(int limit) {
+	while (1) {
+		const int num = _traceBuffersCount;
+		if (num >= limit) {
+			return -1;
+		}
+		if (compareAndSwap(&_traceBuffersCount, num, num + 1)) {
+			return num;
+		}
+	}
+}
+
+static TraceBuffer *getThreadBuffer(const char *name = 0, bool worker = false) {
+	if (!_traceBuffer) {
+		const int num = allocateSlot(worker ? kTraceMaxWorkerThreads : kTraceMaxThreads);
+		TraceBuffer *b = (num < 0) ? 0 : &_traceBuffers[num];
+		if (b) {
+			b->entries = (TraceEntry *)malloc(kTraceBufferSize * sizeof(TraceEntry));
+		}
+		if (!b || !b->entries) {
+			if (fetchAndIncrement(&_traceDroppedThreadsCount) == 0) {
+				warning("No trace buffer for thread '%s', its events are not recorded", name ? name : "");
+			}
+			_traceBuffer = &_traceNoBuffer;
+		} else {
+			_traceBuffer = b;
+		}
+	}
+	return (_traceBuffer == &_traceNoBuffer) ? 0 : _traceBuffer;
+}
+
+bool traceOpen(const char *path) {
+	FILE *fp = fopen(path, "w");
+	if (!fp) {
+		warning("Unable to open '%s' for writing", path);
+		return false;
+	}
+	fclose(fp);
+	memset(_traceBuffers, 0, sizeof(_traceBuffers));
+	_tracePath = strdup(path);
+	_traceStartNs = getTimeNs();
+	g_traceEnabled = true;
+	return true;
+}
+
+static void writeTraceEntry(FILE *fp, const TraceEntry *e, int tid) {
+	const double timeUs = (e->timeNs - _traceStartNs) / 1000.;
+	fprintf(fp, ",\n\t\t{ \"name\": \"%s\", \"ph\": \"%c\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d%s }", e->name, e->phase, timeUs, tid, (e->phase == 'i') ? ", \"s\": \"t\"" : "");
+}
+
+void traceClose() {
+	if (!_tracePath) {
+		return;
+	}
+	g_traceEnabled = false;
+	FILE *fp = fopen(_tracePath, "w");
+	if (fp) {
+		fprintf(fp, "{\n\t\"traceEvents\": [");
+		bool first = true;
+		const int buffersCount = MIN(_traceBuffersCount, kTraceMaxThreads);
+		for (int i = 0; i < buffersCount; ++i) {
+			const TraceBuffer *b = &_traceBuffers[i];
+			if (!b->entries) {
+				continue;
+			}
+			const int tid = i + 1;
+			fprintf(fp, "%s\n\t\t{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": { \"name\": \"%s\" } }", first ? "" : ",", tid, b->threadName ? b->threadName : "thread");
+			first = false;
+			const uint32_t count = MIN(b->count, kTraceBufferSize);
+			for (uint32_t j = b->count - count; j < b->count; ++j) {
+				writeTraceEntry(fp, &b->entries[j & (kTraceBufferSize - 1)], tid);
+			}
+			if (b->count > kTraceBufferSize) {
+				warning("Trace buffer for thread '%s' overflowed, %u events lost", b->threadName ? b->threadName : "", b->count - kTraceBufferSize);
+			}
+		}
+		fprintf(fp, "\n\t],\n\t\"displayTimeUnit\": \"ms\"\n}\n");
+		fclose(fp);
+		if (_traceDroppedThreadsCount != 0) {
+			warning("%d threads were not traced", _traceDroppedThreadsCount);
+		}
+	} else {
+		warning("Unable to open '%s' for writing", _tracePath);
+	}
+	for (int i = 0; i < kTraceMaxThreads; ++i) {
+		free(_traceBuffers[i].entries);
+		_traceBuffers[i].entries = 0;
+	}
+	free(_tracePath);
+	_tracePath = 0;
+}
+
+void traceThreadName(const char *name, bool worker) {
+	if (g_traceEnabled) {
+		TraceBuffer *b = getThreadBuffer(name, worker);
+		if (b) {
+			b->threadName = name;
+		}
+	}
+}
+
+void traceEvent(const char *name, char phase) {
+	TraceBuffer *b = getThreadBuffer();
+	if (b) {
+		TraceEntry *e = &b->entries[b->count & (kTraceBufferSize - 1)];
+		e->timeNs = getTimeNs();
+		e->name = name;
+		e->phase = phase;
+		++b->count;
+	}
+}
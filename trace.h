@@ -0,0 +1,49 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#ifndef TRACE_H__
+#define TRACE_H__
+
+#include "intern.h"
+
+// begin/end events recorded in per-thread ring buffers, saved in the Chrome trace event format (chrome://tracing, ui.perfetto.dev)
+
+extern bool g_traceEnabled;
+
+bool traceOpen(const char *path);
+void traceClose();
+void traceThreadName(const char *name, bool worker = false); // workers are not traced when the slots run low
+void traceEvent(const char *name, char phase); // 'name' must be a static string
+
+inline void traceBegin(const char *name) {
+	if (g_traceEnabled) {
+		traceEvent(name, 'B');
+	}
+}
+
+inline void traceEnd(const char *name) {
+	if (g_traceEnabled) {
+		traceEvent(name, 'E');
+	}
+}
+
+inline void traceInstant(const char *name) {
+	if (g_traceEnabled) {
+		traceEvent(name, 'i');
+	}
+}
+
+struct TraceScope {
+	const char *_name;
+	TraceScope(const char *name)
+		: _name(name) {
+		traceBegin(_name);
+	}
+	~TraceScope() {
+		traceEnd(_name);
+	}
+};
+
+#endif // TRACE_H__
@@ -9,6 +9,18 @@
 #endif
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdint.h>
+#ifdef _WIN32
+#include <windows.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#else
+#include <sys/time.h>
+#include <time.h>
+#endif
+#include "util.h"
+
 extern void System_printLog(FILE *, const char *s);
 extern void System_fatalError(const char *s);
 
@@ -51,3 +63,60 @@ void warning(const char *msg, ...) {
 #endif
 	System_printLog(stderr, buf);
 }
+
+uint64_t getTimeNs() {
+#if defined(_WIN32)
+	static LARGE_INTEGER freq;
+	if (freq.QuadPart == 0) {
+		QueryPerformanceFrequency(&freq);
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / freq.QuadPart) * 1000000000 + (uint64_t)(counter.QuadPart % freq.QuadPart) * 1000000000 / freq.QuadPart;
+#elif defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	struct timeval tv;
+	gettimeofday(&tv, 0);
+	return (uint64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#endif
+}
+
+uint32_t getCpuFeatures() {
+	static bool detected = false;
+	static uint32_t mask = 0;
+	if (!detected) {
+#if (defined(__i386__) || defined(__x86_64__)) && defined(__GNUC__)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2")) {
+			mask |= kCpuFeatureSse2;
+		}
+		if (__builtin_cpu_supports("sse4.1")) {
+			mask |= kCpuFeatureSse41;
+		}
+		if (__builtin_cpu_supports("avx2")) {
+			mask |= kCpuFeatureAvx2;
+		}
+#elif (defined(_M_IX86) || defined(_M_X64)) && defined(_MSC_VER)
+		int regs[4];
+		__cpuid(regs, 1);
+		if (regs[3] & (1 << 26)) {
+			mask |= kCpuFeatureSse2;
+		}
+		if (regs[2] & (1 << 19)) {
+			mask |= kCpuFeatureSse41;
+		}
+		const bool osxsave = (regs[2] & (1 << 27)) != 0;
+		__cpuidex(regs, 7, 0);
+		if (osxsave && (regs[1] & (1 << 5)) != 0 && (_xgetbv(0) & 6) == 6) {
+			mask |= kCpuFeatureAvx2;
+		}
+#elif defined(__aarch64__) || defined(_M_ARM64)
+		mask |= kCpuFeatureNeon;
+#endif
+		detected = true;
+	}
+	return mask;
+}
@@ -25,6 +25,17 @@ void debug(int mask, const char *msg, ...);
 void error(const char *msg, ...);
 void warning(const char *msg, ...);
 
+uint64_t getTimeNs(); // monotonic clock
+
+enum {
+	kCpuFeatureSse41 = 1 << 0,
+	kCpuFeatureAvx2  = 1 << 1,
+	kCpuFeatureNeon  = 1 << 2,
+	kCpuFeatureSse2  = 1 << 3
+};
+
+uint32_t getCpuFeatures();
+
 #ifdef NDEBUG
 #define debug(x, ...)
 #endif
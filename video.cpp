@@ -6,6 +6,7 @@
 #include "video.h"
 #include "mdec.h"
 #include "system.h"
+#include "util.h"
 
 static const bool kUseShadowColorLut = false;
 
@@ -15,7 +16,8 @@ Video::Video() {
 	_drawLine.y1 = 0;
 	_drawLine.x2 = W - 1;
 	_drawLine.y2 = H - 1;
-	_shadowLayer = (uint8_t *)malloc(W * H + 1); // projectionData offset can be equal to W * H
+	_shadowLayer = (uint8_t *)malloc(W * H + 4); // projectionData offset can be equal to W * H, padded for the 32 bits SIMD gathers
+	memset(_shadowLayer + W * H, 0, 4);
 	_frontLayer = (uint8_t *)malloc(W * H);
 	_backgroundLayer = (uint8_t *)malloc(W * H);
 	if (kUseShadowColorLut) {
@@ -23,13 +25,17 @@ Video::Video() {
 	} else {
 		_shadowColorLookupTable = 0;
 	}
-	_shadowScreenMaskBuffer = (uint8_t *)malloc(256 * 192 * 2 + 256 * 4);
+	_shadowScreenMaskBuffer = (uint8_t *)malloc(SHADOW_SCREEN_MASK_BUFFER_SIZE);
 	for (int i = 144; i < 256; ++i) {
 		_shadowColorLut[i] = i;
 	}
+	_applyShadowColorsProc = getApplyShadowColorsProc(getCpuFeatures(), 0);
+	_transformShadowLayerProc = getTransformShadowLayerProc(getCpuFeatures(), 0);
 	_transformShadowBuffer = 0;
 	_transformShadowLayerDelta = 0;
+	_transformShadowBufferMaxOffset = 0;
 	memset(&_mdec, 0, sizeof(_mdec));
+	_mdec.idctProc = getMdecIdctProc(getCpuFeatures(), 0);
 	_backgroundPsx = 0;
 }
 
@@ -241,6 +247,139 @@ void Video::decodeRLE(const uint8_t *src, uint8_t *dst, int size) {
 	assert(size == 0);
 }
 
+// converts the RLE opcodes to a list of spans, only counts the spans if 'spans' is null
+void Video::compileSPR(const uint8_t *src, SpriteSpan *spans, uint32_t *spansCount) {
+	uint32_t count = 0;
+	int x = 0;
+	int y = 0;
+	while (1) {
+		int code = *src++;
+		int len = code & 0x3F;
+		switch (code >> 6) {
+		case 0:
+			if (len != 0) {
+				if (spans) {
+					SpriteSpan *s = &spans[count];
+					s->x = x;
+					s->y = y;
+					s->len = len;
+					s->color = 0;
+					s->data = src;
+				}
+				++count;
+			}
+			x += len;
+			src += len;
+			break;
+		case 1:
+			code = *src++;
+			if (len != 0) {
+				if (spans) {
+					SpriteSpan *s = &spans[count];
+					s->x = x;
+					s->y = y;
+					s->len = len;
+					s->color = code;
+					s->data = 0;
+				}
+				++count;
+			}
+			x += len;
+			break;
+		case 2:
+			if (len == 0) {
+				len = *src++;
+			}
+			x += len;
+			break;
+		case 3:
+			if (len == 0) {
+				len = *src++;
+				if (len == 0) {
+					*spansCount = count;
+					return;
+				}
+			}
+			y += len;
+			x = *src++;
+			break;
+		}
+	}
+}
+
+// same output as decodeSPR
+void Video::drawCompiledSPR(const CompiledSprite *cs, uint8_t *dst, int x, int y, uint8_t flags, uint16_t spr_w, uint16_t spr_h) {
+	if (y >= H) {
+		return;
+	} else if (y < 0) {
+		flags |= kSprClipTop;
+	}
+	const int y2 = y + spr_h - 1;
+	if (y2 < 0) {
+		return;
+	} else if (y2 >= H) {
+		flags |= kSprClipBottom;
+	}
+
+	if (x >= W) {
+		return;
+	} else if (x < 0) {
+		flags |= kSprClipLeft;
+	}
+	const int x2 = x + spr_w - 1;
+	if (x2 < 0) {
+		return;
+	} else if (x2 >= W) {
+		flags |= kSprClipRight;
+	}
+
+	// the original code only clips horizontally flipped or partially visible sprites
+	const bool clipX = (flags & (kSprHorizFlip | kSprClipLeft | kSprClipRight)) != 0;
+	const bool hflip = (flags & kSprHorizFlip) != 0;
+	const bool vflip = (flags & kSprVertFlip) != 0;
+	for (uint32_t i = 0; i < cs->spansCount; ++i) {
+		const SpriteSpan *s = &cs->spans[i];
+		const int sy = vflip ? (y2 - s->y) : (y + s->y);
+		if (sy < 0 || sy >= H) {
+			continue;
+		}
+		int len = s->len;
+		int sx = hflip ? (x2 - s->x - len + 1) : (x + s->x);
+		const uint8_t *data = s->data;
+		if (clipX) {
+			// the pixels are stored left to right, the first ones are drawn on the right side when flipped
+			if (sx < 0) {
+				if (data && !hflip) {
+					data -= sx;
+				}
+				len += sx;
+				sx = 0;
+			}
+			if (sx + len > W) {
+				if (data && hflip) {
+					data += sx + len - W;
+				}
+				len = W - sx;
+			}
+			if (len <= 0) {
+				continue;
+			}
+		}
+		uint8_t *p = dst + sy * W + sx;
+		if (data) {
+			if (hflip) {
+				for (int j = 0; j < len; ++j) {
+					p[len - 1 - j] = data[j];
+				}
+			} else {
+				memcpy(p, data, len);
+			}
+		} else {
+			memset(p, s->color, len);
+		}
+	}
+}
+
 // https://en.wikipedia.org/wiki/Cohen%E2%80%93Sutherland_algorithm
 int Video::computeLineOutCode(int x, int y) {
 	int mask = 0;
@@ -358,34 +497,30 @@ void Video::drawLine(int x1, int y1, int x2, int y2, uint8_t color) {
 	}
 }
 
-static uint8_t lookupColor(uint8_t a, uint8_t b, const uint8_t *lut) {
-	return (a >= 144 && b < 144) ? lut[b] : b;
-}
-
 void Video::applyShadowColors(int x, int y, int src_w, int src_h, int dst_pitch, int src_pitch, uint8_t *dst1, uint8_t *dst2, uint8_t *src1, uint8_t *src2) {
-	assert(dst1 == _shadowLayer);
-	assert(dst2 == _frontLayer);
+	// dst1 == shadowLayer (or the interpolated layers)
+	// dst2 == frontLayer
 	// src1 == projectionData
 	// src2 == shadowPalette
 
 	dst2 += y * dst_pitch + x;
+	if (!kUseShadowColorLut) {
+		(*_applyShadowColorsProc)(dst2, dst_pitch, src_w, src_h, src1, dst1, _shadowColorLut);
+		return;
+	}
 	for (int j = 0; j < src_h; ++j) {
 		for (int i = 0; i < src_w; ++i) {
 			int offset = READ_LE_UINT16(src1); src1 += 2;
 			assert(offset <= W * H);
-			if (kUseShadowColorLut) {
-				// build lookup offset
-				//   msb : _shadowLayer[ _projectionData[ (x, y) ] ]
-				//   lsb : _frontLayer[ (x, y) ]
-				offset = (dst1[offset] << 8) | dst2[i];
-
-				// lookup color matrix
-				//   if msb < 144 : _frontLayer.color
-				//   if msb >= 144 : if _frontLayer.color < 144 ? shadowPalette[ _frontLayer.color ] : _frontLayer.color
-				dst2[i] = _shadowColorLookupTable[offset];
-			} else {
-				dst2[i] = lookupColor(_shadowLayer[offset], dst2[i], _shadowColorLut);
-			}
+			// build lookup offset
+			//   msb : _shadowLayer[ _projectionData[ (x, y) ] ]
+			//   lsb : _frontLayer[ (x, y) ]
+			offset = (dst1[offset] << 8) | dst2[i];
+
+			// lookup color matrix
+			//   if msb < 144 : _frontLayer.color
+			//   if msb >= 144 : if _frontLayer.color < 144 ? shadowPalette[ _frontLayer.color ] : _frontLayer.color
+			dst2[i] = _shadowColorLookupTable[offset];
 		}
 		dst2 += dst_pitch;
 	}
@@ -7,6 +7,7 @@
 #define VIDEO_H__
 
 #include "intern.h"
+#include "defs.h"
 #include "mdec.h"
 
 enum {
@@ -18,11 +19,20 @@ enum {
 	kSprClipRight  = 1 << 5
 };
 
+typedef void (*ApplyShadowColorsProc)(uint8_t *dst, int dstPitch, int w, int h, const uint8_t *projectionData, const uint8_t *shadowLayer, const uint8_t *shadowLut);
+
+// 'offsets' must be lower than 16, the displaced pixels are clamped to the last column of each row
+typedef void (*TransformShadowLayerProc)(uint8_t *dst, const uint8_t *src, const uint8_t *offsets, int h);
+
+ApplyShadowColorsProc getApplyShadowColorsProc(uint32_t cpuFeatures, const char **name); // video_simd.cpp
+TransformShadowLayerProc getTransformShadowLayerProc(uint32_t cpuFeatures, const char **name);
+
 struct Video {
 	enum {
 		CLEAR_COLOR = 0xC4,
 		W = 256,
-		H = 192
+		H = 192,
+		SHADOW_SCREEN_MASK_BUFFER_SIZE = W * H * 2 + 256 * 4
 	};
 
 	static const uint8_t _fontCharactersTable[39 * 2];
@@ -39,7 +49,10 @@ struct Video {
 	uint8_t *_shadowScreenMaskBuffer;
 	uint8_t *_transformShadowBuffer;
 	uint8_t _transformShadowLayerDelta;
+	uint8_t _transformShadowBufferMaxOffset;
+	TransformShadowLayerProc _transformShadowLayerProc;
 	uint8_t _shadowColorLut[256];
+	ApplyShadowColorsProc _applyShadowColorsProc;
 	const uint8_t *_font;
 
 	struct {
@@ -65,6 +78,8 @@ struct Video {
 	void clearPalette();
 	static void decodeRLE(const uint8_t *src, uint8_t *dst, int size);
 	static void decodeSPR(const uint8_t *src, uint8_t *dst, int x, int y, uint8_t flags, uint16_t spr_w, uint16_t spr_h);
+	static void compileSPR(const uint8_t *src, SpriteSpan *spans, uint32_t *spansCount);
+	static void drawCompiledSPR(const CompiledSprite *cs, uint8_t *dst, int x, int y, uint8_t flags, uint16_t spr_w, uint16_t spr_h);
 	int computeLineOutCode(int x, int y);
 	bool clipLineCoords(int &x1, int &y1, int &x2, int &y2);
 	void drawLine(int x1, int y1, int x2, int y2, uint8_t color);
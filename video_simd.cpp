@@ -0,0 +1,254 @@
+/*
+ * Heart of Darkness engine rewrite
+ * Copyright (C) 2009-2011 Gregory Montoir (cyx@users.sourceforge.net)
+ */
+
+#include "simd.h"
+#include "util.h"
+#include "video.h"
+
+// _shadowColorLut remaps the indexes below 144 when the shadow layer color is greater or equal to 144
+
+static void applyShadowColors_C(uint8_t *dst, int dstPitch, int w, int h, const uint8_t *projectionData, const uint8_t *shadowLayer, const uint8_t *lut) {
+	for (int j = 0; j < h; ++j) {
+		for (int i = 0; i < w; ++i) {
+			const int offset = READ_LE_UINT16(projectionData); projectionData += 2;
+			assert(offset <= Video::W * Video::H);
+			const uint8_t a = shadowLayer[offset];
+			const uint8_t b = dst[i];
+			dst[i] = (a >= 144 && b < 144) ? lut[b] : b;
+		}
+		dst += dstPitch;
+	}
+}
+
+// the pixels are displaced by up to 15 columns, only the last 16 pixels of a row need clamping
+
+static void transformShadowLayer_C(uint8_t *dst, const uint8_t *src, const uint8_t *offsets, int h) {
+	for (int y = 0; y < h; ++y) {
+		for (int x = 0; x < Video::W - 16; ++x) {
+			dst[x] = src[x + offsets[x]];
+		}
+		for (int x = Video::W - 16; x < Video::W; ++x) {
+			dst[x] = src[MIN(Video::W - 1, x + offsets[x])];
+		}
+		dst += Video::W;
+		src += Video::W;
+		offsets += Video::W;
+	}
+}
+
+#ifdef SIMD_X86
+
+// 144 entries lookup with 9 16-bytes shuffles, indexes greater or equal to 144 are unchanged
+TARGET_SSE41 static inline __m128i remapColors_SSE41(__m128i b, const __m128i *tables) {
+	const __m128i lowNibble = _mm_set1_epi8(0x0F);
+	const __m128i index = _mm_and_si128(b, lowNibble);
+	const __m128i table = _mm_and_si128(_mm_srli_epi16(b, 4), lowNibble);
+	__m128i r = b;
+	for (int k = 0; k < 9; ++k) {
+		const __m128i mask = _mm_cmpeq_epi8(table, _mm_set1_epi8(k));
+		r = _mm_blendv_epi8(r, _mm_shuffle_epi8(tables[k], index), mask);
+	}
+	return r;
+}
+
+TARGET_SSE41 static void applyShadowColors_SSE41(uint8_t *dst, int dstPitch, int w, int h, const uint8_t *projectionData, const uint8_t *shadowLayer, const uint8_t *lut) {
+	__m128i tables[9];
+	for (int k = 0; k < 9; ++k) {
+		tables[k] = _mm_loadu_si128((const __m128i *)(lut + k * 16));
+	}
+	const __m128i threshold = _mm_set1_epi8((char)144);
+	for (int j = 0; j < h; ++j) {
+		int i = 0;
+		for (; i + 16 <= w; i += 16) {
+			uint8_t shadow[16];
+			for (int k = 0; k < 16; ++k) {
+				shadow[k] = shadowLayer[READ_LE_UINT16(projectionData + k * 2)];
+			}
+			projectionData += 32;
+			const __m128i a = _mm_loadu_si128((const __m128i *)shadow);
+			const __m128i b = _mm_loadu_si128((const __m128i *)(dst + i));
+			const __m128i mask = _mm_cmpeq_epi8(_mm_max_epu8(a, threshold), a);
+			_mm_storeu_si128((__m128i *)(dst + i), _mm_blendv_epi8(b, remapColors_SSE41(b, tables), mask));
+		}
+		for (; i < w; ++i) {
+			const uint8_t a = shadowLayer[READ_LE_UINT16(projectionData)]; projectionData += 2;
+			const uint8_t b = dst[i];
+			dst[i] = (a >= 144 && b < 144) ? lut[b] : b;
+		}
+		dst += dstPitch;
+	}
+}
+
+// gathers 16 bytes, the shadow layer buffer is padded for the 32 bits reads
+TARGET_AVX2 static inline __m128i gatherShadow_AVX2(const uint8_t *shadowLayer, const uint8_t *projectionData) {
+	const __m256i byteMask = _mm256_set1_epi32(0xFF);
+	const __m256i offsets0 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)projectionData));
+	const __m256i offsets1 = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)(projectionData + 16)));
+	const __m256i a0 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)shadowLayer, offsets0, 1), byteMask);
+	const __m256i a1 = _mm256_and_si256(_mm256_i32gather_epi32((const int *)shadowLayer, offsets1, 1), byteMask);
+	const __m256i a = _mm256_permute4x64_epi64(_mm256_packus_epi32(a0, a1), _MM_SHUFFLE(3, 1, 2, 0));
+	return _mm_packus_epi16(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1));
+}
+
+TARGET_AVX2 static void applyShadowColors_AVX2(uint8_t *dst, int dstPitch, int w, int h, const uint8_t *projectionData, const uint8_t *shadowLayer, const uint8_t *lut) {
+	__m256i tables[9];
+	for (int k = 0; k < 9; ++k) {
+		tables[k] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(lut + k * 16)));
+	}
+	const __m256i threshold = _mm256_set1_epi8((char)144);
+	const __m256i lowNibble = _mm256_set1_epi8(0x0F);
+	for (int j = 0; j < h; ++j) {
+		int i = 0;
+		for (; i + 32 <= w; i += 32) {
+			const __m256i a = _mm256_inserti128_si256(_mm256_castsi128_si256(gatherShadow_AVX2(shadowLayer, projectionData)), gatherShadow_AVX2(shadowLayer, projectionData + 32), 1);
+			projectionData += 64;
+			const __m256i b = _mm256_loadu_si256((const __m256i *)(dst + i));
+			const __m256i index = _mm256_and_si256(b, lowNibble);
+			const __m256i table = _mm256_and_si256(_mm256_srli_epi16(b, 4), lowNibble);
+			__m256i r = b;
+			for (int k = 0; k < 9; ++k) {
+				const __m256i mask = _mm256_cmpeq_epi8(table, _mm256_set1_epi8(k));
+				r = _mm256_blendv_epi8(r, _mm256_shuffle_epi8(tables[k], index), mask);
+			}
+			const __m256i mask = _mm256_cmpeq_epi8(_mm256_max_epu8(a, threshold), a);
+			_mm256_storeu_si256((__m256i *)(dst + i), _mm256_blendv_epi8(b, r, mask));
+		}
+		for (; i < w; ++i) {
+			const uint8_t a = shadowLayer[READ_LE_UINT16(projectionData)]; projectionData += 2;
+			const uint8_t b = dst[i];
+			dst[i] = (a >= 144 && b < 144) ? lut[b] : b;
+		}
+		dst += dstPitch;
+	}
+}
+
+// 32 entries lookup with 2 shuffles, indexes with the top bit set select zero
+TARGET_SSE41 static void transformShadowLayer_SSE41(uint8_t *dst, const uint8_t *src, const uint8_t *offsets, int h) {
+	const __m128i lane = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+	const __m128i selectLow = _mm_set1_epi8(0x70);
+	const __m128i selectHigh = _mm_set1_epi8(16);
+	const __m128i lastColumn = _mm_set1_epi8(15);
+	for (int y = 0; y < h; ++y) {
+		int x = 0;
+		for (; x < Video::W - 16; x += 16) {
+			const __m128i index = _mm_add_epi8(lane, _mm_loadu_si128((const __m128i *)(offsets + x)));
+			const __m128i lo = _mm_loadu_si128((const __m128i *)(src + x));
+			const __m128i hi = _mm_loadu_si128((const __m128i *)(src + x + 16));
+			const __m128i r = _mm_or_si128(_mm_shuffle_epi8(lo, _mm_adds_epu8(index, selectLow)), _mm_shuffle_epi8(hi, _mm_sub_epi8(index, selectHigh)));
+			_mm_storeu_si128((__m128i *)(dst + x), r);
+		}
+		const __m128i index = _mm_min_epu8(_mm_add_epi8(lane, _mm_loadu_si128((const __m128i *)(offsets + x))), lastColumn);
+		_mm_storeu_si128((__m128i *)(dst + x), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + x)), index));
+		dst += Video::W;
+		src += Video::W;
+		offsets += Video::W;
+	}
+}
+
+#endif
+
+#ifdef SIMD_NEON
+
+static void applyShadowColors_NEON(uint8_t *dst, int dstPitch, int w, int h, const uint8_t *projectionData, const uint8_t *shadowLayer, const uint8_t *lut) {
+	uint8x16x4_t table0, table1;
+	for (int k = 0; k < 4; ++k) {
+		table0.val[k] = vld1q_u8(lut + k * 16);
+		table1.val[k] = vld1q_u8(lut + 64 + k * 16);
+	}
+	const uint8x16_t table2 = vld1q_u8(lut + 128);
+	const uint8x16_t threshold = vdupq_n_u8(144);
+	for (int j = 0; j < h; ++j) {
+		int i = 0;
+		for (; i + 16 <= w; i += 16) {
+			uint8_t shadow[16];
+			for (int k = 0; k < 16; ++k) {
+				shadow[k] = shadowLayer[READ_LE_UINT16(projectionData + k * 2)];
+			}
+			projectionData += 32;
+			const uint8x16_t a = vld1q_u8(shadow);
+			const uint8x16_t b = vld1q_u8(dst + i);
+			// out of range indexes leave the lookup result unchanged
+			uint8x16_t r = vqtbl4q_u8(table0, b);
+			r = vqtbx4q_u8(r, table1, vsubq_u8(b, vdupq_n_u8(64)));
+			r = vqtbx1q_u8(r, table2, vsubq_u8(b, vdupq_n_u8(128)));
+			const uint8x16_t mask = vandq_u8(vcgeq_u8(a, threshold), vcltq_u8(b, threshold));
+			vst1q_u8(dst + i, vbslq_u8(mask, r, b));
+		}
+		for (; i < w; ++i) {
+			const uint8_t a = shadowLayer[READ_LE_UINT16(projectionData)]; projectionData += 2;
+			const uint8_t b = dst[i];
+			dst[i] = (a >= 144 && b < 144) ? lut[b] : b;
+		}
+		dst += dstPitch;
+	}
+}
+
+static void transformShadowLayer_NEON(uint8_t *dst, const uint8_t *src, const uint8_t *offsets, int h) {
+	static const uint8_t kLane[16] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+	const uint8x16_t lane = vld1q_u8(kLane);
+	const uint8x16_t lastColumn = vdupq_n_u8(15);
+	for (int y = 0; y < h; ++y) {
+		int x = 0;
+		for (; x < Video::W - 16; x += 16) {
+			const uint8x16_t index = vaddq_u8(lane, vld1q_u8(offsets + x));
+			uint8x16x2_t table;
+			table.val[0] = vld1q_u8(src + x);
+			table.val[1] = vld1q_u8(src + x + 16);
+			vst1q_u8(dst + x, vqtbl2q_u8(table, index));
+		}
+		const uint8x16_t index = vminq_u8(vaddq_u8(lane, vld1q_u8(offsets + x)), lastColumn);
+		vst1q_u8(dst + x, vqtbl1q_u8(vld1q_u8(src + x), index));
+		dst += Video::W;
+		src += Video::W;
+		offsets += Video::W;
+	}
+}
+
+#endif
+
+ApplyShadowColorsProc getApplyShadowColorsProc(uint32_t cpuFeatures, const char **name) {
+	const char *procName = "c";
+	ApplyShadowColorsProc proc = applyShadowColors_C;
+#ifdef SIMD_X86
+	if (cpuFeatures & kCpuFeatureAvx2) {
+		procName = "avx2";
+		proc = applyShadowColors_AVX2;
+	} else if (cpuFeatures & kCpuFeatureSse41) {
+		procName = "sse41";
+		proc = applyShadowColors_SSE41;
+	}
+#endif
+#ifdef SIMD_NEON
+	if (cpuFeatures & kCpuFeatureNeon) {
+		procName = "neon";
+		proc = applyShadowColors_NEON;
+	}
+#endif
+	if (name) {
+		*name = procName;
+	}
+	return proc;
+}
+
+TransformShadowLayerProc getTransformShadowLayerProc(uint32_t cpuFeatures, const char **name) {
+	const char *procName = "c";
+	TransformShadowLayerProc proc = transformShadowLayer_C;
+#ifdef SIMD_X86
+	if (cpuFeatures & kCpuFeatureSse41) {
+		procName = "sse41";
+		proc = transformShadowLayer_SSE41;
+	}
+#endif
+#ifdef SIMD_NEON
+	if (cpuFeatures & kCpuFeatureNeon) {
+		procName = "neon";
+		proc = transformShadowLayer_NEON;
+	}
+#endif
+	if (name) {
+		*name = procName;
+	}
+	return proc;
+}